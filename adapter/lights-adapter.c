@@ -1,4 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0
+#include <linux/completion.h>
+#include <linux/hash.h>
+
 #include <adapter/debug.h>
 
 #include "lights-adapter.h"
@@ -31,11 +34,25 @@ static error_t lights_adapter_usb_write (
     struct lights_adapter_client const *client,
     struct lights_adapter_msg const *msg
 );
+static error_t lights_adapter_usb_flush (
+    struct lights_adapter_client const *client
+);
+static error_t lights_adapter_usb_xfer (
+    struct lights_adapter_client const *client,
+    struct lights_adapter_msg *msg
+);
 
+/*
+ * Writes may be queued to the hardware, in which case flush is
+ * called once the last message has been written. When xfer is
+ * given, async jobs hand it their entire chain of messages.
+ */
 struct lights_adapter_vtable {
     enum lights_adapter_protocol proto;
     error_t (*read)(struct lights_adapter_client const *, struct lights_adapter_msg *);
     error_t (*write)(struct lights_adapter_client const *, struct lights_adapter_msg const *);
+    error_t (*flush)(struct lights_adapter_client const *);
+    error_t (*xfer)(struct lights_adapter_client const *, struct lights_adapter_msg *);
 } lights_adapter_vtables[] = {{
     .proto = LIGHTS_PROTOCOL_SMBUS,
     .read  = lights_adapter_smbus_read,
@@ -48,6 +65,8 @@ struct lights_adapter_vtable {
     .proto = LIGHTS_PROTOCOL_USB,
     .read  = lights_adapter_usb_read,
     .write = lights_adapter_usb_write,
+    .flush = lights_adapter_usb_flush,
+    .xfer  = lights_adapter_usb_xfer,
 }};
 
 static inline struct lights_adapter_vtable const *lights_adapter_vtable_get (
@@ -76,6 +95,10 @@ static inline struct lights_adapter_vtable const *lights_adapter_vtable_get (
  * @mempool:     Pool of @lights_context_job
  * @async_queue: Single thread to execute async jobs
  * @i2c_adapter: The adapter being wrapped
+ * @usb:         The USB device being wrapped, by controller and index
+ *
+ * Each USB device has its own context, so devices sharing a driver
+ * are written in parallel.
  */
 struct lights_adapter_context {
     struct lights_adapter_vtable  const *vtable;
@@ -91,7 +114,11 @@ struct lights_adapter_context {
 
     union {
         struct i2c_adapter              *i2c_adapter;
-        struct usb_controller           *usb_controller;
+        struct {
+            struct usb_controller       *controller;
+            uint8_t                     index;
+            char                        name[32];
+        }                               usb;
     };
 };
 #define adapter_from_ref(ptr)( \
@@ -101,6 +128,13 @@ struct lights_adapter_context {
 static LIST_HEAD(lights_adapter_list);
 static DEFINE_SPINLOCK(lights_adapter_lock);
 
+/*
+ * Plugs are found by the task which owns them. Each bucket has its
+ * own bit lock, so tasks only contend when they share a bucket.
+ */
+#define LIGHTS_PLUG_BITS 6
+static struct hlist_bl_head lights_adapter_plugs[1 << LIGHTS_PLUG_BITS];
+
 /**
  * lights_adapter_find() - Searches for a context for a client
  *
@@ -140,7 +174,8 @@ static struct lights_adapter_context *lights_adapter_find (
                     }
                     break;
                 case LIGHTS_PROTOCOL_USB:
-                    if (context->usb_controller == client->usb_client.controller) {
+                    if (context->usb.controller == client->usb_client.controller &&
+                        context->usb.index == client->usb_client.index) {
                         kref_get(&context->refs);
                         return context;
                     }
@@ -160,6 +195,7 @@ static struct lights_adapter_context *lights_adapter_find (
  * @client:     Adapter and address
  * @thunk:      Callers suplemental completion data
  * @completion: Callers completion handler
+ * @batch:      Plugged jobs, or jobs executed alongside this one
  *
  * The objects are memory pool managed. A linked list of messages
  * consists of one fully initialized job head, followed by zero
@@ -171,6 +207,7 @@ struct lights_adapter_job {
     struct lights_adapter_client    client;
     struct lights_thunk             *thunk;
     lights_adapter_done_t           completion;
+    struct list_head                batch;
 };
 #define job_from_async(ptr)( \
     container_of(ptr, struct lights_adapter_job, async) \
@@ -424,6 +461,9 @@ static error_t lights_adapter_usb_read (
  * @msg:    Provided by the adapter caller
  *
  * @return: Zero or negative error number
+ *
+ * The packet is only queued, the packets of a job are sent
+ * together and awaited by lights_adapter_usb_flush().
  */
 static error_t lights_adapter_usb_write (
     struct lights_adapter_client const *client,
@@ -434,7 +474,52 @@ static error_t lights_adapter_usb_write (
         .data = (char*)msg->data.block
     };
 
-    return usb_write_packet(&client->usb_client, &pkt);
+    return usb_queue_packet(&client->usb_client, &pkt);
+}
+
+/**
+ * lights_adapter_usb_flush() - Waits for queued writes
+ *
+ * @client: Provided by the adapter caller
+ *
+ * @return: Zero or negative error number
+ */
+static error_t lights_adapter_usb_flush (
+    struct lights_adapter_client const *client
+){
+    return usb_flush_packets(&client->usb_client);
+}
+
+/**
+ * lights_adapter_usb_xfer() - Processes a chain of messages
+ *
+ * @client: Provided by the adapter caller
+ * @msg:    First of the linked messages
+ *
+ * @return: Zero or negative error number
+ *
+ * The whole chain is given to the device in a single call, read
+ * messages are populated with their responses.
+ */
+static error_t lights_adapter_usb_xfer (
+    struct lights_adapter_client const *client,
+    struct lights_adapter_msg *msg
+){
+    struct usb_packet pkts[LIGHTS_ADAPTER_MAX_MSGS];
+    size_t count = 0;
+
+    for (; msg && count < ARRAY_SIZE(pkts); msg = msg->next) {
+        pkts[count++] = (struct usb_packet){
+            .length = msg->length,
+            .data = msg->data.block,
+            .read = msg->flags & MSG_READ,
+        };
+    }
+
+    if (msg)
+        return -E2BIG;
+
+    return usb_write_packets(&client->usb_client, pkts, count);
 }
 
 /**
@@ -488,7 +573,7 @@ static void lights_adapter_job_execute (
     struct lights_adapter_msg *msg;
     int sanity = LIGHTS_ADAPTER_MAX_MSGS;
     int count = 0;
-    error_t err = 0;
+    error_t err = 0, flushed;
 
     if (IS_NULL(async_job))
         return;
@@ -504,6 +589,19 @@ static void lights_adapter_job_execute (
     if (state == ASYNC_STATE_RUNNING) {
         mutex_lock(&context->lock);
 
+        /* The whole chain is given to the hardware at once */
+        if (context->vtable->xfer) {
+            err = context->vtable->xfer(&job->client, msg);
+
+            while (msg && --sanity) {
+                msg = msg->next;
+                count++;
+            }
+
+            msg = &job->msg;
+            goto unlock;
+        }
+
         /* Process each message in the job */
         while (msg && --sanity) {
             if (msg->flags & MSG_READ)
@@ -518,6 +616,16 @@ static void lights_adapter_job_execute (
             count++;
         }
 
+        /* Queued writes are only awaited once */
+        if (context->vtable->flush) {
+            flushed = context->vtable->flush(&job->client);
+            if (flushed && !err) {
+                err = flushed;
+                msg = &job->msg;
+            }
+        }
+
+unlock:
         mutex_unlock(&context->lock);
 
         if (!sanity)
@@ -533,6 +641,136 @@ static void lights_adapter_job_execute (
         LIGHTS_ERR("Disparity between job count and jobs freed");
 }
 
+/**
+ * lights_adapter_batch_execute() - Processes a group of queued jobs
+ *
+ * @async_job: The head of the first job
+ *
+ * Each job within the group is executed in the order it was submitted.
+ * The group is a single entry in the queue, so no synchronous transfer
+ * may run between them.
+ */
+static void lights_adapter_batch_execute (
+    struct async_job *async_job,
+    enum async_queue_state state
+){
+    struct lights_adapter_job * const head = job_from_async(async_job);
+    struct lights_adapter_job *job, *safe;
+    LIST_HEAD(batch);
+
+    if (IS_NULL(async_job))
+        return;
+
+    /* The head is freed once executed */
+    list_splice_init(&head->batch, &batch);
+
+    lights_adapter_job_execute(&head->async, state);
+
+    list_for_each_entry_safe(job, safe, &batch, batch) {
+        list_del(&job->batch);
+        lights_adapter_job_execute(&job->async, state);
+    }
+}
+
+/**
+ * lights_adapter_plug_bucket() - Fetches the bucket of a task
+ *
+ * @task: Owner of the plug
+ *
+ * @return: The list holding the plugs of @task
+ */
+static inline struct hlist_bl_head *lights_adapter_plug_bucket (
+    struct task_struct const *task
+){
+    return &lights_adapter_plugs[hash_ptr(task, LIGHTS_PLUG_BITS)];
+}
+
+/**
+ * lights_adapter_plug_find() - Fetches the plug of the current thread
+ *
+ * @return: NULL or the plug
+ */
+static struct lights_adapter_plug *lights_adapter_plug_find (
+    void
+){
+    struct hlist_bl_head *bucket = lights_adapter_plug_bucket(current);
+    struct lights_adapter_plug *plug;
+    struct hlist_bl_node *pos;
+
+    if (hlist_bl_empty(bucket))
+        return NULL;
+
+    hlist_bl_lock(bucket);
+
+    hlist_bl_for_each_entry(plug, pos, bucket, node) {
+        if (plug->task == current)
+            goto found;
+    }
+
+    plug = NULL;
+
+found:
+    hlist_bl_unlock(bucket);
+
+    return plug;
+}
+
+/**
+ * lights_adapter_plug_flush() - Queues every job held by a plug
+ *
+ * @plug:   The plug of the current thread
+ * @target: Adapter of interest, may be NULL
+ *
+ * @return: True if any job was queued on @target
+ *
+ * The held jobs are grouped by adapter, each group being a single
+ * entry in the queue of at most max_async jobs.
+ */
+static bool lights_adapter_plug_flush (
+    struct lights_adapter_plug *plug,
+    struct lights_adapter_context const *target
+){
+    struct lights_adapter_context *context;
+    struct lights_adapter_job *head, *job, *safe;
+    bool queued = false;
+    size_t count;
+    error_t err;
+
+    while (!list_empty(&plug->jobs)) {
+        head = list_first_entry(&plug->jobs, struct lights_adapter_job, batch);
+        list_del_init(&head->batch);
+        context = head->client.adapter;
+        count = 1;
+
+        /* Move the following jobs for the same adapter behind the head */
+        list_for_each_entry_safe(job, safe, &plug->jobs, batch) {
+            if (context->max_async && count >= context->max_async)
+                break;
+
+            if (job->client.adapter == context) {
+                list_move_tail(&job->batch, &head->batch);
+                count++;
+            }
+        }
+
+        if (!list_empty(&head->batch))
+            INIT_ASYNC_JOB(&head->async, lights_adapter_batch_execute);
+
+        err = async_queue_add(context->async_queue, &head->async);
+        if (err) {
+            LIGHTS_ERR("Failed to add async job: %d", err);
+            /* Notifies each caller and frees the jobs */
+            lights_adapter_batch_execute(&head->async, ASYNC_STATE_CANCELLED);
+            continue;
+        }
+
+        if (context == target)
+            queued = true;
+    }
+
+    return queued;
+}
+
 /**
  * lights_adapter_job_create() - Creates a linked list of messages
  *
@@ -571,6 +809,7 @@ static struct lights_adapter_job *lights_adapter_job_create (
     }
 
     INIT_ASYNC_JOB(&head->async, lights_adapter_job_execute);
+    INIT_LIST_HEAD(&head->batch);
 
     return head;
 }
@@ -615,6 +854,97 @@ error:
 }
 
 
+/**
+ * struct lights_adapter_wait - A synchronous transfer made through the queue
+ *
+ * @thunk: Passed to the completion
+ * @done:  Signalled once executed
+ * @msgs:  The callers messages, populated with any reads
+ * @count: Number of @msgs
+ * @err:   Result of the transfer
+ */
+struct lights_adapter_wait {
+    struct lights_thunk         thunk;
+    struct completion           done;
+    struct lights_adapter_msg   *msgs;
+    size_t                      count;
+    error_t                     err;
+};
+
+/**
+ * lights_adapter_wait_done() - Completes a queued synchronous transfer
+ *
+ * @result: The first message, or the erroring message
+ * @thunk:  The waiting transfer
+ * @error:  Zero or a negative error number
+ */
+static void lights_adapter_wait_done (
+    struct lights_adapter_msg const * const result,
+    struct lights_thunk *thunk,
+    error_t error
+){
+    struct lights_adapter_wait *wait = lights_thunk_container(thunk, struct lights_adapter_wait, thunk, 'WAIT');
+    struct lights_adapter_msg const *msg = result;
+    size_t i;
+
+    if (!wait)
+        return;
+
+    /* On success, the result is the head of the chain */
+    for (i = 0; !error && msg && i < wait->count; i++, msg = msg->next)
+        wait->msgs[i].data = msg->data;
+
+    wait->err = error;
+    complete(&wait->done);
+}
+
+/**
+ * lights_adapter_xfer_queued() - Synchronous reads/writes behind queued jobs
+ *
+ * @context: Adapter of the client
+ * @client:  Hardware parameters
+ * @msgs:    One or more messages to send
+ * @count:   Number of messages to send
+ *
+ * @return: Zero or a negative error code
+ *
+ * Used once the jobs of a plug have been flushed, so the transfer is
+ * executed after them rather than ahead.
+ */
+static error_t lights_adapter_xfer_queued (
+    struct lights_adapter_context *context,
+    struct lights_adapter_client const *client,
+    struct lights_adapter_msg *msgs,
+    size_t count
+){
+    struct lights_adapter_wait wait = {
+        .msgs  = msgs,
+        .count = count,
+    };
+    struct lights_adapter_job *job;
+    error_t err;
+
+    lights_thunk_init(&wait.thunk, 'WAIT');
+    init_completion(&wait.done);
+
+    job = lights_adapter_job_create(context, count, msgs);
+    job->client         = *client;
+    job->client.adapter = context;
+    job->completion     = lights_adapter_wait_done;
+    job->thunk          = &wait.thunk;
+
+    err = async_queue_add(context->async_queue, &job->async);
+    if (err) {
+        LIGHTS_ERR("Failed to add async job: %d", err);
+        lights_adapter_job_free(job);
+        return err;
+    }
+
+    wait_for_completion(&wait.done);
+
+    return wait.err;
+}
+
 /**
  * lights_adapter_xfer() - Synchronous reads/writes
  *
@@ -631,6 +961,7 @@ error_t lights_adapter_xfer (
 ){
     struct lights_adapter_context *context;
     struct lights_adapter_vtable const *vtable;
+    struct lights_adapter_plug *plug;
     error_t err = 0;
     int i;
 
@@ -645,6 +976,14 @@ error_t lights_adapter_xfer (
     if (IS_ERR(context))
         return CLEAR_ERR(context);
 
+    /* Jobs held by a plug were submitted first, so they go first */
+    plug = lights_adapter_plug_find();
+    if (plug && lights_adapter_plug_flush(plug, context)) {
+        err = lights_adapter_xfer_queued(context, client, msgs, count);
+        kref_put(&context->refs, lights_adapter_destroy);
+        return err;
+    }
+
     if (context) {
         if (context->async_queue)
             async_queue_pause(context->async_queue);
@@ -658,6 +997,12 @@ error_t lights_adapter_xfer (
             err = vtable->write(client, &msgs[i]);
     }
 
+    if (vtable->flush) {
+        error_t flushed = vtable->flush(client);
+        if (!err)
+            err = flushed;
+    }
+
     if (context) {
         mutex_unlock(&context->lock);
         if (context->async_queue)
@@ -689,6 +1034,7 @@ error_t lights_adapter_xfer_async (
     lights_adapter_done_t callback
 ){
     struct lights_adapter_context *context;
+    struct lights_adapter_plug *plug;
     struct lights_adapter_job *job;
     error_t err = 0;
 
@@ -703,6 +1049,13 @@ error_t lights_adapter_xfer_async (
     job->completion = callback;
     job->thunk      = thunk;
 
+    /* Held until lights_adapter_unplug() */
+    plug = lights_adapter_plug_find();
+    if (plug) {
+        list_add_tail(&job->batch, &plug->jobs);
+        return 0;
+    }
+
     err = async_queue_add(context->async_queue, &job->async);
     if (err) {
         LIGHTS_ERR("Failed to add async job: %d", err);
@@ -713,6 +1066,61 @@ error_t lights_adapter_xfer_async (
 }
 EXPORT_SYMBOL_NS_GPL(lights_adapter_xfer_async, LIGHTS);
 
+/**
+ * lights_adapter_plug() - Begins batching async jobs
+ *
+ * @plug: Storage for the held jobs, usually on the stack
+ */
+void lights_adapter_plug (
+    struct lights_adapter_plug *plug
+){
+    struct hlist_bl_head *bucket = lights_adapter_plug_bucket(current);
+
+    if (IS_NULL(plug))
+        return;
+
+    INIT_LIST_HEAD(&plug->jobs);
+    plug->task = current;
+
+    hlist_bl_lock(bucket);
+    hlist_bl_add_head(&plug->node, bucket);
+    hlist_bl_unlock(bucket);
+}
+EXPORT_SYMBOL_NS_GPL(lights_adapter_plug, LIGHTS);
+
+/**
+ * lights_adapter_unplug() - Submits all jobs held by the plug
+ *
+ * @plug: Previously passed to @lights_adapter_plug
+ */
+void lights_adapter_unplug (
+    struct lights_adapter_plug *plug
+){
+    struct hlist_bl_head *bucket = lights_adapter_plug_bucket(current);
+
+    if (IS_NULL(plug))
+        return;
+
+    hlist_bl_lock(bucket);
+    hlist_bl_del(&plug->node);
+    hlist_bl_unlock(bucket);
+
+    lights_adapter_plug_flush(plug, NULL);
+}
+EXPORT_SYMBOL_NS_GPL(lights_adapter_unplug, LIGHTS);
+
+/**
+ * lights_adapter_plugged() - Tests for a plug on the current thread
+ *
+ * @return: True when async jobs of the current thread are held back
+ */
+bool lights_adapter_plugged (
+    void
+){
+    return lights_adapter_plug_find() != NULL;
+}
+EXPORT_SYMBOL_NS_GPL(lights_adapter_plugged, LIGHTS);
+
 /**
  * lights_adapter_unregister() - Releases an async adapter
  *
@@ -801,8 +1209,11 @@ error_t lights_adapter_register (
                     goto error_free;
 
                 usb_registered = true;
-                context->name = client->usb_client.name;
-                context->usb_controller = client->usb_client.controller;
+                context->usb.controller = client->usb_client.controller;
+                context->usb.index = client->usb_client.index;
+                snprintf(context->usb.name, sizeof(context->usb.name), "%s-%u",
+                    client->usb_client.name, client->usb_client.index);
+                context->name = context->usb.name;
                 LIGHTS_DBG("Created USB adapter '%s'", context->name);
                 break;
             default:
@@ -4,6 +4,7 @@
 
 #include <linux/module.h>
 #include <linux/i2c.h>
+#include <linux/list_bl.h>
 
 #include <include/quirks.h>
 #include <include/types.h>
@@ -158,6 +159,58 @@ error_t lights_adapter_xfer_async (
     lights_adapter_done_t callback
 );
 
+/**
+ * struct lights_adapter_plug - Holds back async jobs of the current thread
+ *
+ * @node: Entry in the bucket of @task
+ * @jobs: Jobs queued while plugged
+ * @task: The thread which owns the plug
+ */
+struct lights_adapter_plug {
+    struct hlist_bl_node    node;
+    struct list_head        jobs;
+    struct task_struct      *task;
+};
+
+/**
+ * lights_adapter_plug() - Begins batching async jobs
+ *
+ * @plug: Storage for the held jobs, usually on the stack
+ *
+ * Until @lights_adapter_unplug is called, any @lights_adapter_xfer_async
+ * made by the calling thread is held back. This allows a caller to update
+ * many devices, across many adapters, and have them applied together.
+ *
+ * A @lights_adapter_xfer made while plugged first queues the held jobs,
+ * and is then executed behind them.
+ */
+void lights_adapter_plug (
+    struct lights_adapter_plug *plug
+);
+
+/**
+ * lights_adapter_unplug() - Submits all jobs held by the plug
+ *
+ * @plug: Previously passed to @lights_adapter_plug
+ *
+ * The held jobs are grouped by adapter and each group, of at most the
+ * adapter's max_async jobs, is queued as a single job in the order they
+ * were originally submitted. Should queueing fail, the completion
+ * handlers are called with -ECANCELED.
+ */
+void lights_adapter_unplug (
+    struct lights_adapter_plug *plug
+);
+
+/**
+ * lights_adapter_plugged() - Tests for a plug on the current thread
+ *
+ * @return: True when async jobs of the current thread are held back
+ */
+bool lights_adapter_plugged (
+    void
+);
+
 /**
  * lights_adapter_unregister() - Releases an async adapter
  *
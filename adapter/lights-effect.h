@@ -19,6 +19,11 @@ enum lights_effect_id {
     LIGHTS_EFFECT_ID_FLASHING     = 0x0004,
     LIGHTS_EFFECT_ID_CYCLE        = 0x0005,
     LIGHTS_EFFECT_ID_RAINBOW      = 0x0006,
+
+    /* Rendered by the lights module, 0x40 to 0x7F are reserved */
+    LIGHTS_EFFECT_ID_SW_BREATHING = 0x0040,
+    LIGHTS_EFFECT_ID_SW_RAINBOW   = 0x0041,
+    LIGHTS_EFFECT_ID_SW_CHASE     = 0x0042,
 };
 
 #define LIGHTS_EFFECT_LABEL_OFF       "off"
@@ -28,6 +33,10 @@ enum lights_effect_id {
 #define LIGHTS_EFFECT_LABEL_CYCLE     "cycle"
 #define LIGHTS_EFFECT_LABEL_RAINBOW   "rainbow"
 
+#define LIGHTS_EFFECT_LABEL_SW_BREATHING "sw_breathing"
+#define LIGHTS_EFFECT_LABEL_SW_RAINBOW   "sw_rainbow"
+#define LIGHTS_EFFECT_LABEL_SW_CHASE     "sw_chase"
+
 /**
  * struct lights_mode
  *
@@ -60,6 +69,10 @@ struct lights_effect {
     ((effect)->id & 0xff00) \
 )
 
+#define lights_effect_is_software(effect) ( \
+    ((effect)->id & 0xffc0) == 0x0040 \
+)
+
 #define lights_effect_is_equal(eff1, eff2) ( \
     ((eff1)->id == (eff2)->id && 0 == memcmp((eff1)->name, (eff2)->name, LIGHTS_EFFECT_MAX_NAME_LENGTH)) \
 )
@@ -6,16 +6,41 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/list.h>
+#include <linux/hashtable.h>
+#include <linux/stringhash.h>
+#include <linux/poll.h>
+#include <linux/seqlock.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/math64.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/hrtimer.h>
+#include <linux/bitops.h>
+#include <linux/idr.h>
+#include <linux/rcupdate.h>
 
 #include <adapter/debug.h>
 #include <include/quirks.h>
 
 #include "lights-interface.h"
+#include "lights-adapter.h"
+#include "lights-renderer.h"
 
 #define LIGHTS_FIRST_MINOR          0
 #define LIGHTS_MAX_MINORS           512
-#define LIGHTS_MAX_DEVICES          512
+#define LIGHTS_RAW_MAX              PAGE_SIZE
+#define LIGHTS_CAPS_HASH_BITS       6
+#define LIGHTS_EFFECT_HASH_BITS     4
+
+static unsigned int sync_interval = 10000;
+module_param(sync_interval, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(sync_interval, "Milliseconds between effect clock corrections, 0 to disable");
+
+static bool single_node;
+module_param(single_node, bool, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(single_node, "Access the files of each zone through a single character device");
 
 static struct {
     struct class        *class;
@@ -26,13 +51,27 @@ static struct {
         struct list_head    list;
         spinlock_t          lock;
         size_t              count;
-    }                   interface,
-                        caps;
-    spinlock_t          state_lock;
+    }                   interface;
+    struct {
+        struct list_head    list;
+        spinlock_t          lock;
+        size_t              count;
+        size_t              interfaces;
+        DECLARE_HASHTABLE(by_id, LIGHTS_CAPS_HASH_BITS);
+        DECLARE_HASHTABLE(by_name, LIGHTS_CAPS_HASH_BITS);
+        char                *text;
+        ssize_t             text_len;
+        bool                text_valid;
+    }                   caps;
+    seqlock_t           state_lock;
+    struct delayed_work sync_work;
+    struct {
+        struct list_head    list;
+        struct mutex        lock;
+    }                   group;
     atomic_t            next_id;
     int                 major;
-    spinlock_t          minor_lock;
-    unsigned long       minor_map[BITS_TO_LONGS(LIGHTS_MAX_MINORS)];
+    struct ida          minors;
 } lights_global = {
     .interface = {
         .list = LIST_HEAD_INIT(lights_global.interface.list),
@@ -43,9 +82,14 @@ static struct {
         .list = LIST_HEAD_INIT(lights_global.caps.list),
         .lock = __SPIN_LOCK_UNLOCKED(lights_global.caps.lock),
         .count = 0,
+        .interfaces = 0,
     },
-    .state_lock = __SPIN_LOCK_UNLOCKED(lights_global.state_lock),
-    .minor_lock = __SPIN_LOCK_UNLOCKED(lights_global.minor_lock),
+    .group = {
+        .list = LIST_HEAD_INIT(lights_global.group.list),
+        .lock = __MUTEX_INITIALIZER(lights_global.group.lock),
+    },
+    .state_lock = __SEQLOCK_UNLOCKED(lights_global.state_lock),
+    .minors = IDA_INIT(lights_global.minors),
     .next_id = ATOMIC_INIT(0),
     .all = { .name = "all" },
 };
@@ -64,59 +108,213 @@ static struct lights_effect lights_available_effects[] = {
  * struct lights_caps - Tracker for accumulated effects
  *
  * @siblings:  Next and prev pointers
+ * @by_id:     Node within lights_global.caps.by_id
+ * @by_name:   Node within lights_global.caps.by_name
  * @effect:      Copy of effect
  * @ref_count: Number of interfaces using this effect
  */
 struct lights_caps {
     struct list_head        siblings;
+    struct hlist_node       by_id;
+    struct hlist_node       by_name;
     struct lights_effect    effect;
     uint32_t                ref_count;
 };
 
+/**
+ * struct lights_effect_node - Hash table entry of an interface effect
+ *
+ * @by_name: Node within lights_interface.effects
+ * @effect:  Effect owned by the driver
+ */
+struct lights_effect_node {
+    struct hlist_node               by_name;
+    struct lights_effect const      *effect;
+};
+
+/**
+ * lights_effect_hash() - Hashes the name of an effect
+ *
+ * @name: Null terminated name
+ *
+ * @return: Hash value
+ */
+static inline unsigned int lights_effect_hash (
+    const char *name
+){
+    return full_name_hash(NULL, name, strnlen(name, LIGHTS_EFFECT_MAX_NAME_LENGTH));
+}
+
 /**
  * struct lights_file - Character device wrapper
  *
  * @minor:    Minor number of device
- * @cdev:     Character device
+ * @cdev:     Character device, outlives the file while open
  * @dev:      Device instance
  * @siblings: Next and prev pointers
  * @attr:     Attributes the device was created with
  * @intf:     Owning interface
  * @fops:     File operations of the device
+ * @raw:      LIGHTS_RAW_MAX buffer of a LIGHTS_TYPE_CUSTOM file
+ * @raw_lock: Lock for @raw, or the led buffer of the interface
  */
 struct lights_file {
     unsigned long                       minor;
-    struct cdev                         cdev;
+    struct cdev                         *cdev;
     struct device                       *dev;
     struct list_head                    siblings;
     struct lights_attribute     attr;
     struct lights_interface             *intf;
-    struct file_operations              fops;
+    struct file_operations const        *fops;
+    void                                *raw;
+    struct mutex                        raw_lock;
 };
 #define file_from_attr(ptr) ( \
     container_of(ptr, struct lights_file, attr) \
 )
 
+/**
+ * struct lights_ring - Kernel side of a shared memory frame ring
+ *
+ * @header:   Shared memory, the header followed by the frames
+ * @size:     Size of @header
+ * @frame:    Copy of the frame being pushed
+ * @consumed: Value of head when a frame was last taken
+ * @retries:  Consecutive runs which found their frame overwritten
+ * @waiting:  Set while the pushed frame awaits the device
+ * @pushed:   Time the last frame was pushed
+ * @lock:     Lock for creation and @closed
+ * @work:     Consumer
+ * @closed:   Set once the device has been unregistered
+ */
+struct lights_ring {
+    struct lights_ring_header   *header;
+    size_t                      size;
+    struct lights_color         *frame;
+    uint32_t                    consumed;
+    unsigned int                retries;
+    atomic_t                    waiting;
+    ktime_t                     pushed;
+    struct mutex                lock;
+    struct work_struct          work;
+    bool                        closed;
+};
+
+/**
+ * struct lights_pace - Newest led frame held back by the pacer
+ *
+ * @lock:   Lock for the members
+ * @frame:  Storage of two frames, the one held and the one being sent
+ * @file:   File the held frame was written to, NULL when none is held
+ * @closed: Set once the device has been unregistered
+ * @timer:  Expires once the held frame may be sent
+ * @work:   Sends the held frame
+ */
+struct lights_pace {
+    spinlock_t                  lock;
+    struct lights_color         *frame;
+    struct lights_file const    *file;
+    bool                        closed;
+    struct hrtimer              timer;
+    struct work_struct          work;
+};
+
+struct lights_group;
+
+/* Number of outstanding updates whose submit time is kept */
+#define LIGHTS_SUBMIT_HISTORY   8
+
 /**
  * struct lights_interface - Interface storage
  *
  * @name:      Name of directory/interface
- * @file_lock: Lock for file list (TODO remove, not required)
+ * @file_lock: Lock for file list
  * @file_list: Linked list of character devices
  * @siblings:  Next and prev pointers
- * @ldev:      Public handle
- * @kdev:      Kernel device
+ * @ldev:      Public handle, NULL once unregistered
+ * @kdev:      Kernel device, holds a reference until released
+ * @refs:      Reference count of the memory
+ * @led_count: Copy of the led count of @ldev
+ * @group:     Copy of the group flag of @ldev
+ * @owner:     Group registering the interface, referenced until it is freed
+ * @wait:      Threads polling for update completion
+ * @submitted: Number of updates queued by the driver
+ * @completed: Number of updates the driver has finished
+ * @error:     Result of the last completed update
+ * @submit_times: Time each of the last few updates was submitted
+ * @update_ns: Moving average of the time from submit to completion
+ * @frame_time: Time the last led frame was sent
+ * @fps_limit: Maximum led frames per second, 0 unlimited, -1 measured
+ * @dropped:   Number of led frames dropped by the pacer
+ * @pace:      Led frame held until the pacer allows it
+ * @record_lock: Sequence lock of the state record
+ * @pending:   Every value written to the zone
+ * @inflight:  Copy of @pending when the driver last submitted an update
+ * @applied:   Values the device is known to display
+ * @pending_gen: Generation of @pending, incremented by each write
+ * @inflight_gen: Generation of @inflight
+ * @applied_gen: Generation of @applied
+ * @combine_ms: Write combining window, 0 disables
+ * @combining: Set while the window is open
+ * @combine_lock: Lock for @combined, @combining and @combine_error
+ * @combine_error: Failure of a combined update not yet returned to a writer
+ * @combined:  Properties written while the window is open
+ * @combine_timer: Closes the window
+ * @combine_work: Writes @combined to the driver
+ * @effects:   Hash table of the device caps, by name
+ * @effect_nodes: Storage for @effects
+ * @caps_text: Cached output of /sys/class/lights/___/caps
+ * @caps_len:  Length of @caps_text
+ * @renderer:  Software effect state
+ * @ring:      Shared memory frame ring
+ * @node:      Character device of every file, when single_node is set
+ * @rcu:       Delays the free for lockless lookups of the interface
  */
 struct lights_interface {
     struct list_head        siblings;
     struct lights_dev       *ldev;
     struct device           kdev;
     struct kref             refs;
+    uint16_t                led_count;
+    bool                    group;
+    struct lights_group     *owner;
     struct lights_color     *led_buffer;
     struct lights_file      update;
     struct lights_thunk     thunk;
     struct list_head        file_list;
     spinlock_t              file_lock;
+    wait_queue_head_t       wait;
+    atomic_t                submitted;
+    atomic_t                completed;
+    error_t                 error;
+    ktime_t                 submit_times[LIGHTS_SUBMIT_HISTORY];
+    uint64_t                update_ns;
+    ktime_t                 frame_time;
+    int                     fps_limit;
+    atomic_t                dropped;
+    struct lights_pace      pace;
+    seqlock_t               record_lock;
+    struct lights_state     pending;
+    struct lights_state     inflight;
+    struct lights_state     applied;
+    uint32_t                pending_gen;
+    uint32_t                inflight_gen;
+    uint32_t                applied_gen;
+    unsigned int            combine_ms;
+    bool                    combining;
+    spinlock_t              combine_lock;
+    error_t                 combine_error;
+    struct lights_state     combined;
+    struct hrtimer          combine_timer;
+    struct work_struct      combine_work;
+    DECLARE_HASHTABLE(effects, LIGHTS_EFFECT_HASH_BITS);
+    struct lights_effect_node *effect_nodes;
+    char                    *caps_text;
+    ssize_t                 caps_len;
+    struct lights_renderer  renderer;
+    struct lights_ring      ring;
+    struct cdev             *node;
+    struct rcu_head         rcu;
     uint16_t                id;
     char                    name[LIGHTS_MAX_FILENAME_LENGTH];
 };
@@ -173,11 +371,13 @@ static error_t lights_add_caps (
         return -ENOMEM;
 
     entry->effect = *effect;
-    entry->ref_count = 2;
+    entry->ref_count = 1;
 
     spin_lock(&lights_global.caps.lock);
 
-    list_for_each_entry(iter, &lights_global.caps.list, siblings) {
+    lights_global.caps.text_valid = false;
+
+    hash_for_each_possible(lights_global.caps.by_id, iter, by_id, effect->id) {
         if (iter->effect.id == effect->id) {
             if (0 == strcmp(iter->effect.name, effect->name)) {
                 iter->ref_count++;
@@ -197,11 +397,13 @@ static error_t lights_add_caps (
 
     lights_global.caps.count++;
     list_add_tail(&entry->siblings, &lights_global.caps.list);
+    hash_add(lights_global.caps.by_id, &entry->by_id, entry->effect.id);
+    hash_add(lights_global.caps.by_name, &entry->by_name, lights_effect_hash(entry->effect.name));
 
 exit:
     spin_unlock(&lights_global.caps.lock);
 
-    return 0;
+    return err;
 }
 
 /**
@@ -223,15 +425,19 @@ static void lights_del_caps (
 
     spin_lock(&lights_global.caps.lock);
 
-    list_for_each_entry_safe(iter, safe, &lights_global.caps.list, siblings) {
+    lights_global.caps.text_valid = false;
+
+    hash_for_each_possible_safe(lights_global.caps.by_id, iter, safe, by_id, effect->id) {
         if (iter->effect.id == effect->id) {
             iter->ref_count--;
-            if (1 == iter->ref_count) {
+            if (0 == iter->ref_count) {
                 list_del(&iter->siblings);
+                hash_del(&iter->by_id);
+                hash_del(&iter->by_name);
                 kfree(iter);
                 lights_global.caps.count--;
-                goto exit;
             }
+            goto exit;
         }
     }
 
@@ -257,7 +463,7 @@ static struct lights_effect const *lights_find_caps (
 
     spin_lock(&lights_global.caps.lock);
 
-    list_for_each_entry(iter, &lights_global.caps.list, siblings) {
+    hash_for_each_possible(lights_global.caps.by_name, iter, by_name, lights_effect_hash(name)) {
         if (0 == strcmp(iter->effect.name, name)) {
             effect = &iter->effect;
             goto exit;
@@ -272,6 +478,28 @@ exit:
     return effect;
 }
 
+/**
+ * lights_interface_find_effect() - Searches the caps of an interface
+ *
+ * @intf: Interface to search within
+ * @name: Name of effect to find
+ *
+ * @return: NULL or the effect
+ */
+static struct lights_effect const *lights_interface_find_effect (
+    struct lights_interface *intf,
+    const char *name
+){
+    struct lights_effect_node *node;
+
+    hash_for_each_possible(intf->effects, node, by_name, lights_effect_hash(name)) {
+        if (0 == strcmp(node->effect->name, name))
+            return node->effect;
+    }
+
+    return NULL;
+}
+
 /**
  * lights_find_effect() - Finds a effect from a userland buffer
  *
@@ -304,14 +532,14 @@ static error_t lights_find_effect (
     if (0 == strcmp("all", intf->name)) {
         iter = lights_find_caps(name);
         if (IS_ERR(iter))
-            return CLEAR_ERR(iter);
-
-        memcpy(effect, iter, sizeof(*effect));
-        return 0;
+            iter = lights_renderer_find_effect(name);
+    } else {
+        iter = lights_interface_find_effect(intf, name);
+        if (!iter && (intf->led_count || intf->group))
+            iter = lights_renderer_find_effect(name);
     }
 
-    iter = lights_effect_find_by_name(intf->ldev->caps, name);
-    if (iter) {
+    if (!IS_ERR_OR_NULL(iter)) {
         memcpy(effect, iter, sizeof(*effect));
         return 0;
     }
@@ -333,85 +561,133 @@ static error_t lights_find_effect (
 }
 
 /**
- * lights_dump_caps() - Writes a list of accumulated effects
+ * lights_invalidate_caps() - Marks the cached caps text as stale
  *
- * @buffer: Buffer to write to (PAGE_SIZE length)
+ * The text depends on the number of interfaces, so this must be
+ * called whenever that changes.
+ */
+static inline void lights_invalidate_caps (
+    void
+){
+    spin_lock(&lights_global.caps.lock);
+    lights_global.caps.text_valid = false;
+    spin_unlock(&lights_global.caps.lock);
+}
+
+/**
+ * lights_dump_effects() - Writes a list of effects
  *
- * @return: Number of bytes written or a negative error code
+ * @effects: Zero terminated array of effects to write
+ * @buffer:  Buffer to write into
+ * @size:    Length of @buffer
  *
- * Only the effects sgared by ALL interfaces are written.
+ * @return: Number of bytes written or a negative error code
  */
-static ssize_t lights_dump_caps (
-    char *buffer
+static ssize_t lights_dump_effects (
+    struct lights_effect const *effects,
+    char *buffer,
+    size_t size
 ){
-    struct lights_caps *iter;
+    struct lights_effect const *iter = effects;
     size_t effect_len;
     ssize_t written = 0;
 
-    spin_lock(&lights_global.caps.lock);
-
-    list_for_each_entry(iter, &lights_global.caps.list, siblings) {
-        if (iter->ref_count != lights_global.interface.count)
-            continue;
+    while (iter->id != LIGHTS_EFFECT_ID_INVALID) {
+        if (!iter->name || 0 == iter->name[0])
+            return -EIO;
 
-        effect_len = strlen(iter->effect.name);
+        effect_len = strlen(iter->name);
 
-        if (written + effect_len + 1 > PAGE_SIZE) {
+        if (written + effect_len + 1 > size) {
             written = -ENOMEM;
-            goto exit;
+            break;
         }
 
-        memcpy(buffer, iter->effect.name, effect_len);
+        memcpy(buffer, iter->name, effect_len);
         buffer[effect_len] = '\n';
 
         effect_len++;
         buffer += effect_len;
         written += effect_len;
-    }
 
-exit:
-    spin_unlock(&lights_global.caps.lock);
+        iter++;
+    }
 
     return written;
 }
 
 /**
- * lights_dump_effects() - Writes a list of effects
+ * lights_render_caps() - Writes a list of accumulated effects
  *
- * @effects:  Zero terminated array of effects to write
- * @buffer: Buffer to write into (PAGE_SIZE length)
+ * @buffer: Buffer to write to (PAGE_SIZE length)
  *
  * @return: Number of bytes written or a negative error code
+ *
+ * Only the effects sgared by ALL interfaces are written, followed by
+ * the software effects. The caller MUST hold the caps lock.
  */
-static ssize_t lights_dump_effects (
-    struct lights_effect const *effects,
+static ssize_t lights_render_caps (
     char *buffer
 ){
-    struct lights_effect const *iter = effects;
+    struct lights_caps *iter;
     size_t effect_len;
-    ssize_t written = 0;
+    ssize_t written = 0, software;
 
-    while (iter->id != LIGHTS_EFFECT_ID_INVALID) {
-        if (!iter->name || 0 == iter->name[0])
-            return -EIO;
+    list_for_each_entry(iter, &lights_global.caps.list, siblings) {
+        if (iter->ref_count != lights_global.caps.interfaces)
+            continue;
 
-        effect_len = strlen(iter->name);
+        effect_len = strlen(iter->effect.name);
 
-        if (written + effect_len + 1 > PAGE_SIZE) {
-            written = -ENOMEM;
-            break;
-        }
+        if (written + effect_len + 1 > PAGE_SIZE)
+            return -ENOMEM;
 
-        memcpy(buffer, iter->name, effect_len);
+        memcpy(buffer, iter->effect.name, effect_len);
         buffer[effect_len] = '\n';
 
         effect_len++;
         buffer += effect_len;
         written += effect_len;
+    }
 
-        iter++;
+    software = lights_dump_effects(lights_renderer_effects(), buffer, PAGE_SIZE - written);
+    if (software < 0)
+        return software;
+
+    return written + software;
+}
+
+/**
+ * lights_dump_caps() - Writes a list of accumulated effects
+ *
+ * @buffer: Buffer to write to (PAGE_SIZE length)
+ *
+ * @return: Number of bytes written or a negative error code
+ *
+ * The list is only rendered after it has been invalidated by a
+ * change in the accumulated effects, otherwise the cache is copied.
+ */
+static ssize_t lights_dump_caps (
+    char *buffer
+){
+    ssize_t written;
+
+    if (!lights_global.caps.text)
+        return -ENOMEM;
+
+    spin_lock(&lights_global.caps.lock);
+
+    if (!lights_global.caps.text_valid) {
+        lights_global.caps.text_len = lights_render_caps(lights_global.caps.text);
+        lights_global.caps.text_valid = true;
     }
 
+    written = lights_global.caps.text_len;
+    if (written > 0)
+        memcpy(buffer, lights_global.caps.text, written);
+
+    spin_unlock(&lights_global.caps.lock);
+
     return written;
 }
 
@@ -444,6 +720,11 @@ static error_t lights_append_caps (
         iter++;
     }
 
+    spin_lock(&lights_global.caps.lock);
+    lights_global.caps.interfaces++;
+    lights_global.caps.text_valid = false;
+    spin_unlock(&lights_global.caps.lock);
+
     return 0;
 }
 
@@ -455,6 +736,11 @@ static error_t lights_append_caps (
 static void lights_remove_caps (
     struct lights_effect const *effects
 ){
+    spin_lock(&lights_global.caps.lock);
+    lights_global.caps.interfaces--;
+    lights_global.caps.text_valid = false;
+    spin_unlock(&lights_global.caps.lock);
+
     while (effects->id != LIGHTS_EFFECT_ID_INVALID) {
         lights_del_caps(effects);
         effects++;
@@ -748,15 +1034,17 @@ EXPORT_SYMBOL_NS_GPL(lights_read_sync, LIGHTS);
 void lights_get_state (
     struct lights_state *state
 ){
+    unsigned int seq;
+
     if (IS_NULL(state))
         return;
 
-    spin_lock(&lights_global.state_lock);
+    do {
+        seq = read_seqbegin(&lights_global.state_lock);
+        memcpy(state, &lights_global.state, sizeof(*state));
+    } while (read_seqretry(&lights_global.state_lock, seq));
 
-    memcpy(state, &lights_global.state, sizeof(*state));
     state->type = LIGHTS_TYPE_EFFECT | LIGHTS_TYPE_COLOR | LIGHTS_TYPE_SPEED | LIGHTS_TYPE_DIRECTION;
-
-    spin_unlock(&lights_global.state_lock);
 }
 EXPORT_SYMBOL_NS_GPL(lights_get_state, LIGHTS);
 
@@ -794,9 +1082,17 @@ static struct lights_file *find_attribute_for_file (
     spin_lock(&lights_global.interface.lock);
 
     list_for_each_entry(interface, &lights_global.interface.list, siblings) {
+        /* The node of a zone accesses the file selected by ioctl */
+        if (cdev == interface->node) {
+            iter = READ_ONCE(filp->private_data);
+            if (!iter)
+                break;
+            kref_get(&iter->intf->refs);
+            goto found;
+        }
         if (!list_empty(&interface->file_list)) {
             list_for_each_entry(iter, &interface->file_list, siblings) {
-                if (cdev == &iter->cdev) {
+                if (cdev == iter->cdev) {
                     kref_get(&iter->intf->refs);
                     goto found;
                 }
@@ -840,296 +1136,2875 @@ static struct lights_file *find_attribute_for_type (
 }
 
 /**
- * update_each_interface() - Invokes the write method in all relevant attributes
+ * find_interface_for_id() - Searches for an interface by its id
  *
- * @state: Buffer of data to write
+ * @id: Id of the interface
  *
- * @return: Error code
+ * @return: NULL or the interface
+ *
+ * NOTE, The reference count is increased on the interface. When the
+ * caller is done with the object it MUST decrease the reference counter.
  */
-static error_t update_each_interface (
-    struct lights_state const *state
+static struct lights_interface *find_interface_for_id (
+    uint16_t id
 ){
-    struct lights_file const **files = NULL;
-    struct lights_interface *intf;
-    size_t count, i;
-    error_t err = 0;
-
-    /*
-     * We cannot hold a spinlock while invoking the read callback or while
-     * allocating memory. Reading the count in an unlocked state is risky
-     * since an interface may be removed right after reading.
-     */
-
-repeat:
-    count = lights_global.interface.count;
-    kfree(files);
-    files = kcalloc(count, sizeof(*files), GFP_KERNEL);
-    if (!files)
-        return -ENOMEM;
+    struct lights_interface *iter;
 
     spin_lock(&lights_global.interface.lock);
 
-    if (count < lights_global.interface.count) {
-        spin_unlock(&lights_global.interface.lock);
-        goto repeat;
+    list_for_each_entry(iter, &lights_global.interface.list, siblings) {
+        if (id == iter->id) {
+            kref_get(&iter->refs);
+            goto found;
+        }
     }
 
-    count = 0;
-    list_for_each_entry(intf, &lights_global.interface.list, siblings) {
-        /* Exclude the "all" interface */
-        if (intf->id == 0)
-            continue;
-
-        files[count] = find_attribute_for_type(intf, state->type);
-        if (files[count])
-            count++;
-    }
+    iter = NULL;
 
+found:
     spin_unlock(&lights_global.interface.lock);
 
-    for (i = 0; i < count; i++) {
-        if (files[i]->attr.write) {
-            err = files[i]->attr.write(files[i]->attr.thunk, state);
-
-            if (err) {
-                LIGHTS_ERR(
-                    "Failed to update '%s/%s': %s",
-                    files[i]->intf->name,
-                    files[i]->attr.attr.name,
-                    ERR_NAME(err)
-                );
-            }
-        }
-
-        kref_put(&files[i]->intf->refs, lights_interface_put);
-    }
-
-    kfree(files);
-
-    return 0;
+    return iter;
 }
 
 /**
- * io_read() - File output handler
+ * lights_interface_pace() - Computes how long a led frame must wait
  *
- * @thunk: Unused
- * @state: Buffer to populate
+ * @intf: Interface receiving the frame
  *
- * @return: Zero
+ * @return: Nanoseconds until the frame may be sent, zero to send now
  *
- * This function is the read handler for all device files
- * under the "all" interface.
+ * Frames arriving faster than the limit of the interface must not
+ * queue up behind a slow bus.
  */
-static error_t io_read (
-    struct lights_thunk *thunk,
-    struct lights_state *state
+static uint64_t lights_interface_pace (
+    struct lights_interface *intf
 ){
-    lights_get_state(state);
+    int limit = READ_ONCE(intf->fps_limit);
+    uint64_t interval, elapsed;
 
-    return 0;
+    if (!limit)
+        return 0;
+
+    if (limit < 0)
+        interval = READ_ONCE(intf->update_ns);
+    else
+        interval = NSEC_PER_SEC / limit;
+
+    elapsed = ktime_to_ns(ktime_sub(ktime_get(), READ_ONCE(intf->frame_time)));
+
+    if (!interval || elapsed >= interval)
+        return 0;
+
+    return interval - elapsed;
 }
 
 /**
- * io_write() - File input handler
+ * lights_interface_hold() - Holds a led frame until the pacer allows it
  *
- * @thunk: Unused
- * @state: Data written to the file
+ * @file:  File being written
+ * @state: Led frame
  *
- * @return: Error code
+ * @return: True if the frame is not to be sent now
  *
- * This function is the write handler for all device files
- * under the "all" interface. When invoked it will call the
- * write method of all other interfaces for the same data type.
+ * Only the newest frame is held, any older one is dropped. It is sent
+ * when the window expires, so the last frame of a burst always reaches
+ * the device.
  */
-static error_t io_write (
-    struct lights_thunk *thunk,
+static bool lights_interface_hold (
+    struct lights_file const *file,
     struct lights_state const *state
 ){
-    if (IS_NULL(state))
-        return -EINVAL;
+    struct lights_interface *intf = file->intf;
+    struct lights_pace *pace = &intf->pace;
+    uint64_t delay = lights_interface_pace(intf);
 
-    spin_lock(&lights_global.state_lock);
+    spin_lock(&pace->lock);
 
-    if (state->type & LIGHTS_TYPE_EFFECT)
-        lights_global.state.effect = state->effect;
-    if (state->type & LIGHTS_TYPE_COLOR)
-        lights_global.state.color = state->color;
-    if (state->type & LIGHTS_TYPE_SPEED)
-        lights_global.state.speed = state->speed;
-    if (state->type & LIGHTS_TYPE_DIRECTION)
-        lights_global.state.direction = state->direction;
-    if (state->type & LIGHTS_TYPE_SYNC)
-        lights_global.state.sync = state->sync;
+    /* A frame sent now would overtake the one held */
+    if (!delay && !pace->file) {
+        WRITE_ONCE(intf->frame_time, ktime_get());
+        spin_unlock(&pace->lock);
+        return false;
+    }
+
+    if (pace->closed || !pace->frame || state->type != LIGHTS_TYPE_LEDS ||
+        state->raw.length != intf->led_count) {
+        spin_unlock(&pace->lock);
+        atomic_inc(&intf->dropped);
+        return true;
+    }
+
+    if (pace->file)
+        atomic_inc(&intf->dropped);
+    else
+        hrtimer_start(&pace->timer, ns_to_ktime(delay), HRTIMER_MODE_REL);
+
+    memcpy(pace->frame, state->raw.data, intf->led_count * sizeof(*pace->frame));
+    pace->file = file;
 
-    spin_unlock(&lights_global.state_lock);
+    spin_unlock(&pace->lock);
 
-    return update_each_interface(state);
+    return true;
 }
 
 /**
- * caps_show() - File IO handler for /sys/class/lights/___/caps
- *
- * @dev:  Device being read
- * @attr: Unused
- * @buf:  Buffer to write into (PAGE_SIZE length)
+ * lights_interface_discard() - Drops any led frame held by the pacer
  *
- * @return: Bytes written or a negative error code
+ * @intf: Interface being written
  */
-static ssize_t caps_show (
-    struct device *dev,
-    struct device_attribute *attr,
-    char *buf
+static void lights_interface_discard (
+    struct lights_interface *intf
 ){
-    struct lights_interface *intf = interface_from_dev(dev);
-    ssize_t written = 0;
-
-    if (0 == strcmp(intf->name, "all")) {
-        written = lights_dump_caps(buf);
-    } else if (intf->ldev->caps) {
-        written = lights_dump_effects(intf->ldev->caps, buf);
-    }
-
-    return written;
+    spin_lock(&intf->pace.lock);
+    intf->pace.file = NULL;
+    spin_unlock(&intf->pace.lock);
+}
+
+/**
+ * lights_interface_render() - Frame output handler of the software effects
+ *
+ * @thunk: Interface thunk
+ * @state: Either LIGHTS_TYPE_LEDS or LIGHTS_TYPE_COLOR
+ *
+ * @return: Error code
+ */
+static error_t lights_interface_render (
+    struct lights_thunk *thunk,
+    struct lights_state const *state
+){
+    struct lights_interface *intf = interface_from_thunk(thunk);
+    struct lights_file *file;
+    error_t err = -EOPNOTSUPP;
+
+    if (IS_NULL(thunk, state, intf))
+        return -EINVAL;
+
+    if (lights_interface_pace(intf)) {
+        atomic_inc(&intf->dropped);
+        return 0;
+    }
+
+    WRITE_ONCE(intf->frame_time, ktime_get());
+
+    file = find_attribute_for_type(intf, state->type);
+    if (!file) {
+        if (state->type == LIGHTS_TYPE_COLOR && intf->update.attr.write)
+            return intf->update.attr.write(intf->update.attr.thunk, state);
+
+        return -EOPNOTSUPP;
+    }
+
+    if (file->attr.write)
+        err = file->attr.write(file->attr.thunk, state);
+
+    kref_put(&intf->refs, lights_interface_put);
+
+    return err;
+}
+
+/**
+ * lights_interface_render_start() - Starts a software effect on an interface
+ *
+ * @intf:   Interface to render
+ * @effect: One of the software effects
+ *
+ * @return: Error code
+ *
+ * Zones with writable leds are switched to their "direct" effect
+ * and rendered led by led, all others are switched to "static"
+ * and rendered as a single color.
+ */
+static error_t lights_interface_render_start (
+    struct lights_interface *intf,
+    struct lights_effect const *effect
+){
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_EFFECT
+    };
+    struct lights_effect const *mode;
+    struct lights_file *file;
+    uint16_t led_count = 0;
+    error_t err;
+
+    file = find_attribute_for_type(intf, LIGHTS_TYPE_LEDS);
+    if (file) {
+        if (file->attr.write)
+            led_count = intf->led_count;
+
+        kref_put(&intf->refs, lights_interface_put);
+    }
+
+    mode = lights_interface_find_effect(intf, led_count ? "direct" : LIGHTS_EFFECT_LABEL_STATIC);
+    if (!mode && !led_count)
+        return -EOPNOTSUPP;
+
+    if (mode && intf->update.attr.write) {
+        state.effect = *mode;
+
+        err = intf->update.attr.write(intf->update.attr.thunk, &state);
+        if (err)
+            return err;
+    }
+
+    intf->renderer.effect    = *effect;
+    intf->renderer.led_count = led_count;
+
+    return lights_renderer_start(&intf->renderer);
+}
+
+/**
+ * lights_state_merge() - Copies the values of one state into another
+ *
+ * @dst: Target state
+ * @src: Values to copy, as flagged by its type
+ *
+ * Only the values which describe an effect are copied.
+ */
+static void lights_state_merge (
+    struct lights_state *dst,
+    struct lights_state const *src
+){
+    if (src->type & LIGHTS_TYPE_EFFECT)
+        dst->effect = src->effect;
+    if (src->type & LIGHTS_TYPE_COLOR)
+        dst->color = src->color;
+    if (src->type & LIGHTS_TYPE_SPEED)
+        dst->speed = src->speed;
+    if (src->type & LIGHTS_TYPE_DIRECTION)
+        dst->direction = src->direction;
+
+    dst->type |= src->type & LIGHTS_TYPE_UPDATE;
+}
+
+/**
+ * lights_record_read() - Reads the state record of an interface
+ *
+ * @intf:    Interface to read
+ * @state:   Buffer to populate, its type selects the values
+ * @applied: Read the applied, rather than pending, values
+ *
+ * @return: Generation of the values
+ *
+ * Never blocks, nor calls into the driver.
+ */
+static uint32_t lights_record_read (
+    struct lights_interface *intf,
+    struct lights_state *state,
+    bool applied
+){
+    struct lights_state record;
+    enum lights_state_type type = state->type;
+    unsigned int seq;
+    uint32_t gen;
+
+    do {
+        seq = read_seqbegin(&intf->record_lock);
+        record = applied ? intf->applied : intf->pending;
+        gen = applied ? intf->applied_gen : intf->pending_gen;
+    } while (read_seqretry(&intf->record_lock, seq));
+
+    record.type &= type;
+    lights_state_merge(state, &record);
+
+    return gen;
+}
+
+/**
+ * lights_record_write() - Invokes the write method of a file, recording the values
+ *
+ * @file:  File to write
+ * @state: Data to write
+ *
+ * @return: Error code
+ *
+ * The values become pending before the driver is called, so that any
+ * update it submits carries them. Drivers which don't submit updates
+ * are considered to have applied the values when the write returns.
+ */
+static error_t lights_record_write (
+    struct lights_file const *file,
+    struct lights_state const *state
+){
+    struct lights_interface *intf = file->intf;
+    struct lights_state previous;
+    unsigned long flags;
+    uint32_t gen;
+    error_t err;
+
+    if (!(state->type & LIGHTS_TYPE_UPDATE))
+        return file->attr.write(file->attr.thunk, state);
+
+    write_seqlock_irqsave(&intf->record_lock, flags);
+    previous = intf->pending;
+    lights_state_merge(&intf->pending, state);
+    gen = ++intf->pending_gen;
+    write_sequnlock_irqrestore(&intf->record_lock, flags);
+
+    err = file->attr.write(file->attr.thunk, state);
+
+    write_seqlock_irqsave(&intf->record_lock, flags);
+
+    if (err) {
+        /* Unless another write followed, the values were never pending */
+        if (intf->pending_gen == gen) {
+            intf->pending = previous;
+            intf->pending_gen--;
+        }
+    } else if (atomic_read(&intf->submitted) == atomic_read(&intf->completed) && intf->applied_gen < gen) {
+        intf->applied = intf->pending;
+        intf->applied_gen = intf->pending_gen;
+    }
+
+    write_sequnlock_irqrestore(&intf->record_lock, flags);
+
+    return err;
+}
+
+/**
+ * lights_effect_is_cyclic() - Tests if a hardware effect repeats a cycle
+ *
+ * @effect: Effect to test
+ *
+ * @return: Boolean
+ */
+static inline bool lights_effect_is_cyclic (
+    struct lights_effect const *effect
+){
+    if (effect->id == LIGHTS_EFFECT_ID_INVALID ||
+        effect->id == LIGHTS_EFFECT_ID_OFF ||
+        effect->id == LIGHTS_EFFECT_ID_STATIC)
+        return false;
+
+    return !lights_effect_is_software(effect) && 0 != strcmp(effect->name, "direct");
+}
+
+/**
+ * lights_file_apply() - Invokes the write method of a file
+ *
+ * @file:  File to write
+ * @state: Data to write
+ *
+ * @return: Error code
+ *
+ * Software effects are intercepted here. Selecting one starts the
+ * renderer of the interface, while a hardware effect or led data
+ * stops it. The color, speed and direction are always retained by
+ * the renderer, and not passed to the device while it is running.
+ */
+static error_t lights_file_apply (
+    struct lights_file const *file,
+    struct lights_state const *state
+){
+    struct lights_interface *intf = file->intf;
+    struct lights_state remaining;
+    bool running;
+    error_t err;
+
+    if (!file->attr.write)
+        return -ENODEV;
+
+    /* The "all" interface and groups forward to each of their zones */
+    if (intf->id == 0 || intf->group)
+        return file->attr.write(file->attr.thunk, state);
+
+    remaining = *state;
+    running = lights_renderer_update(&intf->renderer, state);
+
+    if (state->type & LIGHTS_TYPE_EFFECT) {
+        /* A held frame must not overwrite the new effect */
+        lights_interface_discard(intf);
+
+        if (lights_effect_is_software(&state->effect)) {
+            err = lights_interface_render_start(intf, &state->effect);
+            if (err)
+                return err;
+
+            remaining.type &= ~LIGHTS_TYPE_UPDATE;
+        } else if (running) {
+            lights_renderer_stop(&intf->renderer);
+        }
+    } else if (state->type & LIGHTS_TYPE_LEDS) {
+        if (running)
+            lights_renderer_stop(&intf->renderer);
+        if (lights_interface_hold(file, state))
+            return 0;
+    } else if (running) {
+        /* The renderer already follows the timebase, sync is meaningless */
+        remaining.type &= ~(LIGHTS_TYPE_UPDATE | LIGHTS_TYPE_SYNC);
+    }
+
+    if (!remaining.type)
+        return 0;
+
+    return lights_record_write(file, &remaining);
+}
+
+/**
+ * lights_combine_work() - Writes the combined properties to the driver
+ *
+ * @work: Work of the interface
+ */
+static void lights_combine_work (
+    struct work_struct *work
+){
+    struct lights_interface *intf = container_of(work, struct lights_interface, combine_work);
+    struct lights_state state;
+    error_t err;
+
+    spin_lock(&intf->combine_lock);
+    state = intf->combined;
+    memset(&intf->combined, 0, sizeof(intf->combined));
+    intf->combining = false;
+    spin_unlock(&intf->combine_lock);
+
+    if (!state.type)
+        return;
+
+    err = lights_file_apply(&intf->update, &state);
+    if (err) {
+        LIGHTS_ERR("Failed to update '%s': %s", intf->name, ERR_NAME(err));
+        WRITE_ONCE(intf->error, err);
+
+        spin_lock(&intf->combine_lock);
+        intf->combine_error = err;
+        spin_unlock(&intf->combine_lock);
+    }
+}
+
+/**
+ * lights_combine_timeout() - Closes the write combining window
+ *
+ * @timer: Timer of the interface
+ *
+ * @return: Timer restart flag
+ */
+static enum hrtimer_restart lights_combine_timeout (
+    struct hrtimer *timer
+){
+    struct lights_interface *intf = container_of(timer, struct lights_interface, combine_timer);
+
+    queue_work(system_highpri_wq, &intf->combine_work);
+
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * lights_pace_work() - Sends the led frame held by the pacer
+ *
+ * @work: Work of the interface
+ */
+static void lights_pace_work (
+    struct work_struct *work
+){
+    struct lights_interface *intf = container_of(work, struct lights_interface, pace.work);
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_LEDS
+    };
+    struct lights_file const *file;
+    struct lights_color *frame = intf->pace.frame + intf->led_count;
+    error_t err;
+
+    spin_lock(&intf->pace.lock);
+
+    file = intf->pace.file;
+    intf->pace.file = NULL;
+
+    /* The held frame may be replaced while this one is sent */
+    if (file) {
+        memcpy(frame, intf->pace.frame, intf->led_count * sizeof(*frame));
+        WRITE_ONCE(intf->frame_time, ktime_get());
+    }
+
+    spin_unlock(&intf->pace.lock);
+
+    if (!file)
+        return;
+
+    state.raw.length = intf->led_count;
+    state.raw.data   = frame;
+
+    err = lights_record_write(file, &state);
+    if (err) {
+        LIGHTS_ERR("Failed to push '%s' held frame: %s", intf->name, ERR_NAME(err));
+        WRITE_ONCE(intf->error, err);
+    }
+}
+
+/**
+ * lights_pace_timeout() - Ends the pacing window of a held frame
+ *
+ * @timer: Timer of the interface
+ *
+ * @return: Timer restart flag
+ */
+static enum hrtimer_restart lights_pace_timeout (
+    struct hrtimer *timer
+){
+    struct lights_interface *intf = container_of(timer, struct lights_interface, pace.timer);
+
+    queue_work(system_highpri_wq, &intf->pace.work);
+
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * lights_combine_cancel() - Discards any combined properties
+ *
+ * @intf: Interface being removed
+ */
+static void lights_combine_cancel (
+    struct lights_interface *intf
+){
+    hrtimer_cancel(&intf->combine_timer);
+    cancel_work_sync(&intf->combine_work);
+}
+
+/**
+ * lights_combine_flush() - Writes any combined properties now
+ *
+ * @intf: Interface to flush
+ *
+ * @return: The first error of a combined update since last returned
+ */
+static error_t lights_combine_flush (
+    struct lights_interface *intf
+){
+    error_t err;
+
+    /* An inactive timer was either never armed or has queued the work */
+    if (hrtimer_cancel(&intf->combine_timer))
+        queue_work(system_highpri_wq, &intf->combine_work);
+
+    flush_work(&intf->combine_work);
+
+    spin_lock(&intf->combine_lock);
+    err = intf->combine_error;
+    intf->combine_error = 0;
+    spin_unlock(&intf->combine_lock);
+
+    return err;
+}
+
+/**
+ * lights_file_write() - Invokes the write method of a file
+ *
+ * @file:  File to write
+ * @state: Data to write
+ *
+ * @return: Error code
+ *
+ * When the interface has a write combining window, a single effect
+ * property opens it. Every property written until it closes is merged,
+ * then given to the driver as a single update. Writes merged into the
+ * window return zero before the hardware is written, so a failure of
+ * the combined update is deferred: it is returned by the next
+ * combined write to the zone, which is then discarded, or by fsync()
+ * on any of its files, which also closes the window early. It is
+ * always shown by /sys/class/lights/___/error. Writes made under a
+ * transaction plug are never combined.
+ */
+static error_t lights_file_write (
+    struct lights_file const *file,
+    struct lights_state const *state
+){
+    struct lights_interface *intf = file->intf;
+    unsigned int window = READ_ONCE(intf->combine_ms);
+    struct lights_state merged;
+    error_t err;
+    bool arm;
+
+    if (!window || intf->id == 0 || intf->group || !file->attr.write || !intf->update.attr.write)
+        return lights_file_apply(file, state);
+
+    /* Only the effect properties are combined */
+    if (!state->type || (state->type & ~LIGHTS_TYPE_UPDATE))
+        return lights_file_apply(file, state);
+
+    /*
+     * A plugged transaction must not have its writes escape to the
+     * timer, they are held until the plug is removed. An open window
+     * is closed early so its older values are not applied later.
+     */
+    if (lights_adapter_plugged()) {
+        spin_lock(&intf->combine_lock);
+        arm = intf->combining;
+        if (arm) {
+            merged = intf->combined;
+            lights_state_merge(&merged, state);
+            memset(&intf->combined, 0, sizeof(intf->combined));
+            intf->combining = false;
+        }
+        spin_unlock(&intf->combine_lock);
+
+        if (!arm)
+            return lights_file_apply(file, state);
+
+        hrtimer_try_to_cancel(&intf->combine_timer);
+
+        return lights_file_apply(&intf->update, &merged);
+    }
+
+    spin_lock(&intf->combine_lock);
+
+    /* The previous window failed, report it rather than this write */
+    if (intf->combine_error) {
+        err = intf->combine_error;
+        intf->combine_error = 0;
+        spin_unlock(&intf->combine_lock);
+        return err;
+    }
+
+    /* Multiple properties are already combined, unless a window is open */
+    if (!intf->combining && hweight_long(state->type) > 1) {
+        spin_unlock(&intf->combine_lock);
+        return lights_file_apply(file, state);
+    }
+
+    lights_state_merge(&intf->combined, state);
+
+    arm = !intf->combining;
+    intf->combining = true;
+
+    spin_unlock(&intf->combine_lock);
+
+    if (arm)
+        hrtimer_start(&intf->combine_timer, ms_to_ktime(window), HRTIMER_MODE_REL);
+
+    return 0;
+}
+
+/* Files a snapshot holds without allocating */
+#define LIGHTS_SNAPSHOT_SIZE    16
+
+/**
+ * struct lights_snapshot - A file of every zone, gathered for a single call
+ *
+ * @files: Either @local, or an allocated array when there are more zones
+ * @count: Number of @files
+ * @local: Storage for the common case
+ */
+struct lights_snapshot {
+    struct lights_file const    **files;
+    size_t                      count;
+    struct lights_file const    *local[LIGHTS_SNAPSHOT_SIZE];
+};
+
+/**
+ * lights_snapshot_take() - Gathers a file of every zone
+ *
+ * @snap: Storage, usually on the stack
+ * @type: Type of the file, or zero for the update file
+ *
+ * @return: Error code
+ *
+ * A reference is taken on the interface of each file, so the files
+ * may be written without holding any lock. The snapshot MUST be
+ * released with lights_snapshot_release(), even on error.
+ */
+static error_t lights_snapshot_take (
+    struct lights_snapshot *snap,
+    enum lights_state_type type
+){
+    struct lights_file const **files = snap->local;
+    struct lights_interface *intf;
+    size_t capacity = ARRAY_SIZE(snap->local);
+
+    snap->files = snap->local;
+    snap->count = 0;
+
+repeat:
+    spin_lock(&lights_global.interface.lock);
+
+    if (lights_global.interface.count > capacity) {
+        capacity = lights_global.interface.count;
+        spin_unlock(&lights_global.interface.lock);
+
+        if (files != snap->local)
+            kfree(files);
+
+        files = kcalloc(capacity, sizeof(*files), GFP_KERNEL);
+        if (!files)
+            return -ENOMEM;
+
+        goto repeat;
+    }
+
+    list_for_each_entry(intf, &lights_global.interface.list, siblings) {
+        /* Exclude the "all" interface and groups */
+        if (intf->id == 0 || intf->group)
+            continue;
+
+        if (!type) {
+            kref_get(&intf->refs);
+            files[snap->count++] = &intf->update;
+            continue;
+        }
+
+        files[snap->count] = find_attribute_for_type(intf, type);
+        if (files[snap->count])
+            snap->count++;
+    }
+
+    spin_unlock(&lights_global.interface.lock);
+
+    snap->files = files;
+
+    return 0;
+}
+
+/**
+ * lights_snapshot_release() - Puts the references of a snapshot
+ *
+ * @snap: Previously passed to lights_snapshot_take()
+ */
+static void lights_snapshot_release (
+    struct lights_snapshot *snap
+){
+    size_t i;
+
+    for (i = 0; i < snap->count; i++)
+        kref_put(&snap->files[i]->intf->refs, lights_interface_put);
+
+    if (snap->files != snap->local)
+        kfree(snap->files);
+
+    snap->files = snap->local;
+    snap->count = 0;
+}
+
+/**
+ * update_each_interface() - Invokes the write method in all relevant attributes
+ *
+ * @state: Buffer of data to write
+ *
+ * @return: Error code
+ *
+ * Each call writes from its own snapshot, so concurrent writers do
+ * not wait on each other and no lock is held during the writes. Up to
+ * LIGHTS_SNAPSHOT_SIZE zones, the snapshot does not allocate.
+ */
+static error_t update_each_interface (
+    struct lights_state const *state
+){
+    struct lights_snapshot snap;
+    error_t err;
+    size_t i;
+
+    err = lights_snapshot_take(&snap, state->type);
+    if (err)
+        goto exit;
+
+    for (i = 0; i < snap.count; i++) {
+        if (!snap.files[i]->attr.write)
+            continue;
+
+        err = lights_file_write(snap.files[i], state);
+        if (err) {
+            LIGHTS_ERR(
+                "Failed to update '%s/%s': %s",
+                snap.files[i]->intf->name,
+                snap.files[i]->attr.attr.name,
+                ERR_NAME(err)
+            );
+        }
+    }
+
+    err = 0;
+
+exit:
+    lights_snapshot_release(&snap);
+
+    return err;
+}
+
+/**
+ * io_read() - File output handler
+ *
+ * @thunk: Unused
+ * @state: Buffer to populate
+ *
+ * @return: Zero
+ *
+ * This function is the read handler for all device files
+ * under the "all" interface.
+ */
+static error_t io_read (
+    struct lights_thunk *thunk,
+    struct lights_state *state
+){
+    lights_get_state(state);
+
+    return 0;
+}
+
+/**
+ * io_write() - File input handler
+ *
+ * @thunk: Unused
+ * @state: Data written to the file
+ *
+ * @return: Error code
+ *
+ * This function is the write handler for all device files
+ * under the "all" interface. When invoked it will call the
+ * write method of all other interfaces for the same data type.
+ */
+static error_t io_write (
+    struct lights_thunk *thunk,
+    struct lights_state const *state
+){
+    struct lights_adapter_plug plug;
+    error_t err;
+
+    if (IS_NULL(state))
+        return -EINVAL;
+
+    write_seqlock(&lights_global.state_lock);
+
+    if (state->type & LIGHTS_TYPE_EFFECT)
+        lights_global.state.effect = state->effect;
+    if (state->type & LIGHTS_TYPE_COLOR)
+        lights_global.state.color = state->color;
+    if (state->type & LIGHTS_TYPE_SPEED)
+        lights_global.state.speed = state->speed;
+    if (state->type & LIGHTS_TYPE_DIRECTION)
+        lights_global.state.direction = state->direction;
+    if (state->type & LIGHTS_TYPE_SYNC)
+        lights_global.state.sync = state->sync;
+
+    write_sequnlock(&lights_global.state_lock);
+
+    /*
+     * Every bus is started together, so that the same effect begins
+     * at the same time on each device.
+     */
+    lights_adapter_plug(&plug);
+    err = update_each_interface(state);
+    lights_adapter_unplug(&plug);
+
+    /* Align the new effect with the timebase right away */
+    if (state->type & LIGHTS_TYPE_EFFECT)
+        mod_delayed_work(system_wq, &lights_global.sync_work, 0);
+
+    return err;
+}
+
+/**
+ * lights_sync_correct() - Re-syncs a hardware effect to the timebase
+ *
+ * @intf: Interface of the device
+ * @now:  Time of the correction
+ *
+ * A device with a sync file, running a cyclic hardware effect, is
+ * told the position of the timebase. No driver reports where its
+ * effect actually is, so the packet is sent each time rather than
+ * only once it has drifted. It is written like any other value, so
+ * it is recorded and follows the renderer.
+ */
+static void lights_sync_correct (
+    struct lights_interface *intf,
+    ktime_t now
+){
+    struct lights_state state = { .type = LIGHTS_TYPE_EFFECT | LIGHTS_TYPE_SPEED };
+    struct lights_state sync = { .type = LIGHTS_TYPE_SYNC };
+    struct lights_file *file;
+    error_t err;
+
+    if (lights_renderer_is_running(&intf->renderer))
+        return;
+
+    lights_record_read(intf, &state, false);
+    if (!lights_effect_is_cyclic(&state.effect))
+        return;
+
+    file = find_attribute_for_type(intf, LIGHTS_TYPE_SYNC);
+    if (!file)
+        return;
+
+    if (file->attr.write) {
+        sync.sync = lights_timebase_at(state.speed, now) >> 8;
+
+        err = lights_file_apply(file, &sync);
+        if (err)
+            LIGHTS_DBG("Failed to sync '%s': %s", intf->name, ERR_NAME(err));
+    }
+
+    kref_put(&intf->refs, lights_interface_put);
+}
+
+/**
+ * lights_sync_work() - Re-syncs the hardware effects to the timebase
+ *
+ * @work: The global sync work
+ *
+ * Every @sync_interval, each device running a hardware effect is
+ * corrected, see lights_sync_correct(). The zones are gathered first,
+ * no lock is held while they are written. All buses are written under
+ * the same plug, so the corrections leave together.
+ */
+static void lights_sync_work (
+    struct work_struct *work
+){
+    struct lights_snapshot snap;
+    struct lights_adapter_plug plug;
+    unsigned int interval = READ_ONCE(sync_interval);
+    ktime_t now;
+    size_t i;
+
+    if (interval) {
+        if (!lights_snapshot_take(&snap, 0)) {
+            now = ktime_get();
+
+            lights_adapter_plug(&plug);
+
+            for (i = 0; i < snap.count; i++)
+                lights_sync_correct(snap.files[i]->intf, now);
+
+            lights_adapter_unplug(&plug);
+        }
+
+        lights_snapshot_release(&snap);
+    }
+
+    /* The interval may be changed at runtime, check back every second */
+    schedule_delayed_work(
+        &lights_global.sync_work,
+        interval ? msecs_to_jiffies(interval) : HZ
+    );
+}
+
+/**
+ * struct lights_group_member - Zone of a group
+ *
+ * @intf: Referenced interface of the zone, NULL while it is not registered
+ * @name: Name of the zone
+ */
+struct lights_group_member {
+    struct lights_interface *intf;
+    char                    name[LIGHTS_MAX_FILENAME_LENGTH];
+};
+
+/**
+ * struct lights_group - User defined set of zones
+ *
+ * @siblings:    Next and prev pointers
+ * @refs:        Reference count, one held by the creator and one by the interface
+ * @ldev:        Registered interface of the group
+ * @thunk:       Magic member for callbacks
+ * @state:       Last values written to the group
+ * @lock:        Lock for @state
+ * @member_lock: Lock for the interface of each member
+ * @count:       Number of @members
+ * @name:        Name of the group
+ * @members:     Member zones
+ *
+ * Members are named, a zone may come and go without affecting the
+ * group. Each member holds a reference to its interface while the
+ * zone is registered, set and dropped by lights_group_attach() and
+ * lights_group_detach(). The interface outlives the unregister while
+ * any file is open, the group is only freed along with it.
+ */
+struct lights_group {
+    struct list_head            siblings;
+    struct kref                 refs;
+    struct lights_dev           ldev;
+    struct lights_thunk         thunk;
+    struct lights_state         state;
+    struct mutex                lock;
+    spinlock_t                  member_lock;
+    size_t                      count;
+    char                        name[LIGHTS_MAX_FILENAME_LENGTH];
+    struct lights_group_member  members[];
+};
+#define GROUP_MAGIC 'GRUP'
+#define group_from_thunk(ptr) ( \
+    lights_thunk_container(ptr, struct lights_group, thunk, GROUP_MAGIC) \
+)
+
+/**
+ * find_interface_for_name() - Searches for an interface by its name
+ *
+ * @name: Name of the interface
+ *
+ * @return: NULL or the interface
+ *
+ * NOTE, The reference count is increased on the interface. When the
+ * caller is done with the object it MUST decrease the reference counter.
+ */
+static struct lights_interface *find_interface_for_name (
+    const char *name
+){
+    struct lights_interface *iter;
+
+    spin_lock(&lights_global.interface.lock);
+
+    list_for_each_entry(iter, &lights_global.interface.list, siblings) {
+        if (0 == strcmp(name, iter->name)) {
+            kref_get(&iter->refs);
+            goto found;
+        }
+    }
+
+    iter = NULL;
+
+found:
+    spin_unlock(&lights_global.interface.lock);
+
+    return iter;
+}
+
+/**
+ * lights_group_member_get() - Fetches the interface of a member
+ *
+ * @group:  The group
+ * @member: Member of @group
+ *
+ * @return: NULL or a reference counted interface
+ */
+static struct lights_interface *lights_group_member_get (
+    struct lights_group *group,
+    struct lights_group_member *member
+){
+    struct lights_interface *intf;
+
+    spin_lock(&group->member_lock);
+
+    intf = member->intf;
+    if (intf)
+        kref_get(&intf->refs);
+
+    spin_unlock(&group->member_lock);
+
+    return intf;
+}
+
+/**
+ * lights_group_member_set() - Replaces the interface of a member
+ *
+ * @group:  The group
+ * @member: Member of @group
+ * @intf:   Referenced interface or NULL, the reference moves to @member
+ */
+static void lights_group_member_set (
+    struct lights_group *group,
+    struct lights_group_member *member,
+    struct lights_interface *intf
+){
+    struct lights_interface *old;
+
+    spin_lock(&group->member_lock);
+
+    old = member->intf;
+    member->intf = intf;
+
+    spin_unlock(&group->member_lock);
+
+    if (old)
+        kref_put(&old->refs, lights_interface_put);
+}
+
+/**
+ * lights_group_resolve() - Looks up the members of a new group
+ *
+ * @group: Group being added to the list
+ *
+ * Context: Called with lights_global.group.lock held
+ */
+static void lights_group_resolve (
+    struct lights_group *group
+){
+    struct lights_interface *intf;
+    size_t i;
+
+    for (i = 0; i < group->count; i++) {
+        intf = find_interface_for_name(group->members[i].name);
+        if (intf && intf->group) {
+            kref_put(&intf->refs, lights_interface_put);
+            intf = NULL;
+        }
+
+        lights_group_member_set(group, &group->members[i], intf);
+    }
+}
+
+/**
+ * lights_group_attach() - Links a new zone to the groups naming it
+ *
+ * @intf: Interface just added to the list
+ */
+static void lights_group_attach (
+    struct lights_interface *intf
+){
+    struct lights_group *group;
+    struct lights_group_member *member;
+    size_t i;
+
+    if (intf->group)
+        return;
+
+    mutex_lock(&lights_global.group.lock);
+
+    list_for_each_entry(group, &lights_global.group.list, siblings) {
+        for (i = 0; i < group->count; i++) {
+            member = &group->members[i];
+
+            /* A group created after the add already found it */
+            if (strcmp(member->name, intf->name) || member->intf == intf)
+                continue;
+
+            kref_get(&intf->refs);
+            lights_group_member_set(group, member, intf);
+        }
+    }
+
+    mutex_unlock(&lights_global.group.lock);
+}
+
+/**
+ * lights_group_detach() - Unlinks a departing zone from every group
+ *
+ * @intf: Interface just removed from the list
+ */
+static void lights_group_detach (
+    struct lights_interface *intf
+){
+    struct lights_group *group;
+    size_t i;
+
+    if (intf->group)
+        return;
+
+    mutex_lock(&lights_global.group.lock);
+
+    list_for_each_entry(group, &lights_global.group.list, siblings) {
+        for (i = 0; i < group->count; i++) {
+            if (group->members[i].intf == intf)
+                lights_group_member_set(group, &group->members[i], NULL);
+        }
+    }
+
+    mutex_unlock(&lights_global.group.lock);
+}
+
+/**
+ * group_read() - File output handler
+ *
+ * @thunk: The group
+ * @state: Buffer to populate
+ *
+ * @return: Error code
+ */
+static error_t group_read (
+    struct lights_thunk *thunk,
+    struct lights_state *state
+){
+    struct lights_group *group = group_from_thunk(thunk);
+
+    if (IS_NULL(thunk, state, group))
+        return -EINVAL;
+
+    mutex_lock(&group->lock);
+
+    if (state->type & LIGHTS_TYPE_EFFECT)
+        state->effect = group->state.effect;
+    if (state->type & LIGHTS_TYPE_COLOR)
+        state->color = group->state.color;
+    if (state->type & LIGHTS_TYPE_SPEED)
+        state->speed = group->state.speed;
+    if (state->type & LIGHTS_TYPE_DIRECTION)
+        state->direction = group->state.direction;
+
+    mutex_unlock(&group->lock);
+
+    return 0;
+}
+
+/**
+ * group_write() - File input handler
+ *
+ * @thunk: The group
+ * @state: Data written to the file
+ *
+ * @return: Zero
+ *
+ * Invokes the write method of each member for the same data type.
+ * All members are written in a single plugged pass, so the transfers
+ * of each bus are submitted together. No global lock is taken, each
+ * member is referenced only for the duration of its write.
+ */
+static error_t group_write (
+    struct lights_thunk *thunk,
+    struct lights_state const *state
+){
+    struct lights_group *group = group_from_thunk(thunk);
+    struct lights_adapter_plug plug;
+    struct lights_interface *intf;
+    struct lights_file *file;
+    error_t err;
+    size_t i;
+
+    if (IS_NULL(thunk, state, group))
+        return -EINVAL;
+
+    mutex_lock(&group->lock);
+
+    if (state->type & LIGHTS_TYPE_EFFECT)
+        group->state.effect = state->effect;
+    if (state->type & LIGHTS_TYPE_COLOR)
+        group->state.color = state->color;
+    if (state->type & LIGHTS_TYPE_SPEED)
+        group->state.speed = state->speed;
+    if (state->type & LIGHTS_TYPE_DIRECTION)
+        group->state.direction = state->direction;
+
+    lights_adapter_plug(&plug);
+
+    for (i = 0; i < group->count; i++) {
+        intf = lights_group_member_get(group, &group->members[i]);
+        if (!intf)
+            continue;
+
+        file = find_attribute_for_type(intf, state->type);
+
+        if (file) {
+            err = lights_file_write(file, state);
+            if (err) {
+                LIGHTS_ERR(
+                    "Failed to update '%s/%s': %s",
+                    intf->name,
+                    file->attr.attr.name,
+                    ERR_NAME(err)
+                );
+            }
+
+            kref_put(&intf->refs, lights_interface_put);
+        }
+
+        kref_put(&intf->refs, lights_interface_put);
+    }
+
+    lights_adapter_unplug(&plug);
+
+    mutex_unlock(&group->lock);
+
+    return 0;
+}
+
+/**
+ * lights_group_put() - Frees a group once unreferenced
+ *
+ * @ref: Reference counter of the group
+ */
+static void lights_group_put (
+    struct kref *ref
+){
+    struct lights_group *group = container_of(ref, struct lights_group, refs);
+
+    LIGHTS_DBG("freed group '%s'", group->name);
+
+    kfree(group);
+}
+
+/**
+ * lights_group_destroy() - Unregisters a group
+ *
+ * @group: Group previously removed from the list
+ *
+ * The memory is released with the last reference to the interface.
+ */
+static void lights_group_destroy (
+    struct lights_group *group
+){
+    size_t i;
+
+    lights_device_unregister(&group->ldev);
+
+    /* Off the list, no attach or detach can reach the members */
+    for (i = 0; i < group->count; i++)
+        lights_group_member_set(group, &group->members[i], NULL);
+
+    LIGHTS_DBG("removed group '%s'", group->name);
+
+    kref_put(&group->refs, lights_group_put);
+}
+
+/**
+ * lights_group_create() - Creates and registers a group
+ *
+ * @spec: The group name followed by its members, white space separated
+ *
+ * @return: Error code
+ */
+static error_t lights_group_create (
+    const char *spec
+){
+    struct lights_attribute const attrs[] = {
+        LIGHTS_EFFECT_ATTR(NULL, group_read, group_write),
+        LIGHTS_COLOR_ATTR(NULL, group_read, group_write),
+        LIGHTS_SPEED_ATTR(NULL, group_read, group_write),
+        LIGHTS_DIRECTION_ATTR(NULL, group_read, group_write),
+        LIGHTS_UPDATE_ATTR(NULL, group_write),
+        LIGHTS_SYNC_ATTR(NULL, group_write),
+    };
+    struct lights_attribute files[ARRAY_SIZE(attrs)];
+    struct lights_group *group;
+    char **argv;
+    int argc, i;
+    error_t err;
+
+    argv = argv_split(GFP_KERNEL, spec, &argc);
+    if (!argv)
+        return -ENOMEM;
+
+    if (argc < 2) {
+        err = -EINVAL;
+        goto exit;
+    }
+
+    group = kzalloc(struct_size(group, members, argc - 1), GFP_KERNEL);
+    if (!group) {
+        err = -ENOMEM;
+        goto exit;
+    }
+
+    for (i = 0; i < argc; i++) {
+        if (strlen(argv[i]) >= LIGHTS_MAX_FILENAME_LENGTH || 0 == strcmp(argv[i], "all")) {
+            kfree(group);
+            err = -EINVAL;
+            goto exit;
+        }
+    }
+
+    strscpy(group->name, argv[0], sizeof(group->name));
+    for (i = 1; i < argc; i++)
+        strscpy(group->members[i - 1].name, argv[i], sizeof(group->members[0].name));
+
+    group->count = argc - 1;
+
+    kref_init(&group->refs);
+    lights_thunk_init(&group->thunk, GROUP_MAGIC);
+    mutex_init(&group->lock);
+    spin_lock_init(&group->member_lock);
+    lights_get_state(&group->state);
+
+    group->ldev.name  = group->name;
+    group->ldev.caps  = lights_available_effects;
+    group->ldev.group = true;
+
+    err = lights_device_register(&group->ldev);
+    if (err) {
+        kref_put(&group->refs, lights_group_put);
+        goto exit;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(attrs); i++) {
+        files[i] = attrs[i];
+        files[i].thunk = &group->thunk;
+    }
+
+    err = lights_device_create_files(&group->ldev, files, ARRAY_SIZE(files));
+    if (err) {
+        lights_group_destroy(group);
+        goto exit;
+    }
+
+    mutex_lock(&lights_global.group.lock);
+    list_add_tail(&group->siblings, &lights_global.group.list);
+    lights_group_resolve(group);
+    mutex_unlock(&lights_global.group.lock);
+
+    LIGHTS_DBG("created group '%s' with %zu members", group->name, group->count);
+
+exit:
+    argv_free(argv);
+
+    return err;
+}
+
+/**
+ * group_add_store() - File IO handler for /sys/class/lights/group_add
+ *
+ * @class: Unused
+ * @attr:  Unused
+ * @buf:   The group name followed by its members
+ * @len:   Length of @buf
+ *
+ * @return: Bytes read or a negative error code
+ *
+ * Writing "front-panel dimm-0 dimm-1 argb-strip-0" creates the
+ * directory /dev/lights/front-panel/. Each write to its files is
+ * forwarded to the members only.
+ */
+static ssize_t group_add_store (
+    struct class *class,
+    struct class_attribute *attr,
+    const char *buf,
+    size_t len
+){
+    error_t err = lights_group_create(buf);
+
+    return err ? err : len;
+}
+CLASS_ATTR_WO(group_add);
+
+/**
+ * group_remove_store() - File IO handler for /sys/class/lights/group_remove
+ *
+ * @class: Unused
+ * @attr:  Unused
+ * @buf:   Name of the group
+ * @len:   Length of @buf
+ *
+ * @return: Bytes read or a negative error code
+ */
+static ssize_t group_remove_store (
+    struct class *class,
+    struct class_attribute *attr,
+    const char *buf,
+    size_t len
+){
+    struct lights_group *group;
+
+    mutex_lock(&lights_global.group.lock);
+
+    list_for_each_entry(group, &lights_global.group.list, siblings) {
+        if (sysfs_streq(buf, group->name)) {
+            list_del(&group->siblings);
+            mutex_unlock(&lights_global.group.lock);
+
+            lights_group_destroy(group);
+
+            return len;
+        }
+    }
+
+    mutex_unlock(&lights_global.group.lock);
+
+    return -ENOENT;
+}
+CLASS_ATTR_WO(group_remove);
+
+/**
+ * lights_group_destroy_all() - Removes every group
+ */
+static void lights_group_destroy_all (
+    void
+){
+    struct lights_group *group, *safe;
+    LIST_HEAD(groups);
+
+    mutex_lock(&lights_global.group.lock);
+    list_splice_init(&lights_global.group.list, &groups);
+    mutex_unlock(&lights_global.group.lock);
+
+    /* Unregistering detaches from the list, which must not be held */
+    list_for_each_entry_safe(group, safe, &groups, siblings) {
+        list_del(&group->siblings);
+        lights_group_destroy(group);
+    }
+}
+
+/**
+ * caps_show() - File IO handler for /sys/class/lights/___/caps
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ */
+static ssize_t caps_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+    ssize_t written = 0;
+
+    if (intf->id == 0) {
+        written = lights_dump_caps(buf);
+    } else {
+        written = intf->caps_len;
+        if (written > 0)
+            memcpy(buf, intf->caps_text, written);
+    }
+
+    return written;
 }
 DEVICE_ATTR_RO(caps);
 
 /**
- * led_count_show() - File IO handler for /sys/class/lights/___/led_count
+ * led_count_show() - File IO handler for /sys/class/lights/___/led_count
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ */
+static ssize_t led_count_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+
+    /* The 'all' interface and groups have no leds */
+    return sprintf(buf, "%d", intf->led_count);
+}
+DEVICE_ATTR_RO(led_count);
+
+/**
+ * id_show() - File IO handler for /sys/class/lights/___/id
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ *
+ * The id identifies the zone within /dev/lights/all/frame.
+ */
+static ssize_t id_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+
+    return sprintf(buf, "%d\n", intf->id);
+}
+DEVICE_ATTR_RO(id);
+
+/**
+ * error_show() - File IO handler for /sys/class/lights/___/error
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ *
+ * Outputs "0" or the name of the error returned by the last update
+ * completed by the driver.
+ */
+static ssize_t error_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+    error_t err = READ_ONCE(intf->error);
+
+    if (!err)
+        return sprintf(buf, "0\n");
+
+    return sprintf(buf, "%s\n", ERR_NAME(err));
+}
+DEVICE_ATTR_RO(error);
+
+/**
+ * max_fps_show() - File IO handler for /sys/class/lights/___/max_fps
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ *
+ * Outputs the number of updates per second the device has been
+ * measured to complete, or "0" before any update completed.
+ */
+static ssize_t max_fps_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+    uint64_t update_ns = READ_ONCE(intf->update_ns);
+
+    return sprintf(buf, "%llu\n", update_ns ? div64_u64(NSEC_PER_SEC, update_ns) : 0);
+}
+DEVICE_ATTR_RO(max_fps);
+
+/**
+ * fps_limit_show() - File IO handler for /sys/class/lights/___/fps_limit
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ */
+static ssize_t fps_limit_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+    int limit = READ_ONCE(intf->fps_limit);
+
+    if (limit < 0)
+        return sprintf(buf, "auto\n");
+
+    return sprintf(buf, "%d\n", limit);
+}
+
+/**
+ * fps_limit_store() - File IO handler for /sys/class/lights/___/fps_limit
+ *
+ * @dev:  Device being written
+ * @attr: Unused
+ * @buf:  Buffer to read from
+ * @len:  Length of @buf
+ *
+ * @return: Bytes read or a negative error code
+ *
+ * Accepts "0" to disable the pacer, "auto" to follow max_fps or a
+ * fixed number of frames per second. Excess led frames are dropped,
+ * except the newest which is sent once the window expires.
+ */
+static ssize_t fps_limit_store (
+    struct device *dev,
+    struct device_attribute *attr,
+    const char *buf,
+    size_t len
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+    unsigned int limit;
+    error_t err;
+
+    if (sysfs_streq(buf, "auto")) {
+        WRITE_ONCE(intf->fps_limit, -1);
+        return len;
+    }
+
+    err = kstrtouint(buf, 10, &limit);
+    if (err)
+        return err;
+
+    if (limit > 1000)
+        return -EINVAL;
+
+    WRITE_ONCE(intf->fps_limit, limit);
+
+    return len;
+}
+DEVICE_ATTR_RW(fps_limit);
+
+/**
+ * frames_dropped_show() - File IO handler for /sys/class/lights/___/frames_dropped
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ */
+static ssize_t frames_dropped_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+
+    return sprintf(buf, "%d\n", atomic_read(&intf->dropped));
+}
+DEVICE_ATTR_RO(frames_dropped);
+
+/**
+ * members_show() - File IO handler for /sys/class/lights/___/members
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ *
+ * Outputs the member zones of a group, one per line. Empty for zones.
+ */
+static ssize_t members_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+    struct lights_group *group;
+    ssize_t written = 0;
+    size_t i;
+
+    group = intf->owner;
+    if (!group)
+        return 0;
+
+    for (i = 0; i < group->count; i++)
+        written += scnprintf(buf + written, PAGE_SIZE - written, "%s\n", group->members[i].name);
+
+    return written;
+}
+DEVICE_ATTR_RO(members);
+
+/**
+ * generation_show() - File IO handler for /sys/class/lights/___/generation
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ *
+ * Outputs the generation of the pending values followed by that of
+ * the applied values. The zone has converged when both are equal.
+ */
+static ssize_t generation_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+    uint32_t pending, applied;
+    unsigned int seq;
+
+    do {
+        seq = read_seqbegin(&intf->record_lock);
+        pending = intf->pending_gen;
+        applied = intf->applied_gen;
+    } while (read_seqretry(&intf->record_lock, seq));
+
+    return sprintf(buf, "%u %u\n", pending, applied);
+}
+DEVICE_ATTR_RO(generation);
+
+/**
+ * combine_ms_show() - File IO handler for /sys/class/lights/___/combine_ms
+ *
+ * @dev:  Device being read
+ * @attr: Unused
+ * @buf:  Buffer to write into (PAGE_SIZE length)
+ *
+ * @return: Bytes written or a negative error code
+ */
+static ssize_t combine_ms_show (
+    struct device *dev,
+    struct device_attribute *attr,
+    char *buf
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(intf->combine_ms));
+}
+
+/**
+ * combine_ms_store() - File IO handler for /sys/class/lights/___/combine_ms
+ *
+ * @dev:  Device being written
+ * @attr: Unused
+ * @buf:  Buffer to read from
+ * @len:  Length of @buf
+ *
+ * @return: Bytes read or a negative error code
+ *
+ * Accepts the length of the write combining window in milliseconds,
+ * up to 100, or "0" to write each property straight to the driver.
+ */
+static ssize_t combine_ms_store (
+    struct device *dev,
+    struct device_attribute *attr,
+    const char *buf,
+    size_t len
+){
+    struct lights_interface *intf = interface_from_dev(dev);
+    unsigned int window;
+    error_t err;
+
+    err = kstrtouint(buf, 10, &window);
+    if (err)
+        return err;
+
+    if (window > 100)
+        return -EINVAL;
+
+    WRITE_ONCE(intf->combine_ms, window);
+
+    return len;
+}
+DEVICE_ATTR_RW(combine_ms);
+
+static struct attribute *lights_class_attrs[] = {
+	&dev_attr_caps.attr,
+    &dev_attr_led_count.attr,
+    &dev_attr_error.attr,
+    &dev_attr_id.attr,
+    &dev_attr_max_fps.attr,
+    &dev_attr_fps_limit.attr,
+    &dev_attr_frames_dropped.attr,
+    &dev_attr_members.attr,
+    &dev_attr_generation.attr,
+    &dev_attr_combine_ms.attr,
+	NULL,
+};
+
+static struct attribute_group const lights_class_group = {
+	.attrs = lights_class_attrs,
+};
+
+static struct attribute_group const *lights_class_groups[] = {
+	&lights_class_group,
+	NULL,
+};
+
+/**
+ * lights_file_read() - Invokes the read method of a file
+ *
+ * @file:  File to read
+ * @state: Buffer to fill
+ *
+ * @return: Error code
+ */
+static error_t lights_file_read (
+    struct lights_file const *file,
+    struct lights_state *state
+){
+    if (file->attr.read)
+        return file->attr.read(file->attr.thunk, state);
+
+    if (file->intf->id != 0 && !file->intf->group) {
+        /* Drivers may leave reading to the state record */
+        lights_record_read(file->intf, state, false);
+        return 0;
+    }
+
+    return -ENODEV;
+}
+
+/**
+ * lights_attribute_read() - Helper method for invoking write
+ *
+ * @filp:  Handle to the cdev file
+ * @state: Data to write
+ *
+ * @return: Error code
+ */
+static error_t lights_attribute_read (
+    struct file *filp,
+    struct lights_state *state
+){
+    struct lights_file *file;
+    error_t err;
+
+    file = find_attribute_for_file(filp);
+    if (!file)
+        return -ENODEV;
+
+    err = lights_file_read(file, state);
+
+    kref_put(&file->intf->refs, lights_interface_put);
+
+    return err;
+}
+
+/**
+ * lights_attribute_write() - Helper method for invoking read
+ *
+ * @filp:  Handle to the cdev file
+ * @state: Buffer to fill
+ *
+ * @return: Error code
+ */
+static error_t lights_attribute_write (
+    struct file *filp,
+    struct lights_state const *state
+){
+    struct lights_file *file;
+    error_t err = -ENODEV;
+
+    file = find_attribute_for_file(filp);
+    if (!file)
+        return -ENODEV;
+
+    if (file->attr.write)
+        err = lights_file_write(file, state);
+
+    kref_put(&file->intf->refs, lights_interface_put);
+
+    return err;
+}
+
+/**
+ * lights_effect_attribute_read() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Target buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin reading
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_effect_attribute_read (
+    struct file *filp,
+    char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_EFFECT
+    };
+    struct lights_effect *effect = &state.effect;
+    char effect_buf[LIGHTS_EFFECT_MAX_NAME_LENGTH];
+    ssize_t count, err;
+
+    err = lights_attribute_read(filp, &state);
+    if (err)
+        return err;
+
+    if (IS_NULL(effect->name))
+        return -EIO;
+
+    count = strlen(effect->name) + 2;
+    if (*off >= count)
+        return 0;
+
+    snprintf(effect_buf, count, "%s\n", effect->name);
+    err = copy_to_user(buf, effect_buf, len < count ? len : count);
+    if (err)
+        return -EFAULT;
+
+    return *off = count;
+}
+
+/**
+ * lights_effect_attribute_write() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Source buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin writing
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_effect_attribute_write (
+    struct file *filp,
+    const char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_file const *file;
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_EFFECT
+    };
+    error_t err;
+
+    file = find_attribute_for_file(filp);
+    if (!file)
+        return -ENODEV;
+
+    err = lights_find_effect(file->intf, &state.effect, buf, len);
+    if (err)
+        goto exit;
+
+    err = lights_file_write(file, &state);
+
+exit:
+    kref_put(&file->intf->refs, lights_interface_put);
+
+    return err ? err : len;
+}
+
+/**
+ * lights_color_attribute_read() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Target buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin reading
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_color_attribute_read (
+    struct file *filp,
+    char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_COLOR
+    };
+    struct lights_color *c = &state.color;
+    char color_buf[9];
+    ssize_t err;
+
+    if (*off >= 9)
+        return 0;
+
+    err = lights_attribute_read(filp, &state);
+    if (err)
+        return err;
+
+    snprintf(color_buf, 9, "#%02X%02X%02X\n", c->r, c->g, c->b);
+    err = copy_to_user(buf, color_buf, 9);
+    if (err)
+        return -EFAULT;
+
+    return *off = 9;
+}
+
+/**
+ * lights_color_attribute_write() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Source buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin writing
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_color_attribute_write (
+    struct file *filp,
+    const char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_COLOR
+    };
+    ssize_t err;
+
+    err = lights_read_color(buf, len, &state.color);
+    if (err < 0)
+        return err;
+
+    err = lights_attribute_write(filp, &state);
+    if (err)
+        return err;
+
+    return len;
+}
+
+/**
+ * lights_speed_attribute_read() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Target buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin reading
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_speed_attribute_read (
+    struct file *filp,
+    char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_SPEED
+    };
+    char speed_buf[3];
+    ssize_t err;
+
+    if (*off >= 2)
+        return 0;
+
+    err = lights_attribute_read(filp, &state);
+    if (err)
+        return err;
+
+    speed_buf[0] = state.speed + '0';
+    speed_buf[1] = '\n';
+    speed_buf[2] = 0;
+
+    err = copy_to_user(buf, speed_buf, len < 3 ? len : 3);
+    if (err)
+        return -EFAULT;
+
+    return *off = 2;
+}
+
+/**
+ * lights_speed_attribute_write() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Source buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin writing
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_speed_attribute_write (
+    struct file *filp,
+    const char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_SPEED
+    };
+    ssize_t err;
+
+    err = lights_read_speed(buf, len, &state.speed);
+    if (err < 0)
+        return err;
+
+    err = lights_attribute_write(filp, &state);
+    if (err)
+        return err;
+
+    return len;
+}
+
+/**
+ * lights_direction_attribute_read() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Target buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin reading
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_direction_attribute_read (
+    struct file *filp,
+    char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_DIRECTION
+    };
+    char output[3];
+    ssize_t err;
+
+    if (*off >= 2)
+        return 0;
+
+    err = lights_attribute_read(filp, &state);
+    if (err)
+        return err;
+
+    output[0] = state.direction + '0';
+    output[1] = '\n';
+    output[2] = 0;
+
+    err = copy_to_user(buf, output, len < 3 ? len : 3);
+    if (err)
+        return -EFAULT;
+
+    return *off = 2;
+}
+
+/**
+ * lights_direction_attribute_write() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Source buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin writing
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_direction_attribute_write (
+    struct file *filp,
+    const char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_DIRECTION
+    };
+    ssize_t err;
+
+    err = lights_read_direction(buf, len, &state.speed);
+    if (err < 0)
+        return err;
+
+    err = lights_attribute_write(filp, &state);
+    if (err)
+        return err;
+
+    return len;
+}
+
+/**
+ * lights_color_attribute_read() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Target buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin reading
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_raw_attribute_read (
+    struct file *filp,
+    char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_file *file;
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_CUSTOM
+    };
+    struct lights_buffer *buffer = &state.raw;
+    ssize_t err;
+
+    file = find_attribute_for_file(filp);
+    if (!file)
+        return -ENODEV;
+
+    if (!file->raw) {
+        err = -ENODEV;
+        goto exit;
+    }
+
+    /* A short read is returned for anything over the file buffer */
+    mutex_lock(&file->raw_lock);
+
+    buffer->offset = *off;
+    buffer->length = min_t(size_t, len, LIGHTS_RAW_MAX);
+    buffer->data   = file->raw;
+
+    err = lights_file_read(file, &state);
+    if (!err) {
+        // TODO - Keep reading from callback until length is 0 or > len
+        buffer->length = clamp_t(ssize_t, buffer->length, 0, min_t(size_t, len, LIGHTS_RAW_MAX));
+        if (0 != copy_to_user(buf, buffer->data, buffer->length))
+            err = -EFAULT;
+        else
+            *off = buffer->offset;
+    }
+
+    mutex_unlock(&file->raw_lock);
+
+exit:
+    kref_put(&file->intf->refs, lights_interface_put);
+
+    return err ? err : buffer->length;
+}
+
+/**
+ * lights_color_attribute_read() - File IO handler
+ *
+ * @filp: Character device handle
+ * @buf:  Source buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin writing
+ *
+ * @return: Number of bytes or a negative error code
+ */
+static ssize_t lights_raw_attribute_write (
+    struct file *filp,
+    const char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_file *file;
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_CUSTOM
+    };
+    struct lights_buffer *buffer = &state.raw;
+    ssize_t err;
+
+    if (len > LIGHTS_RAW_MAX) {
+        LIGHTS_ERR("Unexpected 'raw' length: %zu", len);
+        return -EINVAL;
+    }
+
+    file = find_attribute_for_file(filp);
+    if (!file)
+        return -ENODEV;
+
+    if (!file->raw || !file->attr.write) {
+        err = -ENODEV;
+        goto exit;
+    }
+
+    mutex_lock(&file->raw_lock);
+
+    buffer->offset = *off;
+    buffer->length = len;
+    buffer->data   = file->raw;
+
+    if (0 != copy_from_user(buffer->data, buf, len))
+        err = -EIO;
+    else
+        err = lights_file_write(file, &state);
+
+    mutex_unlock(&file->raw_lock);
+
+exit:
+    kref_put(&file->intf->refs, lights_interface_put);
+
+    return err ? err : len;
+}
+
+/**
+ * lights_color_attribute_read() - File IO handler
  *
- * @dev:  Device being read
- * @attr: Unused
- * @buf:  Buffer to write into (PAGE_SIZE length)
+ * @filp: Character device handle
+ * @buf:  Source buffer
+ * @len:  Length of @buf
+ * @off:  Offset to begin writing
  *
- * @return: Bytes written or a negative error code
+ * @return: Number of bytes or a negative error code
  */
-static ssize_t led_count_show (
-    struct device *dev,
-    struct device_attribute *attr,
-    char *buf
+static ssize_t lights_leds_attribute_write (
+    struct file *filp,
+    const char __user *buf,
+    size_t len,
+    loff_t *off
+){
+    struct lights_file *file;
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_LEDS
+    };
+    struct lights_buffer *buffer = &state.raw;
+    struct lights_color *color;
+    uint8_t kern_buf[3];
+    uint16_t led_count;
+    ssize_t err;
+    int i;
+
+    file = find_attribute_for_file(filp);
+    if (!file)
+        return -ENODEV;
+
+    if (!file->attr.write) {
+        err = -ENODEV;
+        goto exit;
+    }
+
+    /* The buffer must account for every led */
+    led_count = file->intf->led_count;
+    if (!led_count || led_count * 3 != len) {
+        err = -EINVAL;
+        goto exit;
+    }
+
+    if (!file->intf->led_buffer) {
+        err = -ENOMEM;
+        goto exit;
+    }
+
+    /* The led buffer is shared by every writer of the interface */
+    mutex_lock(&file->raw_lock);
+
+    buffer->offset = *off;
+    buffer->length = led_count;
+    buffer->data   = file->intf->led_buffer;
+
+    color = file->intf->led_buffer;
+
+    for (i = 0; i < led_count; i++) {
+        err = copy_from_user(kern_buf, buf, 3);
+        if (err) {
+            err = -EIO;
+            goto unlock;
+        }
+
+        lights_color_read_rgb(color, kern_buf);
+
+        color++;
+        buf += 3;
+    }
+
+    err = lights_file_write(file, &state);
+
+unlock:
+    mutex_unlock(&file->raw_lock);
+
+exit:
+    kref_put(&file->intf->refs, lights_interface_put);
+
+    return err ? err : buffer->length;
+}
+
+/**
+ * lights_frame_zone_write() - Writes the leds of a single zone
+ *
+ * @header: Zone header read from the frame
+ * @from:   Source of the led data
+ *
+ * @return: Error code
+ */
+static error_t lights_frame_zone_write (
+    struct lights_frame_zone const *header,
+    struct iov_iter *from
+){
+    struct lights_interface *intf;
+    struct lights_file *file;
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_LEDS
+    };
+    struct lights_color *color;
+    uint8_t kern_buf[48];
+    size_t chunk, i;
+    uint16_t remaining;
+    error_t err;
+
+    /* The "all" interface has no leds */
+    if (header->id == 0)
+        return -EINVAL;
+
+    intf = find_interface_for_id(header->id);
+    if (!intf)
+        return -ENODEV;
+
+    file = find_attribute_for_type(intf, LIGHTS_TYPE_LEDS);
+    if (!file || !file->attr.write) {
+        err = -ENODEV;
+        goto exit;
+    }
+
+    if (!header->count || header->count != intf->led_count) {
+        err = -EINVAL;
+        goto exit;
+    }
+
+    if (!intf->led_buffer) {
+        err = -ENOMEM;
+        goto exit;
+    }
+
+    /* Serialized with the leds file, both decode into the same buffer */
+    mutex_lock(&file->raw_lock);
+
+    color = intf->led_buffer;
+    remaining = header->count;
+
+    while (remaining) {
+        chunk = min_t(size_t, remaining, sizeof(kern_buf) / 3);
+
+        if (chunk * 3 != copy_from_iter(kern_buf, chunk * 3, from)) {
+            err = -EFAULT;
+            goto unlock;
+        }
+
+        for (i = 0; i < chunk; i++)
+            lights_color_read_rgb(color++, &kern_buf[i * 3]);
+
+        remaining -= chunk;
+    }
+
+    state.raw.length = header->count;
+    state.raw.data   = intf->led_buffer;
+
+    err = lights_file_write(file, &state);
+
+unlock:
+    mutex_unlock(&file->raw_lock);
+
+exit:
+    if (file)
+        kref_put(&intf->refs, lights_interface_put);
+    kref_put(&intf->refs, lights_interface_put);
+
+    return err;
+}
+
+/**
+ * lights_frame_attribute_write_iter() - File IO handler
+ *
+ * @iocb: Kernel IO control block
+ * @from: Source buffers
+ *
+ * @return: Number of bytes or a negative error code
+ *
+ * Each zone within the frame is a struct lights_frame_zone followed by
+ * the led data of the zone. The data is forwarded to the "leds" file
+ * of each zone. Should a zone fail, the number of bytes successfully
+ * written before it is returned.
+ */
+static ssize_t lights_frame_attribute_write_iter (
+    struct kiocb *iocb,
+    struct iov_iter *from
+){
+    struct lights_frame_zone header;
+    struct lights_adapter_plug plug;
+    size_t total = iov_iter_count(from);
+    size_t written = 0;
+    error_t err = 0;
+
+    /* Submit the whole frame as one job per adapter */
+    lights_adapter_plug(&plug);
+
+    while (iov_iter_count(from)) {
+        if (sizeof(header) != copy_from_iter(&header, sizeof(header), from)) {
+            err = -EINVAL;
+            break;
+        }
+
+        if (iov_iter_count(from) < header.count * 3) {
+            err = -EINVAL;
+            break;
+        }
+
+        err = lights_frame_zone_write(&header, from);
+        if (err) {
+            LIGHTS_ERR("Failed to write frame zone '%d': %s", header.id, ERR_NAME(err));
+            break;
+        }
+
+        written = total - iov_iter_count(from);
+    }
+
+    lights_adapter_unplug(&plug);
+
+    return written ? written : err;
+}
+
+/* Runs allowed to find their frame overwritten, before waiting for a write */
+#define LIGHTS_RING_RETRIES 4
+
+/* Longest wait, in milliseconds, for the device to complete a frame */
+#define LIGHTS_RING_TIMEOUT 100
+
+/**
+ * lights_ring_queue() - Queues the consumer of a ring
+ *
+ * @intf: Interface owning the ring
+ *
+ * The queued work holds a reference to the interface.
+ */
+static void lights_ring_queue (
+    struct lights_interface *intf
+){
+    kref_get(&intf->refs);
+    if (!queue_work(system_highpri_wq, &intf->ring.work))
+        kref_put(&intf->refs, lights_interface_put);
+}
+
+/**
+ * lights_ring_resume() - Requeues a consumer waiting on the device
+ *
+ * @intf: Interface whose updates have all completed
+ *
+ * May be called from interrupt context.
+ */
+static void lights_ring_resume (
+    struct lights_interface *intf
+){
+    if (atomic_xchg(&intf->ring.waiting, 0) && !READ_ONCE(intf->ring.closed))
+        lights_ring_queue(intf);
+}
+
+/**
+ * lights_ring_work() - Pushes the newest frame of a ring to the device
+ *
+ * @work: Work of the ring
+ *
+ * Each run takes at most one frame, the newest as of its start. After
+ * the push, the next is held back until the device has completed the
+ * update, so a slow device drops frames rather than accumulating
+ * latency. The work is not left sleeping on the shared queue, it is
+ * requeued by lights_device_complete(). Should more frames be waiting,
+ * the work is requeued rather than looping, as @head is written by
+ * userland.
+ */
+static void lights_ring_work (
+    struct work_struct *work
+){
+    struct lights_ring *ring = container_of(work, struct lights_ring, work);
+    struct lights_interface *intf = container_of(ring, struct lights_interface, ring);
+    struct lights_ring_header *header = ring->header;
+    struct lights_state state = {
+        .type = LIGHTS_TYPE_LEDS
+    };
+    struct lights_file *file;
+    uint8_t const *slot;
+    uint32_t head, frame, dropped;
+    uint16_t led_count = intf->led_count;
+    uint16_t i;
+    error_t err;
+
+    if (READ_ONCE(ring->closed))
+        goto exit;
+
+    /* Still awaiting the device, unless it never reported back */
+    if (atomic_read(&ring->waiting)) {
+        if (ktime_ms_delta(ktime_get(), ring->pushed) < LIGHTS_RING_TIMEOUT)
+            goto exit;
+
+        atomic_set(&ring->waiting, 0);
+    }
+
+    /* The reference held by the queued work keeps the file alive */
+    file = find_attribute_for_type(intf, LIGHTS_TYPE_LEDS);
+    if (!file)
+        goto exit;
+
+    kref_put(&intf->refs, lights_interface_put);
+
+    state.raw.length = led_count;
+    state.raw.data   = ring->frame;
+
+    head = smp_load_acquire(&header->head);
+    if (head == ring->consumed)
+        goto exit;
+
+    frame = head - 1;
+    slot = (uint8_t const *)header + PAGE_SIZE + (frame % LIGHTS_RING_FRAMES) * led_count * 3;
+
+    for (i = 0; i < led_count; i++)
+        lights_color_read_rgb(&ring->frame[i], &slot[i * 3]);
+
+    /* The producer lapped the ring while we were copying */
+    smp_rmb();
+    if (READ_ONCE(header->head) - frame >= LIGHTS_RING_FRAMES) {
+        if (++ring->retries <= LIGHTS_RING_RETRIES)
+            goto requeue;
+
+        LIGHTS_DBG("Ring of '%s' overwritten during each copy", intf->name);
+        ring->retries = 0;
+        goto exit;
+    }
+
+    ring->retries = 0;
+
+    dropped = head - ring->consumed - 1;
+    ring->consumed = head;
+
+    WRITE_ONCE(header->dropped, READ_ONCE(header->dropped) + dropped);
+    smp_store_release(&header->tail, head);
+
+    err = lights_file_write(file, &state);
+    if (err) {
+        LIGHTS_ERR("Failed to push '%s' ring frame: %s", intf->name, ERR_NAME(err));
+        goto exit;
+    }
+
+    ring->pushed = ktime_get();
+    atomic_set(&ring->waiting, 1);
+    smp_mb__after_atomic();
+
+    /* The device may already be done, its completion then missed the flag */
+    if (atomic_read(&intf->completed) != atomic_read(&intf->submitted))
+        goto exit;
+
+    if (!atomic_xchg(&ring->waiting, 0))
+        goto exit;
+
+    if (READ_ONCE(header->head) == ring->consumed)
+        goto exit;
+
+requeue:
+    /* The reference passes to the next run, cancel_work_sync() refuses it */
+    if (queue_work(system_highpri_wq, &ring->work))
+        return;
+
+exit:
+    kref_put(&intf->refs, lights_interface_put);
+}
+
+/**
+ * lights_ring_create() - Allocates the shared memory of a ring
+ *
+ * @intf: Interface owning the ring
+ *
+ * @return: Error code
+ *
+ * The caller MUST hold the ring lock.
+ */
+static error_t lights_ring_create (
+    struct lights_interface *intf
 ){
-    struct lights_interface *intf = interface_from_dev(dev);
+    struct lights_ring *ring = &intf->ring;
+    uint16_t led_count = intf->led_count;
 
-    if (intf->ldev)
-        return sprintf(buf, "%d", intf->ldev->led_count);
+    ring->size = PAGE_SIZE + PAGE_ALIGN(LIGHTS_RING_FRAMES * led_count * 3);
 
-    /* The 'all' interface has no associated dev, so 0 leds */
-    return 0;
-}
-DEVICE_ATTR_RO(led_count);
+    ring->frame = kcalloc(led_count, sizeof(*ring->frame), GFP_KERNEL);
+    if (!ring->frame)
+        return -ENOMEM;
 
-static struct attribute *lights_class_attrs[] = {
-	&dev_attr_caps.attr,
-    &dev_attr_led_count.attr,
-	NULL,
-};
+    ring->header = vmalloc_user(ring->size);
+    if (!ring->header) {
+        kfree(ring->frame);
+        ring->frame = NULL;
+        return -ENOMEM;
+    }
 
-static struct attribute_group const lights_class_group = {
-	.attrs = lights_class_attrs,
-};
+    ring->header->led_count    = led_count;
+    ring->header->frame_count  = LIGHTS_RING_FRAMES;
+    ring->header->frame_offset = PAGE_SIZE;
+    ring->header->frame_size   = led_count * 3;
 
-static struct attribute_group const *lights_class_groups[] = {
-	&lights_class_group,
-	NULL,
-};
+    return 0;
+}
 
 /**
- * lights_attribute_read() - Helper method for invoking write
+ * lights_ring_mmap() - File IO handler
  *
- * @filp:  Handle to the cdev file
- * @state: Data to write
+ * @filp: Character device handle
+ * @vma:  Mapping to populate
  *
  * @return: Error code
  */
-static error_t lights_attribute_read (
+static int lights_ring_mmap (
     struct file *filp,
-    struct lights_state *state
+    struct vm_area_struct *vma
 ){
-    struct lights_file *file;
-    error_t err = -ENODEV;
+    struct lights_file *file = filp->private_data;
+    struct lights_ring *ring;
+    error_t err = 0;
 
-    file = find_attribute_for_file(filp);
     if (!file)
         return -ENODEV;
 
-    if (file->attr.read)
-        err = file->attr.read(file->attr.thunk, state);
+    ring = &file->intf->ring;
 
-    kref_put(&file->intf->refs, lights_interface_put);
+    if (vma->vm_pgoff)
+        return -EINVAL;
+
+    mutex_lock(&ring->lock);
+
+    if (ring->closed)
+        err = -ENODEV;
+    else if (!ring->header)
+        err = lights_ring_create(file->intf);
+
+    if (!err && vma->vm_end - vma->vm_start != ring->size)
+        err = -EINVAL;
+
+    if (!err)
+        err = remap_vmalloc_range(vma, ring->header, 0);
+
+    mutex_unlock(&ring->lock);
 
     return err;
 }
 
 /**
- * lights_attribute_write() - Helper method for invoking read
+ * lights_ring_write() - File IO handler
  *
- * @filp:  Handle to the cdev file
- * @state: Buffer to fill
+ * @filp: Character device handle
+ * @buf:  Unused
+ * @len:  Length of @buf
+ * @off:  Unused
  *
- * @return: Error code
+ * @return: Number of bytes or a negative error code
+ *
+ * Any write wakes the consumer of the ring.
  */
-static error_t lights_attribute_write (
+static ssize_t lights_ring_write (
     struct file *filp,
-    struct lights_state const *state
+    const char __user *buf,
+    size_t len,
+    loff_t *off
 ){
-    struct lights_file *file;
-    error_t err = -ENODEV;
+    struct lights_file *file = filp->private_data;
+    struct lights_interface *intf;
+    error_t err = 0;
 
-    file = find_attribute_for_file(filp);
     if (!file)
         return -ENODEV;
 
-    if (file->attr.write)
-        err = file->attr.write(file->attr.thunk, state);
+    intf = file->intf;
 
-    kref_put(&file->intf->refs, lights_interface_put);
+    mutex_lock(&intf->ring.lock);
 
-    return err;
+    if (intf->ring.closed)
+        err = -ENODEV;
+    else if (!intf->ring.header)
+        err = -ENXIO;
+    else
+        lights_ring_queue(intf);
+
+    mutex_unlock(&intf->ring.lock);
+
+    return err ? err : len;
 }
 
 /**
- * lights_effect_attribute_read() - File IO handler
+ * lights_color_attribute_read() - File IO handler
  *
  * @filp: Character device handle
- * @buf:  Target buffer
+ * @buf:  Source buffer
  * @len:  Length of @buf
- * @off:  Offset to begin reading
+ * @off:  Offset to begin writing
  *
  * @return: Number of bytes or a negative error code
  */
-static ssize_t lights_effect_attribute_read (
+static ssize_t lights_sync_attribute_write (
     struct file *filp,
-    char __user *buf,
+    const char __user *buf,
     size_t len,
     loff_t *off
 ){
     struct lights_state state = {
-        .type = LIGHTS_TYPE_EFFECT
+        .type = LIGHTS_TYPE_SYNC
     };
-    struct lights_effect *effect = &state.effect;
-    char effect_buf[LIGHTS_EFFECT_MAX_NAME_LENGTH];
-    ssize_t count, err;
+    ssize_t err;
 
-    err = lights_attribute_read(filp, &state);
+    err = lights_read_sync(buf, len, &state.sync);
+    if (err < 0)
+        return err;
+
+    err = lights_attribute_write(filp, &state);
     if (err)
         return err;
 
-    if (IS_NULL(effect->name))
-        return -EIO;
+    return len;
+}
 
-    count = strlen(effect->name) + 2;
-    if (*off >= count)
-        return 0;
+/**
+ * lights_update_state_validate() - Validates a state written by userland
+ *
+ * @intf:  Interface the state is intended for
+ * @state: State copied from the user buffer
+ *
+ * @return: Error code
+ *
+ * The effect name, which is still a userland pointer, is resolved.
+ */
+static error_t lights_update_state_validate (
+    struct lights_interface *intf,
+    struct lights_state *state
+){
+    enum lights_state_type allowed = (
+        LIGHTS_TYPE_EFFECT | LIGHTS_TYPE_COLOR | LIGHTS_TYPE_SPEED | LIGHTS_TYPE_DIRECTION | LIGHTS_TYPE_SYNC
+    );
+    error_t err;
 
-    snprintf(effect_buf, count, "%s\n", effect->name);
-    err = copy_to_user(buf, effect_buf, len < count ? len : count);
-    if (err)
-        return -EFAULT;
+    if ((state->type & ~allowed) != 0) {
+        LIGHTS_ERR("state.type contains unsupported flags");
+        return -EINVAL;
+    }
 
-    return *off = count;
+    /* Trying to sneak in a pointer??? */
+    memset(&state->raw, 0, sizeof(state->raw));
+
+    /* Fix effect name */
+    if (state->type & LIGHTS_TYPE_EFFECT) {
+        if (!state->effect.name || state->effect.id > LIGHTS_EFFECT_MAX_NAME_LENGTH) {
+            LIGHTS_ERR("userland buffer error");
+            return -EINVAL;
+        }
+
+        err = lights_find_effect(intf, &state->effect, state->effect.name, state->effect.id);
+        if (err)
+            return err;
+    }
+
+    if (state->type & LIGHTS_TYPE_SPEED) {
+        if (state->speed > 5) {
+            LIGHTS_ERR("Invalid speed value: 0x%02x", state->speed);
+            return -EINVAL;
+        }
+    }
+
+    if (state->type & LIGHTS_TYPE_DIRECTION) {
+        if (state->direction > 1) {
+            LIGHTS_ERR("Invalid direction value: 0x%02x", state->direction);
+            return -EINVAL;
+        }
+    }
+
+    return 0;
 }
 
 /**
- * lights_effect_attribute_write() - File IO handler
+ * lights_update_attribute_write() - File IO handler
  *
  * @filp: Character device handle
  * @buf:  Source buffer
@@ -1137,78 +4012,254 @@ static ssize_t lights_effect_attribute_read (
  * @off:  Offset to begin writing
  *
  * @return: Number of bytes or a negative error code
+ *
+ * This is a special function which allows another process to
+ * pass in a struct lights_state. This should enable a service
+ * to update multiple properties in a single call.
  */
-static ssize_t lights_effect_attribute_write (
+static ssize_t lights_update_attribute_write (
     struct file *filp,
     const char __user *buf,
     size_t len,
     loff_t *off
 ){
     struct lights_file const *file;
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_EFFECT
-    };
+    struct lights_state state;
     error_t err;
 
+    if (len != sizeof(state)) {
+        LIGHTS_ERR("Unexpected 'update' length: %ld", len);
+        return -EINVAL;
+    }
+
+    if (0 != copy_from_user(&state, buf, len)) {
+        LIGHTS_ERR("Failed to copy user buffer");
+        return -EIO;
+    }
+
     file = find_attribute_for_file(filp);
     if (!file)
         return -ENODEV;
 
-    err = lights_find_effect(file->intf, &state.effect, buf, len);
+    err = lights_update_state_validate(file->intf, &state);
     if (err)
         goto exit;
 
-    if (file->attr.write)
-        err = file->attr.write(file->attr.thunk, &state);
-    else
-        err = -ENODEV;
+    err = lights_file_write(file, &state);
+
+exit:
+    kref_put(&file->intf->refs, lights_interface_put);
+
+    return err ? err : len;
+}
+
+/**
+ * struct lights_staged - A state waiting to be committed
+ *
+ * @siblings: Next and prev pointers
+ * @intf:     Target interface (reference counted)
+ * @state:    Validated state
+ */
+struct lights_staged {
+    struct list_head        siblings;
+    struct lights_interface *intf;
+    struct lights_state     state;
+};
+
+/**
+ * struct lights_transaction - Per open file data of the transaction file
+ *
+ * @file:   The transaction file
+ * @lock:   Lock for @staged
+ * @staged: List of struct lights_staged
+ */
+struct lights_transaction {
+    struct lights_file      *file;
+    struct mutex            lock;
+    struct list_head        staged;
+};
+
+/**
+ * lights_transaction_stage() - Adds, or merges, a state into the transaction
+ *
+ * @trans: Open transaction
+ * @intf:  Target interface, the reference is taken on success
+ * @state: Validated state
+ *
+ * @return: Error code
+ *
+ * Staging the same zone twice merges the states, the newest values win.
+ */
+static error_t lights_transaction_stage (
+    struct lights_transaction *trans,
+    struct lights_interface *intf,
+    struct lights_state const *state
+){
+    struct lights_staged *staged;
+
+    list_for_each_entry(staged, &trans->staged, siblings) {
+        if (staged->intf != intf)
+            continue;
+
+        if (state->type & LIGHTS_TYPE_EFFECT)
+            staged->state.effect = state->effect;
+        if (state->type & LIGHTS_TYPE_COLOR)
+            staged->state.color = state->color;
+        if (state->type & LIGHTS_TYPE_SPEED)
+            staged->state.speed = state->speed;
+        if (state->type & LIGHTS_TYPE_DIRECTION)
+            staged->state.direction = state->direction;
+        if (state->type & LIGHTS_TYPE_SYNC)
+            staged->state.sync = state->sync;
+
+        staged->state.type |= state->type;
+
+        /* The list already holds a reference */
+        kref_put(&intf->refs, lights_interface_put);
+
+        return 0;
+    }
+
+    staged = kmalloc(sizeof(*staged), GFP_KERNEL);
+    if (!staged)
+        return -ENOMEM;
+
+    staged->intf  = intf;
+    staged->state = *state;
+    list_add_tail(&staged->siblings, &trans->staged);
+
+    return 0;
+}
+
+/**
+ * lights_transaction_discard() - Removes all staged states
+ *
+ * @trans: Open transaction
+ */
+static void lights_transaction_discard (
+    struct lights_transaction *trans
+){
+    struct lights_staged *staged, *safe;
+
+    list_for_each_entry_safe(staged, safe, &trans->staged, siblings) {
+        list_del(&staged->siblings);
+        kref_put(&staged->intf->refs, lights_interface_put);
+        kfree(staged);
+    }
+}
+
+/**
+ * lights_transaction_zone_read() - Converts a userland record into a state
+ *
+ * @intf:   Interface the record is intended for
+ * @zone:   Record copied from the user buffer
+ * @record: Userland address of the record
+ * @state:  Buffer to populate
+ *
+ * @return: Error code
+ */
+static error_t lights_transaction_zone_read (
+    struct lights_interface *intf,
+    struct lights_transaction_zone const *zone,
+    const char __user *record,
+    struct lights_state *state
+){
+    error_t err;
+
+    memset(state, 0, sizeof(*state));
+
+    state->type        = zone->type & ~LIGHTS_TYPE_EFFECT;
+    state->color.value = zone->color;
+    state->speed       = zone->speed;
+    state->direction   = zone->direction;
+    state->sync        = zone->sync;
+
+    err = lights_update_state_validate(intf, state);
+    if (err)
+        return err;
+
+    if (zone->type & LIGHTS_TYPE_EFFECT) {
+        if (zone->name_offset < sizeof(*zone) ||
+            zone->name_offset + zone->name_length > zone->length) {
+            LIGHTS_ERR("Effect name lies outside of the 'transaction' record");
+            return -EINVAL;
+        }
+
+        err = lights_find_effect(intf, &state->effect, record + zone->name_offset, zone->name_length);
+        if (err)
+            return err;
+
+        state->type |= LIGHTS_TYPE_EFFECT;
+    }
+
+    return 0;
+}
+
+/**
+ * lights_transaction_open() - File IO handler
+ *
+ * @inode: Unused
+ * @filp:  Character device handle
+ *
+ * @return: Zero or a negative error code
+ *
+ * Every open file has its own transaction.
+ */
+static int lights_transaction_open (
+    struct inode *inode,
+    struct file *filp
+){
+    struct lights_transaction *trans;
+    struct lights_file *file;
+
+    file = find_attribute_for_file(filp);
+    if (!file)
+        return -ENODEV;
+
+    trans = kzalloc(sizeof(*trans), GFP_KERNEL);
+    if (!trans) {
+        kref_put(&file->intf->refs, lights_interface_put);
+        return -ENOMEM;
+    }
+
+    trans->file = file;
+    mutex_init(&trans->lock);
+    INIT_LIST_HEAD(&trans->staged);
 
-exit:
-    kref_put(&file->intf->refs, lights_interface_put);
+    filp->private_data = trans;
 
-    return err ? err : len;
+    return 0;
 }
 
 /**
- * lights_color_attribute_read() - File IO handler
+ * lights_transaction_release() - File IO handler
  *
- * @filp: Character device handle
- * @buf:  Target buffer
- * @len:  Length of @buf
- * @off:  Offset to begin reading
+ * @inode: Unused
+ * @filp:  Character device handle
  *
- * @return: Number of bytes or a negative error code
+ * @return: Zero
+ *
+ * Anything not yet committed is discarded.
  */
-static ssize_t lights_color_attribute_read (
-    struct file *filp,
-    char __user *buf,
-    size_t len,
-    loff_t *off
+static int lights_transaction_release (
+    struct inode *inode,
+    struct file *filp
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_COLOR
-    };
-    struct lights_color *c = &state.color;
-    char color_buf[9];
-    ssize_t err;
-
-    if (*off >= 9)
-        return 0;
+    struct lights_transaction *trans = filp->private_data;
 
-    err = lights_attribute_read(filp, &state);
-    if (err)
-        return err;
+    if (trans) {
+        lights_transaction_discard(trans);
+        kref_put(&trans->file->intf->refs, lights_interface_put);
+        kfree(trans);
+    }
 
-    snprintf(color_buf, 9, "#%02X%02X%02X\n", c->r, c->g, c->b);
-    err = copy_to_user(buf, color_buf, 9);
-    if (err)
-        return -EFAULT;
+    filp->private_data = NULL;
 
-    return *off = 9;
+    return 0;
 }
 
 /**
- * lights_color_attribute_write() - File IO handler
+ * lights_transaction_write() - File IO handler
  *
  * @filp: Character device handle
  * @buf:  Source buffer
@@ -1216,509 +4267,628 @@ static ssize_t lights_color_attribute_read (
  * @off:  Offset to begin writing
  *
  * @return: Number of bytes or a negative error code
+ *
+ * The buffer contains one or more struct lights_transaction_zone, each
+ * followed by the data it carries. Each is validated before being staged.
+ * Nothing is written to the hardware.
  */
-static ssize_t lights_color_attribute_write (
+static ssize_t lights_transaction_write (
     struct file *filp,
     const char __user *buf,
     size_t len,
     loff_t *off
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_COLOR
-    };
-    ssize_t err;
+    struct lights_transaction *trans = filp->private_data;
+    struct lights_transaction_zone zone;
+    struct lights_interface *intf;
+    struct lights_state state;
+    size_t written = 0;
+    error_t err = 0;
 
-    err = lights_read_color(buf, len, &state.color);
-    if (err < 0)
-        return err;
+    BUILD_BUG_ON(sizeof(zone) != 20);
 
-    err = lights_attribute_write(filp, &state);
-    if (err)
-        return err;
+    if (!trans)
+        return -ENODEV;
 
-    return len;
+    if (len < sizeof(zone)) {
+        LIGHTS_ERR("Unexpected 'transaction' length: %ld", len);
+        return -EINVAL;
+    }
+
+    mutex_lock(&trans->lock);
+
+    for (written = 0; written < len; written += zone.length) {
+        if (len - written < sizeof(zone)) {
+            LIGHTS_ERR("Unexpected 'transaction' length: %ld", len);
+            err = -EINVAL;
+            break;
+        }
+
+        if (0 != copy_from_user(&zone, buf + written, sizeof(zone))) {
+            LIGHTS_ERR("Failed to copy user buffer");
+            err = -EIO;
+            break;
+        }
+
+        if (zone.length < sizeof(zone) || zone.length > len - written || zone.reserved) {
+            LIGHTS_ERR("Invalid 'transaction' record");
+            err = -EINVAL;
+            break;
+        }
+
+        intf = find_interface_for_id(zone.id);
+        if (!intf) {
+            err = -ENODEV;
+            break;
+        }
+
+        err = lights_transaction_zone_read(intf, &zone, buf + written, &state);
+        if (!err)
+            err = lights_transaction_stage(trans, intf, &state);
+
+        if (err) {
+            kref_put(&intf->refs, lights_interface_put);
+            break;
+        }
+    }
+
+    mutex_unlock(&trans->lock);
+
+    return written ? written : err;
 }
 
 /**
- * lights_speed_attribute_read() - File IO handler
+ * lights_transaction_fsync() - File IO handler
  *
- * @filp: Character device handle
- * @buf:  Target buffer
- * @len:  Length of @buf
- * @off:  Offset to begin reading
+ * @filp:     Character device handle
+ * @start:    Unused
+ * @end:      Unused
+ * @datasync: Unused
  *
- * @return: Number of bytes or a negative error code
+ * @return: Zero or the first error encountered
+ *
+ * Commits every staged state. While doing so, the adapters hold back
+ * the async jobs of each driver and submit them, grouped by bus, once
+ * all zones have been written. The whole rig then changes together.
  */
-static ssize_t lights_speed_attribute_read (
+static int lights_transaction_fsync (
     struct file *filp,
-    char __user *buf,
-    size_t len,
-    loff_t *off
+    loff_t start,
+    loff_t end,
+    int datasync
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_SPEED
-    };
-    char speed_buf[3];
-    ssize_t err;
+    struct lights_transaction *trans = filp->private_data;
+    struct lights_adapter_plug plug;
+    struct lights_staged *staged;
+    struct lights_file *file;
+    error_t err = 0, ret = 0;
 
-    if (*off >= 2)
-        return 0;
+    if (!trans)
+        return -ENODEV;
 
-    err = lights_attribute_read(filp, &state);
-    if (err)
-        return err;
+    mutex_lock(&trans->lock);
 
-    speed_buf[0] = state.speed + '0';
-    speed_buf[1] = '\n';
-    speed_buf[2] = 0;
+    lights_adapter_plug(&plug);
 
-    err = copy_to_user(buf, speed_buf, len < 3 ? len : 3);
-    if (err)
-        return -EFAULT;
+    list_for_each_entry(staged, &trans->staged, siblings) {
+        file = &staged->intf->update;
+        if (!file->attr.write)
+            continue;
 
-    return *off = 2;
+        err = lights_file_write(file, &staged->state);
+        if (err) {
+            LIGHTS_ERR("Failed to commit '%s': %s", staged->intf->name, ERR_NAME(err));
+            if (!ret)
+                ret = err;
+        }
+    }
+
+    lights_adapter_unplug(&plug);
+
+    lights_transaction_discard(trans);
+
+    mutex_unlock(&trans->lock);
+
+    return ret;
 }
 
 /**
- * lights_speed_attribute_write() - File IO handler
+ * lights_attribute_open() - File IO handler
  *
- * @filp: Character device handle
- * @buf:  Source buffer
- * @len:  Length of @buf
- * @off:  Offset to begin writing
+ * @inode: Unused
+ * @filp:  Character device handle
  *
- * @return: Number of bytes or a negative error code
+ * @return: Zero or a negative error code
+ *
+ * A reference to the owning interface is held for as long as the
+ * file is open, allowing a poll to safely wait on the interface.
  */
-static ssize_t lights_speed_attribute_write (
-    struct file *filp,
-    const char __user *buf,
-    size_t len,
-    loff_t *off
+static int lights_attribute_open (
+    struct inode *inode,
+    struct file *filp
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_SPEED
-    };
-    ssize_t err;
+    struct lights_file *file;
 
-    err = lights_read_speed(buf, len, &state.speed);
-    if (err < 0)
-        return err;
+    file = find_attribute_for_file(filp);
+    if (!file)
+        return -ENODEV;
 
-    err = lights_attribute_write(filp, &state);
-    if (err)
-        return err;
+    filp->private_data = file;
 
-    return len;
+    return 0;
 }
 
 /**
- * lights_direction_attribute_read() - File IO handler
+ * lights_attribute_release() - File IO handler
  *
- * @filp: Character device handle
- * @buf:  Target buffer
- * @len:  Length of @buf
- * @off:  Offset to begin reading
+ * @inode: Unused
+ * @filp:  Character device handle
  *
- * @return: Number of bytes or a negative error code
+ * @return: Zero
  */
-static ssize_t lights_direction_attribute_read (
-    struct file *filp,
-    char __user *buf,
-    size_t len,
-    loff_t *off
+static int lights_attribute_release (
+    struct inode *inode,
+    struct file *filp
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_DIRECTION
-    };
-    char output[3];
-    ssize_t err;
-
-    if (*off >= 2)
-        return 0;
+    struct lights_file *file = filp->private_data;
 
-    err = lights_attribute_read(filp, &state);
-    if (err)
-        return err;
-
-    output[0] = state.direction + '0';
-    output[1] = '\n';
-    output[2] = 0;
+    if (file)
+        kref_put(&file->intf->refs, lights_interface_put);
 
-    err = copy_to_user(buf, output, len < 3 ? len : 3);
-    if (err)
-        return -EFAULT;
+    filp->private_data = NULL;
 
-    return *off = 2;
+    return 0;
 }
 
 /**
- * lights_direction_attribute_write() - File IO handler
+ * lights_attribute_poll() - File IO handler
  *
  * @filp: Character device handle
- * @buf:  Source buffer
- * @len:  Length of @buf
- * @off:  Offset to begin writing
+ * @wait: Poll table
  *
- * @return: Number of bytes or a negative error code
+ * @return: Mask of ready events
+ *
+ * The file becomes ready once every update submitted by the driver
+ * has completed. EPOLLERR is added when the last of those failed.
  */
-static ssize_t lights_direction_attribute_write (
+static __poll_t lights_attribute_poll (
     struct file *filp,
-    const char __user *buf,
-    size_t len,
-    loff_t *off
+    struct poll_table_struct *wait
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_DIRECTION
-    };
-    ssize_t err;
+    struct lights_file *file = filp->private_data;
+    struct lights_interface *intf;
+    __poll_t mask = 0;
 
-    err = lights_read_direction(buf, len, &state.speed);
-    if (err < 0)
-        return err;
+    if (!file)
+        return EPOLLERR | EPOLLHUP;
 
-    err = lights_attribute_write(filp, &state);
-    if (err)
-        return err;
+    intf = file->intf;
 
-    return len;
+    poll_wait(filp, &intf->wait, wait);
+
+    /* The device has gone, nothing will ever complete */
+    if (!READ_ONCE(intf->ldev))
+        return EPOLLERR | EPOLLHUP;
+
+    if (atomic_read(&intf->completed) == atomic_read(&intf->submitted)) {
+        mask = EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+        if (READ_ONCE(intf->error))
+            mask |= EPOLLERR;
+    }
+
+    return mask;
 }
 
 /**
- * lights_color_attribute_read() - File IO handler
+ * lights_attribute_fsync() - File IO handler
  *
- * @filp: Character device handle
- * @buf:  Target buffer
- * @len:  Length of @buf
- * @off:  Offset to begin reading
+ * @filp:     Character device handle
+ * @start:    Unused
+ * @end:      Unused
+ * @datasync: Unused
  *
- * @return: Number of bytes or a negative error code
+ * @return: Zero or the deferred error of a combined update
+ *
+ * Closes the write combining window of the zone, waits for its update
+ * to be given to the driver, and reports a failure of that or of any
+ * earlier combined update not yet returned by write().
  */
-static ssize_t lights_raw_attribute_read (
+static int lights_attribute_fsync (
     struct file *filp,
-    char __user *buf,
-    size_t len,
-    loff_t *off
+    loff_t start,
+    loff_t end,
+    int datasync
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_CUSTOM
-    };
-    struct lights_buffer *buffer = &state.raw;
-    ssize_t err;
+    struct lights_file *file = READ_ONCE(filp->private_data);
 
-    buffer->offset = *off;
-    buffer->length = len;
-    buffer->data = kmalloc(len, GFP_KERNEL);
-    if (!buffer->data)
-        return -ENOMEM;
+    if (!file)
+        return -ENODEV;
 
-    err = lights_attribute_read(filp, &state);
-    if (err)
-        goto error;
+    return lights_combine_flush(file->intf);
+}
 
-    // TODO - Keep reading from callback until length is 0 or > len
-    copy_to_user(buf, buffer->data, buffer->length);
-    *off = buffer->offset;
 
-error:
-    kfree(buffer->data);
+static inline error_t lights_minor_get (
+    unsigned long *minor
+){
+    int id;
 
-    return err ? err : buffer->length;
+    id = ida_alloc_max(&lights_global.minors, LIGHTS_MAX_MINORS - 1, GFP_KERNEL);
+    if (id < 0)
+        return id == -ENOSPC ? -EBUSY : id;
+
+    *minor = id;
+
+    return 0;
+}
+
+static inline error_t lights_minor_put (
+    unsigned long minor
+){
+    if (minor >= LIGHTS_MAX_MINORS)
+        return -EINVAL;
+
+    ida_free(&lights_global.minors, minor);
+
+    return 0;
 }
 
 /**
- * lights_color_attribute_read() - File IO handler
+ * lights_node_open() - File IO handler
  *
- * @filp: Character device handle
- * @buf:  Source buffer
- * @len:  Length of @buf
- * @off:  Offset to begin writing
+ * @inode: Node of the zone
+ * @filp:  Character device handle
  *
- * @return: Number of bytes or a negative error code
+ * @return: Zero or a negative error code
+ *
+ * The update file is selected until LIGHTS_IOCTL_SELECT is used.
  */
-static ssize_t lights_raw_attribute_write (
-    struct file *filp,
-    const char __user *buf,
-    size_t len,
-    loff_t *off
+static int lights_node_open (
+    struct inode *inode,
+    struct file *filp
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_CUSTOM
-    };
-    struct lights_buffer *buffer = &state.raw;
-    ssize_t err;
+    struct lights_interface *intf;
 
-    buffer->offset = *off;
-    buffer->length = len;
-    buffer->data = kmalloc(len, GFP_KERNEL);
-    if (!buffer->data) {
-        err = -ENOMEM;
-        goto exit;
-    }
+    spin_lock(&lights_global.interface.lock);
 
-    err = copy_from_user(buffer->data, buf, len);
-    if (err) {
-        err = -EIO;
-        goto exit;
+    list_for_each_entry(intf, &lights_global.interface.list, siblings) {
+        if (inode->i_cdev == intf->node) {
+            kref_get(&intf->refs);
+            filp->private_data = &intf->update;
+            break;
+        }
     }
 
-    err = lights_attribute_write(filp, &state);
-
-exit:
-    kfree(buffer->data);
+    spin_unlock(&lights_global.interface.lock);
 
-    return err ? err : buffer->length;
+    return filp->private_data ? 0 : -ENODEV;
 }
 
 /**
- * lights_color_attribute_read() - File IO handler
+ * lights_node_ioctl() - File IO handler
  *
  * @filp: Character device handle
- * @buf:  Source buffer
- * @len:  Length of @buf
- * @off:  Offset to begin writing
+ * @cmd:  LIGHTS_IOCTL_SELECT
+ * @arg:  User pointer to the name of a file
  *
- * @return: Number of bytes or a negative error code
+ * @return: Zero or a negative error code
+ *
+ * Only files which were not given their own device may be selected.
+ * The file position is reset to zero.
  */
-static ssize_t lights_leds_attribute_write (
+static long lights_node_ioctl (
     struct file *filp,
-    const char __user *buf,
-    size_t len,
-    loff_t *off
+    unsigned int cmd,
+    unsigned long arg
 ){
-    struct lights_file const *file;
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_LEDS
-    };
-    struct lights_buffer *buffer = &state.raw;
-    struct lights_color *color;
-    uint8_t kern_buf[3];
-    uint16_t led_count;
-    ssize_t err;
-    int i;
+    struct lights_file *file = filp->private_data;
+    struct lights_file *iter, *found = NULL;
+    char name[LIGHTS_MAX_FILENAME_LENGTH];
 
-    file = find_attribute_for_file(filp);
     if (!file)
         return -ENODEV;
 
-    if (!file->attr.write) {
-        err = -ENODEV;
-        goto exit;
-    }
-
-    /* The buffer must account for every led */
-    led_count = file->intf->ldev->led_count;
-    if (!led_count || led_count * 3 != len) {
-        err = -EINVAL;
-        goto exit;
-    }
+    if (cmd != LIGHTS_IOCTL_SELECT)
+        return -ENOTTY;
 
-    if (!file->intf->led_buffer) {
-        file->intf->led_buffer = kcalloc(led_count, sizeof(struct lights_color), GFP_KERNEL);
-        if (!file->intf->led_buffer) {
-            err = -ENOMEM;
-            goto exit;
-        }
-    }
+    if (0 != copy_from_user(name, (const char __user *)arg, sizeof(name)))
+        return -EFAULT;
 
-    buffer->offset = *off;
-    buffer->length = led_count;
-    buffer->data   = file->intf->led_buffer;
+    name[sizeof(name) - 1] = 0;
 
-    color = file->intf->led_buffer;
+    /* Files are only freed with the interface, which the node holds */
+    spin_lock(&file->intf->file_lock);
 
-    for (i = 0; i < led_count; i++) {
-        err = copy_from_user(kern_buf, buf, 3);
-        if (err) {
-            err = -EIO;
-            goto exit;
+    list_for_each_entry(iter, &file->intf->file_list, siblings) {
+        if (0 == strcmp(iter->attr.attr.name, name)) {
+            found = iter;
+            break;
         }
+    }
 
-        lights_color_read_rgb(color, kern_buf);
+    spin_unlock(&file->intf->file_lock);
 
-        color++;
-        buf += 3;
-    }
+    if (!found && 0 == strcmp(name, LIGHTS_IO_UPDATE))
+        found = &file->intf->update;
 
-    err = file->attr.write(file->attr.thunk, &state);
+    if (!found)
+        return -ENOENT;
 
-exit:
-    kref_put(&file->intf->refs, lights_interface_put);
+    if (found->dev)
+        return -EBUSY;
 
-    return err ? err : buffer->length;
+    WRITE_ONCE(filp->private_data, found);
+    filp->f_pos = 0;
+
+    return 0;
 }
 
 /**
- * lights_color_attribute_read() - File IO handler
+ * lights_node_read() - File IO handler
  *
  * @filp: Character device handle
- * @buf:  Source buffer
+ * @buf:  User buffer
  * @len:  Length of @buf
- * @off:  Offset to begin writing
+ * @off:  File position
  *
  * @return: Number of bytes or a negative error code
  */
-static ssize_t lights_sync_attribute_write (
+static ssize_t lights_node_read (
     struct file *filp,
-    const char __user *buf,
+    char __user *buf,
     size_t len,
     loff_t *off
 ){
-    struct lights_state state = {
-        .type = LIGHTS_TYPE_SYNC
-    };
-    ssize_t err;
+    struct lights_file *file = READ_ONCE(filp->private_data);
 
-    err = lights_read_sync(buf, len, &state.sync);
-    if (err < 0)
-        return err;
+    if (!file)
+        return -ENODEV;
 
-    err = lights_attribute_write(filp, &state);
-    if (err)
-        return err;
+    if (!file->fops->read)
+        return -EINVAL;
 
-    return len;
+    return file->fops->read(filp, buf, len, off);
 }
 
 /**
- * lights_update_attribute_write() - File IO handler
+ * lights_node_write() - File IO handler
  *
  * @filp: Character device handle
- * @buf:  Source buffer
+ * @buf:  User buffer
  * @len:  Length of @buf
- * @off:  Offset to begin writing
+ * @off:  File position
  *
  * @return: Number of bytes or a negative error code
- *
- * This is a special function which allows another process to
- * pass in a struct lights_state. This should enable a service
- * to update multiple properties in a single call.
  */
-static ssize_t lights_update_attribute_write (
+static ssize_t lights_node_write (
     struct file *filp,
     const char __user *buf,
     size_t len,
     loff_t *off
 ){
-    struct lights_file const *file;
-    enum lights_state_type allowed = (
-        LIGHTS_TYPE_EFFECT | LIGHTS_TYPE_COLOR | LIGHTS_TYPE_SPEED | LIGHTS_TYPE_DIRECTION | LIGHTS_TYPE_SYNC
-    );
-    struct lights_state state;
-    error_t err;
-
-    if (len != sizeof(state)) {
-        LIGHTS_ERR("Unexpected 'update' length: %ld", len);
-        return -EINVAL;
-    }
+    struct lights_file *file = READ_ONCE(filp->private_data);
 
-    if (0 != copy_from_user(&state, buf, len)) {
-        LIGHTS_ERR("Failed to copy user buffer");
-        return -EIO;
-    }
+    if (!file)
+        return -ENODEV;
 
-    if ((state.type & ~allowed) != 0) {
-        LIGHTS_ERR("state.type contains unsupported flags");
+    if (!file->fops->write)
         return -EINVAL;
-    }
-
-    /* Trying to sneak in a pointer??? */
-    memset(&state.raw, 0, sizeof(state.raw));
 
-    file = find_attribute_for_file(filp);
-    if (!file)
-        return -ENODEV;
+    return file->fops->write(filp, buf, len, off);
+}
 
-    /* Fix effect name */
-    if (state.type & LIGHTS_TYPE_EFFECT) {
-        if (!state.effect.name || state.effect.id > LIGHTS_EFFECT_MAX_NAME_LENGTH) {
-            LIGHTS_ERR("userland buffer error");
-            err = -EINVAL;
-            goto exit;
-        }
+/**
+ * lights_node_poll() - File IO handler
+ *
+ * @filp: Character device handle
+ * @wait: Poll table
+ *
+ * @return: Mask of ready events
+ */
+static __poll_t lights_node_poll (
+    struct file *filp,
+    struct poll_table_struct *wait
+){
+    struct lights_file *file = READ_ONCE(filp->private_data);
 
-        err = lights_find_effect(file->intf, &state.effect, state.effect.name, state.effect.id);
-        if (err)
-            goto exit;
-    }
+    if (!file || !file->fops->poll)
+        return EPOLLERR | EPOLLHUP;
 
-    if (state.type & LIGHTS_TYPE_SPEED) {
-        if (state.speed > 5) {
-            LIGHTS_ERR("Invalid speed value: 0x%02x", state.speed);
-            err = -EINVAL;
-            goto exit;
-        }
-    }
+    return file->fops->poll(filp, wait);
+}
 
-    if (state.type & LIGHTS_TYPE_DIRECTION) {
-        if (state.direction > 1) {
-            LIGHTS_ERR("Invalid direction value: 0x%02x", state.direction);
-            err = -EINVAL;
-            goto exit;
-        }
-    }
+/**
+ * lights_node_fsync() - File IO handler
+ *
+ * @filp:     Character device handle
+ * @start:    Start of the range
+ * @end:      End of the range
+ * @datasync: Only flush data
+ *
+ * @return: Zero or a negative error code
+ */
+static int lights_node_fsync (
+    struct file *filp,
+    loff_t start,
+    loff_t end,
+    int datasync
+){
+    struct lights_file *file = READ_ONCE(filp->private_data);
 
-    if (file->attr.write)
-        err = file->attr.write(file->attr.thunk, &state);
-    else
-        err = -ENODEV;
+    if (!file)
+        return -ENODEV;
 
-exit:
-    kref_put(&file->intf->refs, lights_interface_put);
+    if (!file->fops->fsync)
+        return 0;
 
-    return -ENODEV;
+    return file->fops->fsync(filp, start, end, datasync);
 }
 
-
-static inline error_t lights_minor_get (
-    unsigned long *minor
+/**
+ * lights_node_mmap() - File IO handler
+ *
+ * @filp: Character device handle
+ * @vma:  Mapping to populate
+ *
+ * @return: Error code
+ */
+static int lights_node_mmap (
+    struct file *filp,
+    struct vm_area_struct *vma
 ){
-    error_t err = 0;
+    struct lights_file *file = READ_ONCE(filp->private_data);
 
-    spin_lock(&lights_global.minor_lock);
-
-    *minor = find_first_zero_bit(lights_global.minor_map, LIGHTS_MAX_MINORS);
-    if (*minor < LIGHTS_MAX_MINORS)
-        set_bit(*minor, lights_global.minor_map);
-    else
-        err = -EBUSY;
+    if (!file)
+        return -ENODEV;
 
-    spin_unlock(&lights_global.minor_lock);
+    if (!file->fops->mmap)
+        return -ENODEV;
 
-    return err;
+    return file->fops->mmap(filp, vma);
 }
 
-static inline error_t lights_minor_put (
-    unsigned long minor
+static const struct file_operations lights_node_fops = {
+    .owner          = THIS_MODULE,
+    .open           = lights_node_open,
+    .release        = lights_attribute_release,
+    .read           = lights_node_read,
+    .write          = lights_node_write,
+    .poll           = lights_node_poll,
+    .fsync          = lights_node_fsync,
+    .mmap           = lights_node_mmap,
+    .unlocked_ioctl = lights_node_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+};
+
+/**
+ * lights_node_add() - Creates the single character device of a zone
+ *
+ * @intf: Interface being created, its kdev initialized but not added
+ *
+ * @return: Error code
+ *
+ * The node is the kdev of the interface itself, so a zone costs one
+ * cdev and minor no matter how many files it has. On failure the kdev
+ * is left without a devt, and each file gets its own device.
+ */
+static error_t lights_node_add (
+    struct lights_interface *intf
 ){
-    error_t err = 0;
+    unsigned long minor;
+    error_t err;
 
-    spin_lock(&lights_global.minor_lock);
+    err = lights_minor_get(&minor);
+    if (err) {
+        LIGHTS_ERR("Failed to allocate minor number");
+        return err;
+    }
 
-    if (minor < LIGHTS_MAX_MINORS)
-        clear_bit(minor, lights_global.minor_map);
-    else
-        err = -EINVAL;
+    intf->node = cdev_alloc();
+    if (!intf->node) {
+        lights_minor_put(minor);
+        return -ENOMEM;
+    }
+
+    intf->node->ops   = &lights_node_fops;
+    intf->node->owner = THIS_MODULE;
+    intf->kdev.devt = MKDEV(lights_global.major, minor);
 
-    spin_unlock(&lights_global.minor_lock);
+    err = cdev_device_add(intf->node, &intf->kdev);
+    if (err) {
+        kobject_put(&intf->node->kobj);
+        intf->node = NULL;
+        intf->kdev.devt = 0;
+        lights_minor_put(minor);
+    }
 
     return err;
 }
 
 /**
- * lights_device_release() - Dummy function
+ * lights_device_release() - Releases the reference held by the kdev
  *
- * @dev: Unused
+ * @dev: Kernel device of an interface
+ *
+ * Sysfs may still hold the device after it has been unregistered,
+ * so the interface memory must outlive it.
  */
 static void lights_device_release (
     struct device *dev
 ){
-    /* Nothing to do here */
+    struct lights_interface *intf = interface_from_dev(dev);
+
+    kref_put(&intf->refs, lights_interface_put);
+}
+
+/*
+ * The file operations are never freed. An open file still uses them
+ * after its release, long after the interface may have been freed.
+ */
+#define LIGHTS_FOPS(_read, _write) { \
+    .owner   = THIS_MODULE, \
+    .open    = lights_attribute_open, \
+    .release = lights_attribute_release, \
+    .poll    = lights_attribute_poll, \
+    .fsync   = lights_attribute_fsync, \
+    .read    = _read, \
+    .write   = _write, \
 }
 
+/* Indexed by the presence of a write method */
+static struct file_operations const lights_effect_fops[] = {
+    LIGHTS_FOPS(lights_effect_attribute_read, NULL),
+    LIGHTS_FOPS(lights_effect_attribute_read, lights_effect_attribute_write),
+};
+static struct file_operations const lights_color_fops[] = {
+    LIGHTS_FOPS(lights_color_attribute_read, NULL),
+    LIGHTS_FOPS(lights_color_attribute_read, lights_color_attribute_write),
+};
+static struct file_operations const lights_speed_fops[] = {
+    LIGHTS_FOPS(lights_speed_attribute_read, NULL),
+    LIGHTS_FOPS(lights_speed_attribute_read, lights_speed_attribute_write),
+};
+static struct file_operations const lights_direction_fops[] = {
+    LIGHTS_FOPS(lights_direction_attribute_read, NULL),
+    LIGHTS_FOPS(lights_direction_attribute_read, lights_direction_attribute_write),
+};
+static struct file_operations const lights_raw_fops[] = {
+    LIGHTS_FOPS(lights_raw_attribute_read, NULL),
+    LIGHTS_FOPS(lights_raw_attribute_read, lights_raw_attribute_write),
+};
+
+static struct file_operations const lights_leds_fops   = LIGHTS_FOPS(NULL, lights_leds_attribute_write);
+static struct file_operations const lights_update_fops = LIGHTS_FOPS(NULL, lights_update_attribute_write);
+static struct file_operations const lights_sync_fops   = LIGHTS_FOPS(NULL, lights_sync_attribute_write);
+
+static struct file_operations const lights_ring_fops = {
+    .owner   = THIS_MODULE,
+    .open    = lights_attribute_open,
+    .release = lights_attribute_release,
+    .poll    = lights_attribute_poll,
+    .write   = lights_ring_write,
+    .mmap    = lights_ring_mmap,
+};
+
+static struct file_operations const lights_frame_fops = {
+    .owner      = THIS_MODULE,
+    .open       = lights_attribute_open,
+    .release    = lights_attribute_release,
+    .poll       = lights_attribute_poll,
+    .write_iter = lights_frame_attribute_write_iter,
+};
+
+static struct file_operations const lights_transaction_fops = {
+    .owner   = THIS_MODULE,
+    .open    = lights_transaction_open,
+    .release = lights_transaction_release,
+    .write   = lights_transaction_write,
+    .fsync   = lights_transaction_fsync,
+};
+
 /**
- * file_operations_create() - Builds read/write functions for attributes
+ * file_operations_create() - Selects the read/write functions for attributes
  *
- * @file: Target, contains the file_operations struct
+ * @file: Target, receives the file_operations
  * @attr: Attributes for the file
  *
  * @return: Zero or a negative error number
@@ -1727,8 +4897,6 @@ static error_t file_operations_create (
     struct lights_file *file,
     struct lights_attribute const *attr
 ){
-    memset(&file->fops, 0, sizeof(file->fops));
-
     /*
         The fops structure contains local red/write methods. Each of these
         methods will retrieve the lights_file, associated with the cdev,
@@ -1737,58 +4905,73 @@ static error_t file_operations_create (
      */
     switch (attr->type) {
         case LIGHTS_TYPE_EFFECT:
-            file->fops.read = lights_effect_attribute_read;
-            if (attr->write)
-                file->fops.write = lights_effect_attribute_write;
+            file->fops = &lights_effect_fops[!!attr->write];
             break;
         case LIGHTS_TYPE_COLOR:
-            file->fops.read = lights_color_attribute_read;
-            if (attr->write)
-                file->fops.write = lights_color_attribute_write;
+            file->fops = &lights_color_fops[!!attr->write];
             break;
         case LIGHTS_TYPE_SPEED:
-            file->fops.read = lights_speed_attribute_read;
-            if (attr->write)
-                file->fops.write = lights_speed_attribute_write;
+            file->fops = &lights_speed_fops[!!attr->write];
             break;
         case LIGHTS_TYPE_DIRECTION:
-            file->fops.read = lights_direction_attribute_read;
-            if (attr->write)
-                file->fops.write = lights_direction_attribute_write;
+            file->fops = &lights_direction_fops[!!attr->write];
             break;
         case LIGHTS_TYPE_CUSTOM:
-            file->fops.read = lights_raw_attribute_read;
-            if (attr->write)
-                file->fops.write = lights_raw_attribute_write;
+            file->fops = &lights_raw_fops[!!attr->write];
             break;
         case LIGHTS_TYPE_LEDS:
+            /* The ring file is consumed into the leds file of the zone */
+            if (0 == strcmp(attr->attr.name, LIGHTS_IO_RING)) {
+                if (attr->read || attr->write) {
+                    LIGHTS_ERR("LIGHTS_IO_RING is handled internally");
+                    return -EINVAL;
+                }
+                file->fops = &lights_ring_fops;
+                break;
+            }
+            /* The frame file forwards to the leds file of each zone */
+            if (0 == strcmp(attr->attr.name, LIGHTS_IO_FRAME)) {
+                if (attr->read || attr->write) {
+                    LIGHTS_ERR("LIGHTS_IO_FRAME is handled internally");
+                    return -EINVAL;
+                }
+                file->fops = &lights_frame_fops;
+                break;
+            }
             if (!attr->write || attr->read) {
                 LIGHTS_ERR("LIGHTS_TYPE_LEDS is write only");
                 return -EINVAL;
             }
-            file->fops.write = lights_leds_attribute_write;
+            file->fops = &lights_leds_fops;
             break;
         case LIGHTS_TYPE_UPDATE:
+            /* Each open transaction file has its own private data */
+            if (0 == strcmp(attr->attr.name, LIGHTS_IO_TRANSACTION)) {
+                if (attr->read || attr->write) {
+                    LIGHTS_ERR("LIGHTS_IO_TRANSACTION is handled internally");
+                    return -EINVAL;
+                }
+                file->fops = &lights_transaction_fops;
+                break;
+            }
             if (!attr->write || attr->read) {
                 LIGHTS_ERR("LIGHTS_TYPE_UPDATE is write only");
                 return -EINVAL;
             }
-            file->fops.write = lights_update_attribute_write;
+            file->fops = &lights_update_fops;
             break;
         case LIGHTS_TYPE_SYNC:
             if (!attr->write || attr->read) {
                 LIGHTS_ERR("LIGHTS_TYPE_SYNC is write only");
                 return -EINVAL;
             }
-            file->fops.write = lights_sync_attribute_write;
+            file->fops = &lights_sync_fops;
             break;
         default:
             return -EINVAL;
     }
 
-    file->fops.owner = attr->owner;
     file->attr = *attr;
-    // memcpy((void*)&file->attr, attr, sizeof(file->attr));
 
     return 0;
 }
@@ -1861,27 +5044,52 @@ static error_t lights_file_init (
     if (IS_NULL(file, attr, intf, attr->attr.name) || IS_TRUE(attr->attr.name[0] == 0))
         return -EINVAL;
 
-    err = lights_minor_get(&file->minor);
-    if (err) {
-        LIGHTS_ERR("Failed to allocate minor number");
-        goto error_exit;
-    }
-
     err = file_operations_create(file, attr);
     if (err) {
         LIGHTS_ERR("Failed to create file operations: %s", ERR_NAME(err));
-        goto error_exit;
+        return err;
     }
 
     file->intf = intf;
+    mutex_init(&file->raw_lock);
+
+    if (attr->type == LIGHTS_TYPE_CUSTOM) {
+        file->raw = kmalloc(LIGHTS_RAW_MAX, GFP_KERNEL);
+        if (!file->raw)
+            return -ENOMEM;
+    }
+
+    /* Files with per open state, or vectored writes, keep their own device */
+    if (intf->kdev.devt && file->fops->open == lights_attribute_open && !file->fops->write_iter) {
+        LIGHTS_DBG("multiplexed '/dev/lights/%s/%s'", intf->name, attr->attr.name);
+        return 0;
+    }
+
+    err = lights_minor_get(&file->minor);
+    if (err) {
+        LIGHTS_ERR("Failed to allocate minor number");
+        goto error_free_raw;
+    }
+
     ver = MKDEV(lights_global.major, file->minor);
 
-    /* Create a character device with a unique major:minor */
-    cdev_init(&file->cdev, &file->fops);
-    file->cdev.owner = attr->owner;
-    err = cdev_add(&file->cdev, ver, 1);
+    /*
+     * Create a character device with a unique major:minor. It is
+     * reference counted by the open files, which use it after release.
+     */
+    file->cdev = cdev_alloc();
+    if (!file->cdev) {
+        err = -ENOMEM;
+        goto error_exit;
+    }
+
+    file->cdev->ops   = file->fops;
+    file->cdev->owner = attr->owner;
+    err = cdev_add(file->cdev, ver, 1);
     if (err) {
         LIGHTS_ERR("Failed to add character device: %s", ERR_NAME(err));
+        kobject_put(&file->cdev->kobj);
+        file->cdev = NULL;
         goto error_exit;
     }
 
@@ -1911,11 +5119,17 @@ static error_t lights_file_init (
     return 0;
 
 error_free_cdev:
-    cdev_del(&file->cdev);
+    cdev_del(file->cdev);
+    file->cdev = NULL;
+    file->dev = NULL;
 
 error_exit:
     lights_minor_put(file->minor);
 
+error_free_raw:
+    kfree(file->raw);
+    file->raw = NULL;
+
     return err;
 }
 
@@ -1963,6 +5177,30 @@ static struct lights_file *lights_file_create (
     return ERR_PTR(err);
 }
 
+/**
+ * lights_file_remove() - Removes the character device of a file
+ *
+ * @file: Wrapper whose device is removed
+ *
+ * Files already open keep working on the wrapper, which is
+ * only freed along with its interface.
+ */
+static void lights_file_remove (
+    struct lights_file *file
+){
+    if (!file->dev)
+        return;
+
+    device_destroy(lights_global.class, MKDEV(lights_global.major, file->minor));
+    cdev_del(file->cdev);
+    lights_minor_put(file->minor);
+
+    file->dev  = NULL;
+    file->cdev = NULL;
+
+    LIGHTS_DBG("removed device '/dev/lights/%s/%s'", file->intf->name, file->attr.attr.name);
+}
+
 /**
  * lights_file_destroy() - Destroys a character device
  *
@@ -1974,11 +5212,9 @@ static void lights_file_destroy (
     if (IS_NULL(file))
         return;
 
-    device_destroy(lights_global.class, MKDEV(lights_global.major, file->minor));
-    cdev_del(&file->cdev);
-    lights_minor_put(file->minor);
+    lights_file_remove(file);
 
-    LIGHTS_DBG("removed device '/dev/lights/%s/%s'", file->intf->name, file->attr.attr.name);
+    kfree(file->raw);
 
     if (file == &file->intf->update)
         memset(file, 0, sizeof(*file));
@@ -2020,13 +5256,49 @@ found:
     return interface;
 }
 
+/**
+ * lights_interface_teardown() - Removes the devices of an interface
+ *
+ * @intf: Interface to tear down
+ *
+ * Every character device, and the kdev, is removed. Nothing of the
+ * lights_dev is touched once this returns, open files only keep the
+ * memory of the interface alive.
+ */
+static void lights_interface_teardown (
+    struct lights_interface *intf
+){
+    struct lights_file *file;
+
+    list_for_each_entry(file, &intf->file_list, siblings)
+        lights_file_remove(file);
+
+    /* Possible when owner didn't create an update attr */
+    if (intf->update.siblings.next == 0)
+        lights_file_remove(&intf->update);
+
+    if (intf->node) {
+        cdev_device_del(intf->node, &intf->kdev);
+        lights_minor_put(MINOR(intf->kdev.devt));
+        intf->node = NULL;
+    } else if (device_is_registered(&intf->kdev)) {
+        device_del(&intf->kdev);
+    }
+
+    /* Drops the reference of the kdev once sysfs is done with it */
+    put_device(&intf->kdev);
+
+    LIGHTS_DBG("removed interface '%s'", intf->name);
+}
+
 /**
  * lights_interface_destroy() - Destroys an interface
  *
  * @intf: Interface to destroy
  *
- * The interface is expected to have been removed from any list
- * and have no open references.
+ * The interface is expected to have been torn down and have no open
+ * references. Only memory is released, so the last reference may be
+ * dropped from any context.
  */
 static void lights_interface_destroy (
     struct lights_interface *intf
@@ -2040,22 +5312,78 @@ static void lights_interface_destroy (
     if (intf->update.siblings.next == 0)
         list_add_tail(&intf->update.siblings, &intf->file_list);
 
-    if (!list_empty(&intf->file_list)) {
-        list_for_each_entry_safe(file, safe, &intf->file_list, siblings) {
-            list_del(&file->siblings);
-            lights_file_destroy(file);
+    list_for_each_entry_safe(file, safe, &intf->file_list, siblings) {
+        list_del(&file->siblings);
+        lights_file_destroy(file);
+    }
+
+    vfree(intf->ring.header);
+    kfree(intf->ring.frame);
+    kfree(intf->caps_text);
+    kfree(intf->effect_nodes);
+    kfree(intf->led_buffer);
+    kfree(intf->pace.frame);
+
+    if (intf->owner)
+        kref_put(&intf->owner->refs, lights_group_put);
+
+    /* Drivers may still be looking up the interface, see lights_device_get_interface() */
+    kfree_rcu(intf, rcu);
+}
+
+/**
+ * lights_interface_index_caps() - Indexes and renders the caps of a device
+ *
+ * @intf: Interface being created
+ * @caps: Zero terminated array of effects
+ *
+ * @return: Error code
+ *
+ * The caps of a device never change, so the text of the caps file
+ * is rendered once. Software effects are only offered by zones with
+ * leds, and by groups which forward them to their members.
+ */
+static error_t lights_interface_index_caps (
+    struct lights_interface *intf,
+    struct lights_effect const *caps
+){
+    struct lights_effect const *iter;
+    size_t count = 0, i;
+    ssize_t len;
+    char *buf;
+
+    for (iter = caps; iter->id != LIGHTS_EFFECT_ID_INVALID; iter++)
+        count++;
+
+    if (count) {
+        intf->effect_nodes = kcalloc(count, sizeof(*intf->effect_nodes), GFP_KERNEL);
+        if (!intf->effect_nodes)
+            return -ENOMEM;
+
+        for (i = 0; i < count; i++) {
+            intf->effect_nodes[i].effect = &caps[i];
+            hash_add(intf->effects, &intf->effect_nodes[i].by_name, lights_effect_hash(caps[i].name));
         }
     }
 
-    if (intf->ldev->caps)
-        lights_remove_caps(intf->ldev->caps);
+    buf = (char*)__get_free_page(GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
 
-    device_unregister(&intf->kdev);
+    intf->caps_len = lights_dump_effects(caps, buf, PAGE_SIZE);
+    if (intf->caps_len >= 0 && (intf->led_count || intf->group)) {
+        len = lights_dump_effects(lights_renderer_effects(), buf + intf->caps_len, PAGE_SIZE - intf->caps_len);
+        intf->caps_len = len < 0 ? len : intf->caps_len + len;
+    }
+    if (intf->caps_len > 0) {
+        intf->caps_text = kmemdup(buf, intf->caps_len, GFP_KERNEL);
+        if (!intf->caps_text)
+            intf->caps_len = -ENOMEM;
+    }
 
-    LIGHTS_DBG("removed interface '%s'", intf->name);
+    free_page((unsigned long)buf);
 
-    kfree(intf->led_buffer);
-    kfree(intf);
+    return 0;
 }
 
 /**
@@ -2081,20 +5409,89 @@ static struct lights_interface *lights_interface_create (
         return ERR_PTR(-ENOMEM);
 
     intf->ldev = lights;
+    intf->led_count = lights->led_count;
+    intf->group = lights->group;
     intf->id = atomic_fetch_inc(&lights_global.next_id);
 
     lights_thunk_init(&intf->thunk, INTERFACE_MAGIC);
     spin_lock_init(&intf->file_lock);
     INIT_LIST_HEAD(&intf->file_list);
+    init_waitqueue_head(&intf->wait);
+    seqlock_init(&intf->record_lock);
+    spin_lock_init(&intf->combine_lock);
+    hrtimer_init(&intf->combine_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    intf->combine_timer.function = lights_combine_timeout;
+    INIT_WORK(&intf->combine_work, lights_combine_work);
+    spin_lock_init(&intf->pace.lock);
+    hrtimer_init(&intf->pace.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    intf->pace.timer.function = lights_pace_timeout;
+    INIT_WORK(&intf->pace.work, lights_pace_work);
+    atomic_set(&intf->submitted, 0);
+    atomic_set(&intf->completed, 0);
+    atomic_set(&intf->dropped, 0);
     kref_init(&intf->refs);
+    hash_init(intf->effects);
+
+    intf->renderer.thunk       = &intf->thunk;
+    intf->renderer.push        = lights_interface_render;
+    intf->renderer.color.value = 0xFFFFFF;
+    intf->renderer.speed       = 2;
+
+    mutex_init(&intf->ring.lock);
+    INIT_WORK(&intf->ring.work, lights_ring_work);
+    atomic_set(&intf->ring.waiting, 0);
     strncpy(intf->name, lights->name, LIGHTS_MAX_FILENAME_LENGTH);
 
+    if (lights->caps) {
+        err = lights_interface_index_caps(intf, lights->caps);
+        if (err) {
+            kfree(intf->effect_nodes);
+            kfree(intf);
+            return ERR_PTR(err);
+        }
+    }
+
+    /* Led writes are decoded into this, never into a new allocation */
+    if (lights->led_count) {
+        intf->led_buffer = kcalloc(lights->led_count, sizeof(*intf->led_buffer), GFP_KERNEL);
+        intf->pace.frame = kcalloc(lights->led_count * 2, sizeof(*intf->pace.frame), GFP_KERNEL);
+        if (!intf->led_buffer || !intf->pace.frame) {
+            kfree(intf->pace.frame);
+            kfree(intf->led_buffer);
+            kfree(intf->caps_text);
+            kfree(intf->effect_nodes);
+            kfree(intf);
+            return ERR_PTR(-ENOMEM);
+        }
+    }
+
+    /* A group must outlive every open file of its interface */
+    if (lights->group) {
+        intf->owner = container_of(lights, struct lights_group, ldev);
+        kref_get(&intf->owner->refs);
+    }
+
     dev_set_name(&intf->kdev, intf->name);
     intf->kdev.class = lights_global.class;
     intf->kdev.release = lights_device_release;
     intf->kdev.groups = lights_class_groups;
 
-    device_register(&intf->kdev);
+    device_initialize(&intf->kdev);
+    kref_get(&intf->refs);
+
+    if (single_node) {
+        err = lights_node_add(intf);
+        if (err)
+            LIGHTS_WARN("Failed to create '%s' node: %s", intf->name, ERR_NAME(err));
+    }
+
+    if (!intf->kdev.devt) {
+        err = device_add(&intf->kdev);
+        if (err) {
+            LIGHTS_ERR("Failed to add device '%s': %s", intf->name, ERR_NAME(err));
+            goto error;
+        }
+    }
 
     /* Register the only default attribute */
     err = lights_file_init(
@@ -2121,12 +5518,27 @@ static struct lights_interface *lights_interface_create (
         }
     }
 
+    /* Any zone accepting leds may also be fed through a ring */
+    if (lights->led_count && (file = find_attribute_for_type(intf, LIGHTS_TYPE_LEDS))) {
+        kref_put(&intf->refs, lights_interface_put);
+
+        file = lights_file_create(intf, &LIGHTS_ATTR(LIGHTS_IO_RING, 0600, LIGHTS_TYPE_LEDS, NULL, NULL, NULL));
+        if (IS_ERR(file)) {
+            err = PTR_ERR(file);
+            LIGHTS_ERR("Failed to create ring: %s", ERR_NAME(err));
+            goto error;
+        }
+
+        list_add_tail(&file->siblings, &intf->file_list);
+    }
+
     LIGHTS_DBG("created interface '%s' with id '%d'", intf->name, intf->id);
 
     return intf;
 
 error:
-    lights_interface_destroy(intf);
+    lights_interface_teardown(intf);
+    kref_put(&intf->refs, lights_interface_put);
 
     return ERR_PTR(err);
 }
@@ -2153,7 +5565,8 @@ error_t lights_device_register (
         return err;
     }
 
-    if (lights->caps) {
+    /* The effects of a group are not counted towards the shared caps */
+    if (lights->caps && !lights->group) {
         err = lights_append_caps(lights->caps);
         if (err)
             goto error;
@@ -2165,24 +5578,86 @@ error_t lights_device_register (
         if (strcmp(iter->name, intf->name) == 0) {
             spin_unlock(&lights_global.interface.lock);
             err = -EEXIST;
-            goto error;
+            goto error_caps;
         }
     }
 
     list_add_tail(&intf->siblings, &lights_global.interface.list);
     lights_global.interface.count++;
+    smp_store_release(&lights->intf, intf);
 
     spin_unlock(&lights_global.interface.lock);
 
+    lights_invalidate_caps();
+    lights_group_attach(intf);
+
     return 0;
 
+error_caps:
+    if (lights->caps && !lights->group)
+        lights_remove_caps(lights->caps);
+
 error:
-    lights_interface_destroy(intf);
+    lights_interface_teardown(intf);
+    kref_put(&intf->refs, lights_interface_put);
 
     return err;
 }
 EXPORT_SYMBOL_NS_GPL(lights_device_register, LIGHTS);
 
+/**
+ * lights_interface_remove() - Unlists and tears down an interface
+ *
+ * @intf: Listed interface, the caller holding a reference
+ *
+ * Once returned, the lights_dev of the interface may be freed. The
+ * memory of the interface lives on until the last open file closes.
+ */
+static void lights_interface_remove (
+    struct lights_interface *intf
+){
+    struct lights_dev *lights = intf->ldev;
+
+    spin_lock(&lights_global.interface.lock);
+
+    list_del(&intf->siblings);
+    lights_global.interface.count--;
+    WRITE_ONCE(lights->intf, NULL);
+
+    spin_unlock(&lights_global.interface.lock);
+
+    lights_invalidate_caps();
+    lights_group_detach(intf);
+
+    if (lights->caps && !lights->group)
+        lights_remove_caps(lights->caps);
+
+    /* Nothing may be pushed to a departing device */
+    lights_renderer_stop(&intf->renderer);
+    lights_combine_cancel(intf);
+
+    mutex_lock(&intf->ring.lock);
+    intf->ring.closed = true;
+    mutex_unlock(&intf->ring.lock);
+    cancel_work_sync(&intf->ring.work);
+
+    spin_lock(&intf->pace.lock);
+    intf->pace.closed = true;
+    intf->pace.file = NULL;
+    spin_unlock(&intf->pace.lock);
+    hrtimer_cancel(&intf->pace.timer);
+    cancel_work_sync(&intf->pace.work);
+
+    lights_interface_teardown(intf);
+    WRITE_ONCE(intf->ldev, NULL);
+
+    /* Release any pollers, nothing more will complete */
+    wake_up_interruptible_all(&intf->wait);
+
+    /* Remove the ref held by the list */
+    kref_put(&intf->refs, lights_interface_put);
+}
+
 /**
  * lights_device_unregister() - Removes a device
  *
@@ -2202,19 +5677,125 @@ void lights_device_unregister (
         return;
     }
 
-    spin_lock(&lights_global.interface.lock);
+    lights_interface_remove(intf);
 
-    list_del(&intf->siblings);
-    /* Remove the ref held by the list */
+    /* Remove the ref created by lights_interface_find() */
     kref_put(&intf->refs, lights_interface_put);
-    lights_global.interface.count--;
+}
+EXPORT_SYMBOL_NS_GPL(lights_device_unregister, LIGHTS);
 
-    spin_unlock(&lights_global.interface.lock);
+/**
+ * lights_device_get_interface() - Fetches the interface of a device
+ *
+ * @dev: A device previously registered with lights_device_register()
+ *
+ * @return: NULL or a reference counted interface
+ *
+ * Unlike lights_interface_find(), the list is not searched. This is
+ * intended for the hot paths invoked by drivers, which may be running
+ * in interrupt context, so no lock is taken. The memory of an
+ * interface is only freed after an RCU grace period.
+ */
+static struct lights_interface *lights_device_get_interface (
+    struct lights_dev const *dev
+){
+    struct lights_interface *intf;
+
+    rcu_read_lock();
+
+    intf = READ_ONCE(dev->intf);
+    if (intf && !kref_get_unless_zero(&intf->refs))
+        intf = NULL;
+
+    rcu_read_unlock();
+
+    return intf;
+}
+
+/**
+ * lights_device_submit() - Records an update queued by the driver
+ *
+ * @dev: A device previously registered with lights_device_register()
+ */
+void lights_device_submit (
+    struct lights_dev const *dev
+){
+    struct lights_interface *intf;
+    unsigned long flags;
+    unsigned int index;
+
+    if (IS_NULL(dev))
+        return;
+
+    intf = lights_device_get_interface(dev);
+    if (!intf)
+        return;
+
+    /* Updates complete in order, the count of each selects its time */
+    index = atomic_inc_return(&intf->submitted) - 1;
+    WRITE_ONCE(intf->submit_times[index % LIGHTS_SUBMIT_HISTORY], ktime_get());
+
+    write_seqlock_irqsave(&intf->record_lock, flags);
+    intf->inflight = intf->pending;
+    intf->inflight_gen = intf->pending_gen;
+    write_sequnlock_irqrestore(&intf->record_lock, flags);
 
-    /* Remove the ref created by lights_interface_find() */
     kref_put(&intf->refs, lights_interface_put);
 }
-EXPORT_SYMBOL_NS_GPL(lights_device_unregister, LIGHTS);
+EXPORT_SYMBOL_NS_GPL(lights_device_submit, LIGHTS);
+
+/**
+ * lights_device_complete() - Records the completion of a queued update
+ *
+ * @dev:   A device previously registered with lights_device_register()
+ * @error: Result of the transfer
+ */
+void lights_device_complete (
+    struct lights_dev const *dev,
+    error_t error
+){
+    struct lights_interface *intf;
+    uint64_t elapsed, average;
+    unsigned long flags;
+    unsigned int index;
+
+    if (IS_NULL(dev))
+        return;
+
+    intf = lights_device_get_interface(dev);
+    if (!intf)
+        return;
+
+    WRITE_ONCE(intf->error, error);
+
+    index = atomic_inc_return(&intf->completed) - 1;
+
+    /* Each update is measured from its own submit, unless it was overwritten */
+    if ((unsigned int)atomic_read(&intf->submitted) - index <= LIGHTS_SUBMIT_HISTORY) {
+        elapsed = ktime_to_ns(ktime_sub(ktime_get(), READ_ONCE(intf->submit_times[index % LIGHTS_SUBMIT_HISTORY])));
+        average = READ_ONCE(intf->update_ns);
+
+        /* Moving average, each update has a weight of 1/8 */
+        WRITE_ONCE(intf->update_ns, average ? average - (average >> 3) + (elapsed >> 3) : elapsed);
+    }
+
+    if (index + 1 == (unsigned int)atomic_read(&intf->submitted)) {
+        if (!error) {
+            write_seqlock_irqsave(&intf->record_lock, flags);
+            if (intf->applied_gen < intf->inflight_gen) {
+                intf->applied = intf->inflight;
+                intf->applied_gen = intf->inflight_gen;
+            }
+            write_sequnlock_irqrestore(&intf->record_lock, flags);
+        }
+
+        wake_up_interruptible_all(&intf->wait);
+        lights_ring_resume(intf);
+    }
+
+    kref_put(&intf->refs, lights_interface_put);
+}
+EXPORT_SYMBOL_NS_GPL(lights_device_complete, LIGHTS);
 
 /**
  * lights_device_create_file() - Adds a file to the devices directory
@@ -2342,12 +5923,18 @@ static char *lights_devnode (
     char *buf;
 
     name = dev_name(dev);
-    len = strlen(name) + 9;
+    len = strlen(name) + 10 + strlen(LIGHTS_IO_NODE);
     buf = kmalloc(len, GFP_KERNEL);
 
     if (buf) {
+        /* Only the node of a zone is named without a file */
+        if (!strchr(name, ':')) {
+            snprintf(buf, len, "lights/%s/" LIGHTS_IO_NODE, name);
+            return buf;
+        }
+
         snprintf(buf, len, "lights/%s", name);
-        for (i = 8; i < len; i++) {
+        for (i = 8; buf[i]; i++) {
             if (buf[i] == ':')
                 buf[i] = '/';
         }
@@ -2360,6 +5947,9 @@ static char *lights_devnode (
  * init_default_attributes() - Creates the character devices in /dev/lights/all/
  *
  * @return: Zero or a negative error code
+ *
+ * Besides the usual files, "frame" accepts the leds of many zones at once
+ * and "transaction" applies the states of many zones together.
  */
 static error_t init_default_attributes (
     void
@@ -2372,8 +5962,13 @@ static error_t init_default_attributes (
         LIGHTS_DIRECTION_ATTR(NULL, io_read, io_write),
         LIGHTS_UPDATE_ATTR(NULL, io_write),
         LIGHTS_SYNC_ATTR(NULL, io_write),
+        LIGHTS_ATTR_WO(LIGHTS_IO_FRAME, LIGHTS_TYPE_LEDS, NULL, NULL),
+        LIGHTS_UPDATE_ATTR(NULL, NULL),
     };
 
+    /* Shares the type of the update file */
+    attrs[ARRAY_SIZE(attrs) - 1].attr.name = LIGHTS_IO_TRANSACTION;
+
     err = lights_device_register(&lights_global.all);
     if (err)
         return err;
@@ -2388,26 +5983,41 @@ void lights_destroy (
     void
 ){
     struct lights_interface *intf;
-    struct lights_interface *intf_safe;
     dev_t dev_id = MKDEV(lights_global.major, 0);
 
+    cancel_delayed_work_sync(&lights_global.sync_work);
+
+    lights_group_destroy_all();
+
     lights_device_unregister(&lights_global.all);
 
-    if (!list_empty(&lights_global.interface.list)) {
+    if (!list_empty(&lights_global.interface.list))
         LIGHTS_WARN("Not all interfaces have been unregistered.");
+
+    for (;;) {
         spin_lock(&lights_global.interface.lock);
+        intf = list_first_entry_or_null(&lights_global.interface.list, struct lights_interface, siblings);
+        if (intf)
+            kref_get(&intf->refs);
+        spin_unlock(&lights_global.interface.lock);
 
-        list_for_each_entry_safe(intf, intf_safe, &lights_global.interface.list, siblings) {
-            list_del(&intf->siblings);
-            kref_put(&intf->refs, lights_interface_put);
-        }
+        if (!intf)
+            break;
 
-        spin_unlock(&lights_global.interface.lock);
+        lights_interface_remove(intf);
+        kref_put(&intf->refs, lights_interface_put);
     }
 
     // lights_unregister_all_devices();
-    unregister_chrdev_region(dev_id, LIGHTS_MAX_DEVICES);
+    unregister_chrdev_region(dev_id, LIGHTS_MAX_MINORS);
     class_destroy(lights_global.class);
+
+    free_page((unsigned long)lights_global.caps.text);
+    lights_global.caps.text = NULL;
+
+    ida_destroy(&lights_global.minors);
+
+    lights_renderer_exit();
 }
 
 error_t lights_init (
@@ -2416,7 +6026,7 @@ error_t lights_init (
     int err;
     dev_t dev_id;
 
-    err = alloc_chrdev_region(&dev_id, LIGHTS_FIRST_MINOR, LIGHTS_MAX_DEVICES, "lights");
+    err = alloc_chrdev_region(&dev_id, LIGHTS_FIRST_MINOR, LIGHTS_MAX_MINORS, "lights");
     if (err < 0) {
         LIGHTS_ERR("can't get major number");
         return err;
@@ -2428,16 +6038,41 @@ error_t lights_init (
 
     if (IS_ERR(lights_global.class)) {
         err = PTR_ERR(lights_global.class);
-        unregister_chrdev_region(dev_id, LIGHTS_MAX_DEVICES);
+        unregister_chrdev_region(dev_id, LIGHTS_MAX_MINORS);
         LIGHTS_ERR("failed to create lights_class");
         return err;
     }
 
     lights_global.class->devnode = lights_devnode;
 
+    err = class_create_file(lights_global.class, &class_attr_group_add);
+    if (!err)
+        err = class_create_file(lights_global.class, &class_attr_group_remove);
+    if (err) {
+        class_destroy(lights_global.class);
+        unregister_chrdev_region(dev_id, LIGHTS_MAX_MINORS);
+        LIGHTS_ERR("failed to create group attributes");
+        return err;
+    }
+
+    /* Cache of /sys/class/lights/all/caps */
+    lights_global.caps.text = (char*)__get_free_page(GFP_KERNEL);
+
+    INIT_DELAYED_WORK(&lights_global.sync_work, lights_sync_work);
+
+    err = lights_renderer_init();
+    if (err) {
+        lights_destroy();
+        return err;
+    }
+
     err = init_default_attributes();
-    if (err)
+    if (err) {
         lights_destroy();
+        return err;
+    }
 
-    return err;
+    schedule_delayed_work(&lights_global.sync_work, msecs_to_jiffies(sync_interval ? sync_interval : 1000));
+
+    return 0;
 }
@@ -4,6 +4,7 @@
 
 #include <linux/types.h>
 #include <linux/sysfs.h>
+#include <linux/ioctl.h>
 #include <include/types.h>
 
 #include "lights-thunk.h"
@@ -19,6 +20,22 @@
 #define LIGHTS_IO_LEDS      "leds"
 #define LIGHTS_IO_SYNC      "sync"
 #define LIGHTS_IO_UPDATE    "update"
+#define LIGHTS_IO_FRAME     "frame"
+#define LIGHTS_IO_TRANSACTION "transaction"
+#define LIGHTS_IO_RING      "ring"
+#define LIGHTS_IO_NODE      "node"
+
+/*
+ * Selects which file of a zone is accessed through /dev/lights/___/node,
+ * the argument being the null terminated name of the file.
+ */
+#define LIGHTS_IOCTL_SELECT _IOW('L', 0x01, char[LIGHTS_MAX_FILENAME_LENGTH])
+
+/* Number of frame slots within /dev/lights/___/ring */
+#define LIGHTS_RING_FRAMES  4
+
+/* Forward declaration */
+struct lights_interface;
 
 struct lights_buffer {
     ssize_t         length;
@@ -26,6 +43,51 @@ struct lights_buffer {
     loff_t          offset;
 };
 
+/**
+ * struct lights_frame_zone - Header of a zone within /dev/lights/all/frame
+ *
+ * @id:    The zone id, as read from /sys/class/lights/___/id
+ * @count: Number of leds which follow, must equal the zones led_count
+ *
+ * The frame file accepts any number of zones in a single write. Each
+ * zone is a header followed by @count 3 byte RGB values. Using writev(),
+ * or io_uring, one iovec per zone allows an entire frame to be written
+ * with a single syscall.
+ */
+struct lights_frame_zone {
+    uint16_t        id;
+    uint16_t        count;
+} __packed;
+
+/**
+ * struct lights_ring_header - First page of a mapped /dev/lights/___/ring
+ *
+ * @head:         Number of frames published by the producer
+ * @tail:         Value of @head when the kernel last took a frame
+ * @dropped:      Number of frames skipped in favour of newer ones
+ * @led_count:    Number of leds within each frame
+ * @frame_count:  Number of frame slots
+ * @frame_offset: Offset, in bytes, of the first slot from the header
+ * @frame_size:   Size, in bytes, of a single slot
+ *
+ * The mapping must be exactly one page plus the page aligned size of
+ * all the slots. Frame N is written, as 3 byte RGB values, into slot
+ * (N % @frame_count). Once complete, the producer increments @head
+ * and writes anything to the file to wake the kernel.
+ *
+ * The kernel only ever takes the newest frame, at the rate the device
+ * accepts them, so a producer never needs to wait.
+ */
+struct lights_ring_header {
+    uint32_t        head;
+    uint32_t        tail;
+    uint32_t        dropped;
+    uint32_t        led_count;
+    uint32_t        frame_count;
+    uint32_t        frame_offset;
+    uint32_t        frame_size;
+};
+
 /**
  * enum lights_state_type - @lights_io data type flag
  *
@@ -119,6 +181,45 @@ static inline struct lights_state lights_state_copy (
     return state;
 };
 
+/**
+ * struct lights_transaction_zone - A state staged within /dev/lights/all/transaction
+ *
+ * @id:          The zone id, as read from /sys/class/lights/___/id
+ * @type:        One or more of LIGHTS_TYPE_EFFECT, _COLOR, _SPEED, _DIRECTION
+ *               and _SYNC, selecting the values which follow
+ * @length:      Size, in bytes, of this record and any data it carries
+ * @color:       The color as 0xAARRGGBB (requires LIGHTS_TYPE_COLOR)
+ * @speed:       The speed, 0 to 5 (requires LIGHTS_TYPE_SPEED)
+ * @direction:   0 or 1 (requires LIGHTS_TYPE_DIRECTION)
+ * @sync:        The sync step (requires LIGHTS_TYPE_SYNC)
+ * @reserved:    Must be zero
+ * @name_offset: Offset, from the start of this record, of the effect name
+ *               (requires LIGHTS_TYPE_EFFECT)
+ * @name_length: Length of the effect name, without any terminator
+ *
+ * Each write to the transaction file stages one or more of these, each
+ * immediately followed by the next. The effect name, when given, lies
+ * after the fixed fields and within @length. Every member has a fixed
+ * size and position, so the layout is the same for 32 and 64 bit
+ * userland.
+ *
+ * Nothing is sent to the hardware until fsync() is called on the file,
+ * at which point every staged zone is applied together. Closing the
+ * file discards anything not yet committed.
+ */
+struct lights_transaction_zone {
+    uint16_t        id;
+    uint16_t        type;
+    uint32_t        length;
+    uint32_t        color;
+    uint8_t         speed;
+    uint8_t         direction;
+    uint8_t         sync;
+    uint8_t         reserved;
+    uint16_t        name_offset;
+    uint16_t        name_length;
+} __packed;
+
 typedef error_t (*lights_read_t)(struct lights_thunk *, struct lights_state *);
 typedef error_t (*lights_write_t)(struct lights_thunk *, struct lights_state const *);
 
@@ -153,6 +254,8 @@ struct lights_attribute {
  * @led_count:    The number of leds supported by the device
  * @caps:         A list of modes supported by the device
  * @attrs:        A null terminated array of io attributes
+ * @intf:         Internal interface data
+ * @group:        Internal flag, set for user defined groups of zones
  *
  * The modes listed here are available to userland in the 'caps' file. This
  * file is created for each device when modes are given. Each mode is also
@@ -165,6 +268,10 @@ struct lights_dev {
     uint16_t                                    led_count;
     struct lights_effect const                  *caps;
     struct lights_attribute const * const    *attrs;
+
+    /* Private */
+    struct lights_interface                     *intf;
+    bool                                        group;
 };
 
 #define VERIFY_LIGHTS_TYPE(_type) ( \
@@ -294,6 +401,41 @@ error_t lights_device_create_files (
     size_t count
 );
 
+/**
+ * lights_device_submit() - Records an update queued by the driver
+ *
+ * @dev: A device previously registered with lights_device_register()
+ *
+ * Drivers which apply updates asynchronously should call this before
+ * handing the job to the adapter. Each call MUST be paired with a call
+ * to lights_device_complete(), including when queueing the job fails.
+ * Only the devices whose state the job changes should be submitted, as
+ * each completion wakes every poller of the device.
+ *
+ * The core only records the values written through the device files.
+ * It does not replace a drivers copy of the hardware registers, which
+ * is still needed to build packets and hold values read at probe.
+ */
+void lights_device_submit (
+    struct lights_dev const *dev
+);
+
+/**
+ * lights_device_complete() - Records the completion of a queued update
+ *
+ * @dev:   A device previously registered with lights_device_register()
+ * @error: Result of the transfer
+ *
+ * Once every submitted update has completed, any thread polling the
+ * devices files is woken. The @error is kept until the next completion
+ * and can be read from /sys/class/lights/___/error. May be called from
+ * interrupt context.
+ */
+void lights_device_complete (
+    struct lights_dev const *dev,
+    error_t error
+);
+
 /**
  * lights_read_effect() - Helper for reading effect value strings
  *
@@ -2,6 +2,7 @@
 #include <linux/module.h>
 #include <adapter/debug.h>
 #include "lights-interface.h"
+#include "usb/usb-driver.h"
 
 static char *default_color      = "#FF0000";
 static char *default_effect     = "static";
@@ -23,6 +24,7 @@ extern error_t lights_init (
 static void __exit lights_module_exit (void)
 {
     lights_destroy();
+    usb_driver_exit();
 }
 
 /**
@@ -57,7 +59,13 @@ static int __init lights_module_init (void)
         return err;
     }
 
-    return lights_init(&state);
+    usb_driver_init();
+
+    err = lights_init(&state);
+    if (err)
+        usb_driver_exit();
+
+    return err;
 }
 
 module_param(default_color,     charp, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
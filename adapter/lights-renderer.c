@@ -0,0 +1,626 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/math64.h>
+#include <linux/wait.h>
+
+#include <adapter/debug.h>
+#include <include/quirks.h>
+
+#include "lights-renderer.h"
+#include "lights-adapter.h"
+
+/* Fixed point size of a full effect cycle */
+#define PHASE_BITS  16
+#define PHASE_ONE   (1U << PHASE_BITS)
+
+/* Number of hue steps in a full rainbow */
+#define HUE_MAX     1536
+
+static struct lights_effect const lights_renderer_effect_list[] = {
+    LIGHTS_EFFECT_NAMED(SW_BREATHING),
+    LIGHTS_EFFECT_NAMED(SW_RAINBOW),
+    LIGHTS_EFFECT_NAMED(SW_CHASE),
+    {}
+};
+
+/* Duration, in milliseconds, of a single cycle for each speed */
+static uint32_t const lights_renderer_periods[] = {
+    8000, 6000, 4000, 3000, 2000, 1000
+};
+
+/**
+ * struct lights_renderer_global - The render engine
+ *
+ * @timer:     Frame clock
+ * @interval:  Time between frames
+ * @workqueue: Thread which renders and pushes the frames
+ * @work:      Work queued by @timer
+ * @lock:      Lock for @list and the parameters of each renderer
+ * @list:      Running renderers
+ * @running:   Set while @timer is armed
+ * @pushed:    Woken as each frame has been pushed
+ *
+ * The lock is never held while a frame is pushed, drivers may sleep
+ * on the bus and must not stall the writers of other zones.
+ */
+static struct {
+    struct hrtimer          timer;
+    ktime_t                 interval;
+    struct workqueue_struct *workqueue;
+    struct work_struct      work;
+    struct mutex            lock;
+    struct list_head        list;
+    bool                    running;
+    wait_queue_head_t       pushed;
+} lights_renderer_global = {
+    .lock   = __MUTEX_INITIALIZER(lights_renderer_global.lock),
+    .list   = LIST_HEAD_INIT(lights_renderer_global.list),
+    .pushed = __WAIT_QUEUE_HEAD_INITIALIZER(lights_renderer_global.pushed),
+};
+
+/**
+ * scale() - Multiplies a color channel by a level
+ *
+ * @value: Color channel
+ * @level: 0 to 255
+ *
+ * @return: Scaled value
+ */
+static inline uint8_t scale (
+    uint8_t value,
+    uint8_t level
+){
+    return ((uint16_t)value * level + 255) >> 8;
+}
+
+/**
+ * lights_color_scale() - Multiplies all channels of a color by a level
+ *
+ * @dst:   Target color
+ * @src:   Base color
+ * @level: 0 to 255
+ */
+static inline void lights_color_scale (
+    struct lights_color *dst,
+    struct lights_color const *src,
+    uint8_t level
+){
+    dst->r = scale(src->r, level);
+    dst->g = scale(src->g, level);
+    dst->b = scale(src->b, level);
+}
+
+/**
+ * lights_color_from_hue() - Converts a fully saturated hue into rgb
+ *
+ * @color: Target color
+ * @hue:   0 to HUE_MAX
+ */
+static void lights_color_from_hue (
+    struct lights_color *color,
+    uint32_t hue
+){
+    uint8_t rise, fall;
+
+    hue %= HUE_MAX;
+    rise = hue & 0xff;
+    fall = 255 - rise;
+
+    switch (hue >> 8) {
+    case 0: color->r = 255;  color->g = rise; color->b = 0;    break;
+    case 1: color->r = fall; color->g = 255;  color->b = 0;    break;
+    case 2: color->r = 0;    color->g = 255;  color->b = rise; break;
+    case 3: color->r = 0;    color->g = fall; color->b = 255;  break;
+    case 4: color->r = rise; color->g = 0;    color->b = 255;  break;
+    default:color->r = 255;  color->g = 0;    color->b = fall; break;
+    }
+}
+
+/**
+ * render_breathing() - Fades the base color in and out
+ *
+ * @renderer: Renderer to draw
+ * @count:    Number of colors in the frame
+ */
+static void render_breathing (
+    struct lights_renderer *renderer,
+    uint16_t count
+){
+    struct lights_color color;
+    uint32_t level;
+    uint16_t i;
+
+    /* Triangle wave, squared to look linear to the eye */
+    level = renderer->phase < PHASE_ONE / 2 ?
+        renderer->phase : PHASE_ONE - 1 - renderer->phase;
+    level = level >> (PHASE_BITS - 9);
+    level = (level * level) / 255;
+
+    lights_color_scale(&color, &renderer->color, level);
+
+    for (i = 0; i < count; i++)
+        renderer->frame[i] = color;
+}
+
+/**
+ * render_rainbow() - Rotates the hue, spread over all leds
+ *
+ * @renderer: Renderer to draw
+ * @count:    Number of colors in the frame
+ */
+static void render_rainbow (
+    struct lights_renderer *renderer,
+    uint16_t count
+){
+    uint32_t base, offset;
+    uint16_t i;
+
+    base = (renderer->phase * HUE_MAX) >> PHASE_BITS;
+
+    for (i = 0; i < count; i++) {
+        offset = (i * HUE_MAX) / count;
+        if (renderer->direction)
+            offset = HUE_MAX - offset;
+
+        lights_color_from_hue(&renderer->frame[i], base + offset);
+    }
+}
+
+/**
+ * render_chase() - Moves a fading segment of the base color along the leds
+ *
+ * @renderer: Renderer to draw
+ * @count:    Number of colors in the frame
+ *
+ * A single color zone blinks instead.
+ */
+static void render_chase (
+    struct lights_renderer *renderer,
+    uint16_t count
+){
+    uint32_t head, length, distance;
+    uint16_t i;
+
+    if (count == 1) {
+        lights_color_scale(
+            &renderer->frame[0],
+            &renderer->color,
+            renderer->phase < PHASE_ONE / 2 ? 255 : 0
+        );
+        return;
+    }
+
+    length = max_t(uint32_t, count / 8, 1);
+    head = (renderer->phase * count) >> PHASE_BITS;
+    if (renderer->direction)
+        head = count - 1 - head;
+
+    for (i = 0; i < count; i++) {
+        distance = renderer->direction ? i + count - head : head + count - i;
+        distance %= count;
+
+        if (distance < length) {
+            lights_color_scale(
+                &renderer->frame[i],
+                &renderer->color,
+                255 - (distance * 255) / length
+            );
+        } else {
+            renderer->frame[i].value = 0;
+        }
+    }
+}
+
+/**
+ * lights_timebase_period() - Duration of an effect cycle
+ *
+ * @speed: 0 to 5, the cycle duration
+ *
+ * @return: Nominal period in nanoseconds
+ */
+uint64_t lights_timebase_period (
+    uint8_t speed
+){
+    return (uint64_t)lights_renderer_periods[
+        min_t(uint8_t, speed, ARRAY_SIZE(lights_renderer_periods) - 1)
+    ] * NSEC_PER_MSEC;
+}
+
+/**
+ * lights_timebase_at() - Position within an effect cycle at a given time
+ *
+ * @speed: 0 to 5, the cycle duration
+ * @now:   Monotonic time
+ *
+ * @return: 16 bit fixed point phase
+ */
+uint32_t lights_timebase_at (
+    uint8_t speed,
+    ktime_t now
+){
+    uint64_t period, offset;
+
+    period = lights_timebase_period(speed);
+
+    div64_u64_rem(ktime_to_ns(now), period, &offset);
+
+    return div64_u64(offset << PHASE_BITS, period);
+}
+
+/**
+ * lights_timebase() - Position within an effect cycle
+ *
+ * @speed: 0 to 5, the cycle duration
+ *
+ * @return: 16 bit fixed point phase
+ */
+uint32_t lights_timebase (
+    uint8_t speed
+){
+    return lights_timebase_at(speed, ktime_get());
+}
+
+/**
+ * lights_renderer_draw() - Renders a single frame
+ *
+ * @renderer: Running renderer
+ * @now:      Time of the frame
+ * @state:    Populated with the frame to push
+ *
+ * @return: Error code
+ *
+ * The caller MUST hold the engine lock.
+ */
+static error_t lights_renderer_draw (
+    struct lights_renderer *renderer,
+    ktime_t now,
+    struct lights_state *state
+){
+    uint16_t count = max_t(uint16_t, renderer->led_count, 1);
+
+    /* Every renderer of the same speed is in phase */
+    renderer->phase = lights_timebase_at(renderer->speed, now);
+
+    switch (renderer->effect.id) {
+    case LIGHTS_EFFECT_ID_SW_BREATHING:
+        render_breathing(renderer, count);
+        break;
+    case LIGHTS_EFFECT_ID_SW_RAINBOW:
+        render_rainbow(renderer, count);
+        break;
+    case LIGHTS_EFFECT_ID_SW_CHASE:
+        render_chase(renderer, count);
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    memset(state, 0, sizeof(*state));
+
+    if (renderer->led_count) {
+        state->type       = LIGHTS_TYPE_LEDS;
+        state->raw.length = renderer->led_count;
+        state->raw.data   = renderer->frame;
+    } else {
+        state->type  = LIGHTS_TYPE_COLOR;
+        state->color = renderer->frame[0];
+    }
+
+    return 0;
+}
+
+/**
+ * lights_renderer_wait_pushed() - Waits for a frame being pushed
+ *
+ * @renderer: Renderer about to be changed
+ *
+ * The caller MUST hold the engine lock, which is dropped while waiting.
+ * Once returned, the renderer is not in use by the work.
+ */
+static void lights_renderer_wait_pushed (
+    struct lights_renderer *renderer
+){
+    while (renderer->pushing) {
+        mutex_unlock(&lights_renderer_global.lock);
+        wait_event(lights_renderer_global.pushed, !READ_ONCE(renderer->pushing));
+        mutex_lock(&lights_renderer_global.lock);
+    }
+}
+
+/**
+ * lights_renderer_work() - Renders a frame for every running renderer
+ *
+ * @work: The engine work
+ *
+ * Drivers may sleep while writing, so the frames are drawn here rather
+ * than in the timer. All frames are pushed under a single plug, the
+ * adapters then submit the transfers of one bus together.
+ *
+ * Each frame is drawn under the lock and pushed once it is released.
+ * While pushed, the renderer is marked so that it is neither removed
+ * from the list nor has its frame freed.
+ */
+static void lights_renderer_work (
+    struct work_struct *work
+){
+    struct lights_renderer *renderer;
+    struct lights_adapter_plug plug;
+    struct lights_state state;
+    ktime_t now = ktime_get();
+    error_t err;
+
+    lights_adapter_plug(&plug);
+
+    mutex_lock(&lights_renderer_global.lock);
+
+    list_for_each_entry(renderer, &lights_renderer_global.list, siblings) {
+        err = lights_renderer_draw(renderer, now, &state);
+        if (err)
+            continue;
+
+        renderer->pushing = true;
+        mutex_unlock(&lights_renderer_global.lock);
+
+        err = renderer->push(renderer->thunk, &state);
+        if (err)
+            LIGHTS_DBG("Failed to push '%s' frame: %s", renderer->effect.name, ERR_NAME(err));
+
+        mutex_lock(&lights_renderer_global.lock);
+        WRITE_ONCE(renderer->pushing, false);
+        wake_up_all(&lights_renderer_global.pushed);
+    }
+
+    mutex_unlock(&lights_renderer_global.lock);
+
+    lights_adapter_unplug(&plug);
+}
+
+/**
+ * lights_renderer_tick() - Frame clock handler
+ *
+ * @timer: The engine timer
+ *
+ * @return: Timer restart flag
+ *
+ * Runs in interrupt context. If the previous frame is still being
+ * pushed, the work is already pending and this frame is dropped.
+ */
+static enum hrtimer_restart lights_renderer_tick (
+    struct hrtimer *timer
+){
+    if (!READ_ONCE(lights_renderer_global.running))
+        return HRTIMER_NORESTART;
+
+    queue_work(lights_renderer_global.workqueue, &lights_renderer_global.work);
+    hrtimer_forward_now(timer, lights_renderer_global.interval);
+
+    return HRTIMER_RESTART;
+}
+
+/**
+ * lights_renderer_effects() - Fetches the software effects
+ *
+ * @return: Zero terminated array of effects
+ */
+struct lights_effect const *lights_renderer_effects (
+    void
+){
+    return lights_renderer_effect_list;
+}
+
+/**
+ * lights_renderer_find_effect() - Searches the software effects by name
+ *
+ * @name: Name of the effect
+ *
+ * @return: NULL or the effect
+ */
+struct lights_effect const *lights_renderer_find_effect (
+    const char *name
+){
+    return lights_effect_find_by_name(lights_renderer_effect_list, name);
+}
+
+/**
+ * lights_renderer_is_running() - Checks if a renderer is producing frames
+ *
+ * @renderer: Renderer to check
+ *
+ * @return: Boolean
+ */
+bool lights_renderer_is_running (
+    struct lights_renderer *renderer
+){
+    bool running;
+
+    mutex_lock(&lights_renderer_global.lock);
+    running = renderer->frame != NULL;
+    mutex_unlock(&lights_renderer_global.lock);
+
+    return running;
+}
+
+/**
+ * lights_renderer_start() - Begins rendering frames
+ *
+ * @renderer: Configured renderer
+ *
+ * @return: Error code
+ */
+error_t lights_renderer_start (
+    struct lights_renderer *renderer
+){
+    struct lights_color *frame;
+
+    if (IS_NULL(renderer, renderer->push))
+        return -EINVAL;
+
+    if (!lights_effect_is_software(&renderer->effect))
+        return -EINVAL;
+
+    frame = kcalloc(max_t(uint16_t, renderer->led_count, 1), sizeof(*frame), GFP_KERNEL);
+    if (!frame)
+        return -ENOMEM;
+
+    mutex_lock(&lights_renderer_global.lock);
+
+    lights_renderer_wait_pushed(renderer);
+
+    if (renderer->frame) {
+        list_del(&renderer->siblings);
+        kfree(renderer->frame);
+    }
+
+    renderer->frame = frame;
+
+    list_add_tail(&renderer->siblings, &lights_renderer_global.list);
+
+    /* Armed under the lock, so a concurrent stop cannot cancel it */
+    if (!lights_renderer_global.running) {
+        WRITE_ONCE(lights_renderer_global.running, true);
+        hrtimer_start(
+            &lights_renderer_global.timer,
+            lights_renderer_global.interval,
+            HRTIMER_MODE_REL
+        );
+    }
+
+    mutex_unlock(&lights_renderer_global.lock);
+
+    return 0;
+}
+
+/**
+ * lights_renderer_update() - Changes the parameters of a running effect
+ *
+ * @renderer: Running renderer
+ * @state:    Color, speed and/or direction
+ *
+ * @return: True if the renderer was running
+ *
+ * The values are stored even while stopped, to be used by the
+ * next call to lights_renderer_start().
+ */
+bool lights_renderer_update (
+    struct lights_renderer *renderer,
+    struct lights_state const *state
+){
+    bool running;
+
+    if (IS_NULL(renderer, state))
+        return false;
+
+    mutex_lock(&lights_renderer_global.lock);
+
+    if (state->type & LIGHTS_TYPE_COLOR)
+        renderer->color = state->color;
+    if (state->type & LIGHTS_TYPE_SPEED)
+        renderer->speed = state->speed;
+    if (state->type & LIGHTS_TYPE_DIRECTION)
+        renderer->direction = state->direction;
+
+    running = renderer->frame != NULL;
+
+    mutex_unlock(&lights_renderer_global.lock);
+
+    return running;
+}
+
+/**
+ * lights_renderer_stop() - Stops rendering frames
+ *
+ * @renderer: Previously started renderer
+ *
+ * When the last renderer stops, the timer is cancelled and any frame
+ * work already queued is flushed, so neither outlives the engine being
+ * idle. A frame being pushed is waited for, so the caller must not hold
+ * a lock taken by a push handler.
+ */
+void lights_renderer_stop (
+    struct lights_renderer *renderer
+){
+    struct lights_color *frame = NULL;
+    bool disarm = false;
+
+    if (IS_NULL(renderer))
+        return;
+
+    mutex_lock(&lights_renderer_global.lock);
+
+    lights_renderer_wait_pushed(renderer);
+
+    if (renderer->frame) {
+        list_del(&renderer->siblings);
+        frame = renderer->frame;
+        renderer->frame = NULL;
+    }
+
+    /* The tick never takes the lock, waiting for it here is safe */
+    if (lights_renderer_global.running && list_empty(&lights_renderer_global.list)) {
+        WRITE_ONCE(lights_renderer_global.running, false);
+        hrtimer_cancel(&lights_renderer_global.timer);
+        disarm = true;
+    }
+
+    mutex_unlock(&lights_renderer_global.lock);
+
+    /* The work takes the lock, it can only be flushed once released */
+    if (disarm)
+        flush_work(&lights_renderer_global.work);
+
+    kfree(frame);
+}
+
+/**
+ * lights_renderer_init() - Creates the render thread and timer
+ *
+ * @return: Error code
+ */
+error_t lights_renderer_init (
+    void
+){
+    lights_renderer_global.workqueue = alloc_ordered_workqueue("lights-renderer", WQ_HIGHPRI);
+    if (!lights_renderer_global.workqueue)
+        return -ENOMEM;
+
+    INIT_WORK(&lights_renderer_global.work, lights_renderer_work);
+
+    lights_renderer_global.interval = ns_to_ktime(NSEC_PER_SEC / LIGHTS_RENDERER_HZ);
+    hrtimer_init(&lights_renderer_global.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    lights_renderer_global.timer.function = lights_renderer_tick;
+
+    return 0;
+}
+
+/**
+ * lights_renderer_exit() - Stops all renderers and releases the thread
+ */
+void lights_renderer_exit (
+    void
+){
+    struct lights_renderer *renderer, *safe;
+
+    if (!lights_renderer_global.workqueue)
+        return;
+
+    mutex_lock(&lights_renderer_global.lock);
+
+    WRITE_ONCE(lights_renderer_global.running, false);
+
+    list_for_each_entry_safe(renderer, safe, &lights_renderer_global.list, siblings) {
+        LIGHTS_WARN("Renderer '%s' was not stopped", renderer->effect.name);
+        list_del(&renderer->siblings);
+        kfree(renderer->frame);
+        renderer->frame = NULL;
+    }
+
+    mutex_unlock(&lights_renderer_global.lock);
+
+    hrtimer_cancel(&lights_renderer_global.timer);
+    destroy_workqueue(lights_renderer_global.workqueue);
+    lights_renderer_global.workqueue = NULL;
+}
@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _UAPI_LIGHTS_ADAPTER_RENDERER_H
+#define _UAPI_LIGHTS_ADAPTER_RENDERER_H
+
+#include <linux/list.h>
+#include <linux/ktime.h>
+#include <include/types.h>
+
+#include "lights-thunk.h"
+#include "lights-interface.h"
+
+/* Number of frames rendered each second */
+#define LIGHTS_RENDERER_HZ 60
+
+/**
+ * typedef lights_renderer_push_t - Frame output handler
+ *
+ * @thunk: The renderers thunk
+ * @state: Either LIGHTS_TYPE_LEDS or LIGHTS_TYPE_COLOR
+ *
+ * @return: Error code
+ *
+ * Called from process context, once per frame.
+ */
+typedef error_t (*lights_renderer_push_t)(struct lights_thunk *, struct lights_state const *);
+
+/**
+ * struct lights_renderer - Software effect state of a single zone
+ *
+ * @siblings:  Next and prev pointers (Private)
+ * @thunk:     First parameter of @push
+ * @push:      Frame output handler
+ * @effect:    One of the software effects
+ * @color:     Base color of the effect
+ * @speed:     0 to 5, the cycle duration
+ * @direction: 0 or 1, the direction of travel
+ * @led_count: Number of leds, or zero to render a single color
+ * @frame:     Led buffer (Private)
+ * @phase:     Position within the cycle, 16 bit fixed point (Private)
+ * @pushing:   Set while the frame is given to @push (Private)
+ *
+ * A zero filled object is a valid, stopped, renderer.
+ */
+struct lights_renderer {
+    struct list_head            siblings;
+    struct lights_thunk         *thunk;
+    lights_renderer_push_t      push;
+
+    struct lights_effect        effect;
+    struct lights_color         color;
+    uint8_t                     speed;
+    uint8_t                     direction;
+    uint16_t                    led_count;
+
+    /* Private */
+    struct lights_color         *frame;
+    uint32_t                    phase;
+    bool                        pushing;
+};
+
+/**
+ * lights_timebase_period() - Duration of an effect cycle
+ *
+ * @speed: 0 to 5, the cycle duration
+ *
+ * @return: Nominal period in nanoseconds
+ */
+uint64_t lights_timebase_period (
+    uint8_t speed
+);
+
+/**
+ * lights_timebase_at() - Position within an effect cycle at a given time
+ *
+ * @speed: 0 to 5, the cycle duration
+ * @now:   Monotonic time
+ *
+ * @return: 16 bit fixed point phase
+ */
+uint32_t lights_timebase_at (
+    uint8_t speed,
+    ktime_t now
+);
+
+/**
+ * lights_timebase() - Position within an effect cycle
+ *
+ * @speed: 0 to 5, the cycle duration
+ *
+ * @return: 16 bit fixed point phase
+ *
+ * The effect clock shared by every device. Software effects are
+ * drawn at this phase, hardware effects are periodically synced
+ * to it.
+ */
+uint32_t lights_timebase (
+    uint8_t speed
+);
+
+/**
+ * lights_renderer_effects() - Fetches the software effects
+ *
+ * @return: Zero terminated array of effects
+ */
+struct lights_effect const *lights_renderer_effects (
+    void
+);
+
+/**
+ * lights_renderer_find_effect() - Searches the software effects by name
+ *
+ * @name: Name of the effect
+ *
+ * @return: NULL or the effect
+ */
+struct lights_effect const *lights_renderer_find_effect (
+    const char *name
+);
+
+/**
+ * lights_renderer_start() - Begins rendering frames
+ *
+ * @renderer: Configured renderer
+ *
+ * @return: Error code
+ *
+ * If the renderer is already running, it is restarted with the new
+ * configuration.
+ */
+error_t lights_renderer_start (
+    struct lights_renderer *renderer
+);
+
+/**
+ * lights_renderer_update() - Changes the parameters of a running effect
+ *
+ * @renderer: Running renderer
+ * @state:    Color, speed and/or direction
+ *
+ * @return: True if the renderer was running
+ */
+bool lights_renderer_update (
+    struct lights_renderer *renderer,
+    struct lights_state const *state
+);
+
+/**
+ * lights_renderer_stop() - Stops rendering frames
+ *
+ * @renderer: Previously started renderer
+ *
+ * Once returned, @push will not be called again. Does nothing
+ * if the renderer is not running.
+ */
+void lights_renderer_stop (
+    struct lights_renderer *renderer
+);
+
+/**
+ * lights_renderer_is_running() - Checks if a renderer is producing frames
+ *
+ * @renderer: Renderer to check
+ *
+ * @return: Boolean
+ */
+bool lights_renderer_is_running (
+    struct lights_renderer *renderer
+);
+
+/**
+ * lights_renderer_init() - Creates the render thread and timer
+ *
+ * @return: Error code
+ */
+error_t lights_renderer_init (
+    void
+);
+
+/**
+ * lights_renderer_exit() - Stops all renderers and releases the thread
+ */
+void lights_renderer_exit (
+    void
+);
+
+#endif
@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0
+#include <linux/completion.h>
 #include <linux/delay.h>
 #include <linux/i2c.h>
+#include <linux/interrupt.h>
 #include <linux/pci.h>
 
 #include "../debug.h"
@@ -16,6 +18,19 @@
 #define SMBHSTDAT0              (5 + smba)
 #define SMBHSTDAT1              (6 + smba)
 #define SMBBLKDAT               (7 + smba)
+#define SMBI2CCFG               (0x10 + smba)
+
+/* PIIX4 status and control bits */
+#define SMBHSTSTS_BUSY          0x01
+#define SMBHSTSTS_INTR          0x02
+#define SMBHSTSTS_DEV_ERR       0x04
+#define SMBHSTSTS_BUS_ERR       0x08
+#define SMBHSTSTS_FAILED        0x10
+#define SMBHSTSTS_FLAGS         0x1e
+#define SMBHSTCNT_INTREN        0x01
+
+/* FCH I2C bus config, set when the host interrupts an IRQ rather than SMI */
+#define SMBI2CCFG_IRQ           0x01
 
 /* PIIX4 constants */
 #define PIIX4_QUICK             0x00
@@ -28,7 +43,12 @@
 #define SMBIOSIZE               7 // Changed from 9
 #define MUXED_NAME              "sb800_piix4_smb"
 #define MAX_TIMEOUT             500
-#define ENABLE_INT9             0
+/* Longest wait, in milliseconds, for the completion interrupt */
+#define IRQ_TIMEOUT             25
+
+static bool use_irq = false;
+module_param(use_irq, bool, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(use_irq, "Wait for the SMBus completion interrupt instead of polling");
 
 /*
  * Data for PCI driver interface
@@ -47,25 +67,196 @@ static struct pci_device_id const smbus_piix4_tbl[] = {
 /**
  * struct smbus_context - Storage for smbus access
  *
- * @smbus_adapter: data expected by the read/write functions
- * @adapter:       access to the smbus
- * @smba:          address of the smbus
+ * @adapter: access to the smbus
+ * @smba:    address of the smbus
+ * @irq:     interrupt line, zero when polling
+ * @done:    signalled by the interrupt handler
+ * @status:  host status captured by the interrupt handler
+ * @pending: set while a transaction of this context is outstanding
+ * @armed:   set while INTREN is enabled in the host control
  */
 struct smbus_context {
     struct i2c_adapter      adapter;
     uint16_t                smba;
+    int                     irq;
+    struct completion       done;
+    uint8_t                 status;
+    bool                    pending;
+    bool                    armed;
 };
 #define ctx_from_adapter(ptr)( \
     container_of(ptr, struct smbus_context, adapter) \
 )
 
+/**
+ * smbus_piix4_isr() - Acknowledges a completed transaction
+ *
+ * @irq:    Interrupt line
+ * @dev_id: The smbus context
+ *
+ * @return: IRQ_NONE if the (shared) interrupt was not raised by the host
+ *
+ * Whenever INTREN is armed the status is acknowledged, even if the
+ * waiter has already given up, so the (level) line is deasserted.
+ */
+static irqreturn_t smbus_piix4_isr (
+    int irq,
+    void *dev_id
+){
+    struct smbus_context *context = dev_id;
+    uint16_t smba = context->smba;
+    uint8_t status;
+
+    if (!READ_ONCE(context->armed))
+        return IRQ_NONE;
+
+    status = inb_p(SMBHSTSTS);
+    if ((status & SMBHSTSTS_BUSY) || !(status & SMBHSTSTS_FLAGS))
+        return IRQ_NONE;
+
+    outb_p(status & SMBHSTSTS_FLAGS, SMBHSTSTS);
+
+    if (READ_ONCE(context->pending)) {
+        context->status = status;
+        complete(&context->done);
+    }
+
+    return IRQ_HANDLED;
+}
+
+/**
+ * smbus_piix4_disarm() - Stops the host raising the interrupt
+ *
+ * @context: The smbus context
+ *
+ * Any completion already latched in the status is acknowledged.
+ */
+static void smbus_piix4_disarm (
+    struct smbus_context *context
+){
+    uint16_t smba = context->smba;
+    uint8_t status;
+
+    outb_p(inb_p(SMBHSTCNT) & ~SMBHSTCNT_INTREN, SMBHSTCNT);
+    WRITE_ONCE(context->armed, false);
+
+    status = inb_p(SMBHSTSTS);
+    if (status & SMBHSTSTS_FLAGS)
+        outb_p(status & SMBHSTSTS_FLAGS, SMBHSTSTS);
+}
+
+/**
+ * smbus_piix4_release_irq() - Switches the context to polling
+ *
+ * @context: The smbus context
+ *
+ * Once returned, the interrupt handler will not be called again.
+ */
+static void smbus_piix4_release_irq (
+    struct smbus_context *context
+){
+    if (!context->irq)
+        return;
+
+    free_irq(context->irq, context);
+    context->irq = 0;
+}
+
+/**
+ * smbus_piix4_request_irq() - Attempts to use the completion interrupt
+ *
+ * @context: The smbus context
+ * @pci_dev: The SMBus PCI function
+ *
+ * The FCH only raises an interrupt when the I2C bus config of the
+ * port selects IRQ over SMI, in which case it is delivered on the
+ * line assigned to the PCI function. Unless both can be confirmed,
+ * or should anything fail, transactions are polled instead.
+ */
+static void smbus_piix4_request_irq (
+    struct smbus_context *context,
+    struct pci_dev *pci_dev
+){
+    uint16_t smba = context->smba;
+    uint8_t config;
+    int err;
+
+    init_completion(&context->done);
+
+    if (!use_irq)
+        return;
+
+    config = inb_p(SMBI2CCFG);
+    if (!(config & SMBI2CCFG_IRQ) || pci_dev->irq <= 0) {
+        LIGHTS_DBG("SMBus interrupt not routed to an IRQ (%02x), polling", config);
+        return;
+    }
+
+    err = request_irq(pci_dev->irq, smbus_piix4_isr, IRQF_SHARED,
+        context->adapter.name, context);
+    if (err) {
+        LIGHTS_WARN("Failed to request IRQ %d, polling instead: %d", pci_dev->irq, err);
+        return;
+    }
+
+    context->irq = pci_dev->irq;
+}
+
+/**
+ * smbus_piix4_wait() - Waits for the host to finish a transaction
+ *
+ * @context: The smbus context
+ *
+ * @return: The final host status, busy if timed out
+ *
+ * On a timeout INTREN is cleared, so a late completion can not leave
+ * the line asserted. Should the interrupt never arrive for a completed
+ * transaction, the line is assumed to be unrouted and the context falls
+ * back to polling.
+ */
+static uint8_t smbus_piix4_wait (
+    struct smbus_context *context
+){
+    uint16_t smba = context->smba;
+    int timeout = 0;
+    uint8_t temp = SMBHSTSTS_BUSY;
+
+    if (context->irq) {
+        if (wait_for_completion_timeout(&context->done, msecs_to_jiffies(IRQ_TIMEOUT)))
+            return context->status;
+
+        temp = inb_p(SMBHSTSTS);
+        smbus_piix4_disarm(context);
+
+        /* The handler may have raced the timeout */
+        if (completion_done(&context->done))
+            return context->status;
+
+        if (temp & SMBHSTSTS_BUSY)
+            return SMBHSTSTS_BUSY;
+
+        LIGHTS_WARN("No interrupt from '%s', polling instead", context->adapter.name);
+        smbus_piix4_release_irq(context);
+
+        return temp;
+    }
+
+    /* We will always wait for a fraction of a second! (See PIIX4 docs errata) */
+    usleep_range(25, 50);
+
+    while ((++timeout < MAX_TIMEOUT) && ((temp = inb_p(SMBHSTSTS)) & SMBHSTSTS_BUSY))
+        usleep_range(25, 50);
+
+    return temp;
+}
+
 static int smbus_piix4_transaction (
-    struct i2c_adapter *adapter,
-    uint16_t smba
+    struct smbus_context *context
 ){
+    struct i2c_adapter *adapter = &context->adapter;
+    uint16_t smba = context->smba;
     int temp;
     int result = 0;
-    int timeout = 0;
 
     /* Make sure the SMBus host is ready to start transmitting */
     if ((temp = inb_p(SMBHSTSTS)) != 0x00) {
@@ -79,34 +270,34 @@ static int smbus_piix4_transaction (
         }
     }
 
+    reinit_completion(&context->done);
+    WRITE_ONCE(context->pending, true);
+
     /* start the transaction by setting bit 6 */
     outb_p(inb(SMBHSTCNT) | 0x040, SMBHSTCNT);
 
-    /* We will always wait for a fraction of a second! (See PIIX4 docs errata) */
-    usleep_range(25, 50);
-
-    while ((++timeout < MAX_TIMEOUT) && ((temp = inb_p(SMBHSTSTS)) & 0x01))
-        usleep_range(25, 50);
+    temp = smbus_piix4_wait(context);
+    WRITE_ONCE(context->pending, false);
 
     /* If the SMBus is still busy, we give up */
-    if (timeout == MAX_TIMEOUT) {
+    if (temp & SMBHSTSTS_BUSY) {
         dev_err(&adapter->dev, "SMBus Timeout!\n");
         result = -ETIMEDOUT;
     }
 
-    if (temp & 0x10) {
+    if (temp & SMBHSTSTS_FAILED) {
         result = -EIO;
         dev_err(&adapter->dev, "Error: Failed bus transaction\n");
     }
 
-    if (temp & 0x08) {
+    if (temp & SMBHSTSTS_BUS_ERR) {
         result = -EIO;
         dev_dbg(&adapter->dev, "Bus collision! SMBus may be "
             "locked until next hard reset. (sorry!)\n");
         /* Clock stops and slave is stuck in mid-transmission */
     }
 
-    if (temp & 0x04) {
+    if (temp & SMBHSTSTS_DEV_ERR) {
         result = -ENXIO;
         dev_dbg(&adapter->dev, "Error: no response!\n");
     }
@@ -187,9 +378,10 @@ static int smbus_piix4_transfer (
         return -EOPNOTSUPP;
     }
 
-    outb_p((size & 0x1C) + (ENABLE_INT9 & 1), SMBHSTCNT);
+    outb_p((size & 0x1C) | (context->irq ? SMBHSTCNT_INTREN : 0), SMBHSTCNT);
+    WRITE_ONCE(context->armed, !!context->irq);
 
-    status = smbus_piix4_transaction(adapter, smba);
+    status = smbus_piix4_transaction(context);
     if (status)
         return status;
 
@@ -300,6 +492,7 @@ void piix4_adapter_destroy (
     i2c_set_adapdata(&context->adapter, NULL);
     i2c_del_adapter(&context->adapter);
 
+    smbus_piix4_release_irq(context);
     kfree(context);
 }
 EXPORT_SYMBOL_NS_GPL(piix4_adapter_destroy, LIGHTS);
@@ -336,14 +529,17 @@ struct i2c_adapter *piix4_adapter_create (
         "AURA MB adapter (piix4) at %04x", context->smba);
 
     i2c_set_adapdata(&context->adapter, context);
+    smbus_piix4_request_irq(context, pci_dev);
 
     err = i2c_add_adapter(&context->adapter);
     if (err) {
+        smbus_piix4_release_irq(context);
         kfree(context);
         return ERR_PTR(err);
     }
 
-    LIGHTS_INFO("Created I2C adapter '%s'", context->adapter.name);
+    LIGHTS_INFO("Created I2C adapter '%s' (%s)", context->adapter.name,
+        context->irq ? "interrupt" : "polling");
 
     return &context->adapter;
 }
@@ -11,6 +11,12 @@
 #include <linux/usb.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/rcupdate.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/idr.h>
 
 #include <adapter/debug.h>
 #include "usb-driver.h"
@@ -24,10 +30,29 @@
         len );      \
 })
 
+/* Number of interrupt OUT URBs which may be queued at once */
+#define USB_OUT_URBS    8
+/* Number of interrupt IN URBs kept posted to the device */
+#define USB_IN_URBS     4
+/* Number of responses held for readers */
+#define USB_IN_SLOTS    8
+/* Number of devices addressable by usb_client.index */
+#define USB_MAX_CONTEXTS (U8_MAX + 1)
+/* Number of power of two, microsecond, latency buckets */
+#define USB_LATENCY_BUCKETS 16
+/* Shortest wait, allowing for scheduling delays */
+#define USB_TIMEOUT_MIN_US  (10 * USEC_PER_MSEC)
+
+static unsigned int timeout_ms = 500;
+module_param(timeout_ms, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(timeout_ms, "Longest wait, in milliseconds, for a USB transfer to complete");
+
 static struct file_operations const usb_fops = {
     .owner = THIS_MODULE,
 };
 
+static struct dentry *usb_debugfs;
+
 static LIST_HEAD(usb_controller_store_list);
 static DEFINE_SPINLOCK(usb_controller_store_lock);
 
@@ -68,6 +93,12 @@ struct usb_callback {
  * @refs:         Reference count
  * @descriptor:   The actual properties of the device
  * @lock:         Spin lock for list
+ * @contexts:     RCU protected index of @context_list
+ * @slots:        Allocator of the index of each context
+ *
+ * Transfers resolve their device through @contexts, without taking
+ * @lock, so the cost does not grow with the number of devices. A
+ * context keeps its index from probe until disconnect.
  */
 struct usb_controller {
     struct list_head                siblings;
@@ -83,6 +114,9 @@ struct usb_controller {
 
     wait_queue_head_t               probe_wait;
     size_t                          packet_size;
+
+    struct usb_context __rcu        *contexts[USB_MAX_CONTEXTS];
+    struct ida                      slots;
 };
 
 /**
@@ -92,6 +126,7 @@ struct usb_controller {
  * @urb:      Associated URB for the endpoint
  * @buffer:   Buffer for the packet data
  * @interval: URB interval
+ * @period:   Microseconds between transfers, decoded from @interval
  * @done:     Tranfer completion flag
  */
 struct interrupt {
@@ -99,10 +134,35 @@ struct interrupt {
     struct urb                      *urb;
     unsigned int                    pipe;
     int                             interval;
+    unsigned int                    period;
     uint8_t                         *buffer;
     bool                            done;
 };
 
+/**
+ * struct usb_latency - Submit to completion times of an endpoint
+ *
+ * @lock:     Lock for the members
+ * @buckets:  Counts of samples, bucket N holding those under 2^(N+1)us
+ * @count:    Number of samples
+ * @max:      Longest sample, in microseconds
+ * @srtt:     Smoothed latency, in microseconds scaled by 8
+ * @rttvar:   Smoothed deviation, in microseconds scaled by 4
+ * @timeouts: Number of waits which timed out
+ *
+ * The estimates are those TCP uses for its retransmit timer, a wait
+ * is given the smoothed latency plus four deviations.
+ */
+struct usb_latency {
+    spinlock_t                      lock;
+    uint32_t                        buckets[USB_LATENCY_BUCKETS];
+    uint64_t                        count;
+    uint32_t                        max;
+    uint32_t                        srtt;
+    uint32_t                        rttvar;
+    uint32_t                        timeouts;
+};
+
 /**
  * struct usb_context - Single device
  *
@@ -113,11 +173,29 @@ struct interrupt {
  * @completion:    Threads waiting for read/write completion
  * @state:         Atomic state of the device
  * @lock:          Mutual exclusion lock for read and write
- * @interrupt_in:  Input config
- * @interrupt_out: Output config
+ * @interrupt_in:  Input config, only the endpoint is used
+ * @interrupt_out: Output config, only the endpoint is used
+ * @in_pool:       Interrupt IN URBs, resubmitted as each completes
+ * @in_anchor:     URBs of @in_pool posted to the host controller
+ * @in_posted:     Number of URBs of @in_pool posted, the ring is dead at zero
+ * @in_lock:       Lock for @in_ring and the counters
+ * @in_ring:       USB_IN_SLOTS responses of packet_size bytes
+ * @in_requested:  Number of requests written which expect a response
+ * @in_received:   Number of responses received
+ * @out_pool:      Interrupt OUT URBs, each owning a coherent packet buffer
+ * @out_anchor:    URBs of @out_pool queued to the host controller
+ * @out_inflight:  Number of URBs anchored to @out_anchor
+ * @out_next:      Index of the next URB of @out_pool to submit
+ * @out_stamp:     Submission time of each URB of @out_pool
+ * @out_latency:   Write latencies
+ * @in_stamp:      Request time of each slot of @in_ring
+ * @in_latency:    Request to response latencies
+ * @debugfs:       Directory of the latency file
  * @error:         Error seen during interrupt
  * @packet_size:   Max size of packet
  * @name:          Name of the driver
+ * @index:         Index of the context within the controller, fixed at probe
+ * @rcu:           Delays the free until lockless lookups are done
  */
 struct usb_context {
     struct list_head                siblings;
@@ -131,12 +209,82 @@ struct usb_context {
     struct mutex                    lock;
     struct interrupt                interrupt_in;
     struct interrupt                interrupt_out;
+    struct urb                      *in_pool[USB_IN_URBS];
+    struct usb_anchor               in_anchor;
+    atomic_t                        in_posted;
+    spinlock_t                      in_lock;
+    uint8_t                         *in_ring;
+    uint32_t                        in_requested;
+    uint32_t                        in_received;
+    struct urb                      *out_pool[USB_OUT_URBS];
+    struct usb_anchor               out_anchor;
+    atomic_t                        out_inflight;
+    unsigned int                    out_next;
+    ktime_t                         out_stamp[USB_OUT_URBS];
+    struct usb_latency              out_latency;
+    ktime_t                         in_stamp[USB_IN_SLOTS];
+    struct usb_latency              in_latency;
+    struct dentry                   *debugfs;
 
     error_t                         error;
     size_t                          packet_size;
     const char                      *name;
+    uint8_t                         index;
+    struct rcu_head                 rcu;
 };
 
+/**
+ * usb_context_alloc_urb() - Creates an URB with a DMA coherent buffer
+ *
+ * @context: Owning context
+ *
+ * @return: NULL or the URB
+ *
+ * The buffer is packet_size bytes and mapped for the lifetime of the
+ * URB, so no mapping is made for each transfer.
+ */
+static struct urb *usb_context_alloc_urb (
+    struct usb_context *context
+){
+    struct urb *urb;
+
+    urb = usb_alloc_urb(0, GFP_KERNEL);
+    if (!urb)
+        return NULL;
+
+    urb->transfer_buffer = usb_alloc_coherent(
+        context->udev,
+        context->packet_size,
+        GFP_KERNEL,
+        &urb->transfer_dma
+    );
+    if (!urb->transfer_buffer) {
+        usb_free_urb(urb);
+        return NULL;
+    }
+
+    urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+
+    return urb;
+}
+
+/**
+ * usb_context_free_urb() - Releases an URB and its buffer
+ *
+ * @context: Owning context
+ * @urb:     NULL or an URB created by usb_context_alloc_urb()
+ */
+static void usb_context_free_urb (
+    struct usb_context *context,
+    struct urb *urb
+){
+    if (!urb)
+        return;
+
+    usb_free_coherent(context->udev, context->packet_size, urb->transfer_buffer, urb->transfer_dma);
+    usb_free_urb(urb);
+}
+
 /**
  * usb_context_destroy() - Destructor
  *
@@ -146,16 +294,22 @@ static void usb_context_destroy (
     struct kref *ref
 ){
     struct usb_context *context = container_of(ref, struct usb_context, refs);
+    int i;
 
     LIGHTS_DBG("Destroying usb context for '%s'", context->name);
 
     mutex_destroy(&context->lock);
-    usb_free_urb(context->interrupt_in.urb);
-    usb_free_urb(context->interrupt_out.urb);
     kfree_const(context->name);
-    kfree(context->interrupt_in.buffer);
-    kfree(context->interrupt_out.buffer);
-    kfree(context);
+    kfree(context->in_ring);
+
+    for (i = 0; i < USB_IN_URBS; i++)
+        usb_context_free_urb(context, context->in_pool[i]);
+
+    for (i = 0; i < USB_OUT_URBS; i++)
+        usb_context_free_urb(context, context->out_pool[i]);
+
+    usb_put_dev(context->udev);
+    kfree_rcu(context, rcu);
 }
 
 /**
@@ -188,95 +342,10 @@ static void usb_controller_destroy (
         kfree(cb_iter);
     }
 
+    ida_destroy(&ctrl->slots);
     kfree(ctrl);
 }
 
-/**
- * usb_container_node_match() - Checks if a device id matches the node
- *
- * @node: Node to test
- * @id:   Device ID to match
- *
- * @return: True or False
- */
-static inline bool usb_container_match (
-    struct usb_controller const *ctrl,
-    struct usb_device_id const *id
-){
-    struct usb_device_id const *iter;
-
-    for (
-        iter = ctrl->usb_driver.id_table;
-        iter->idVendor || iter->idProduct || iter->bDeviceClass || iter->bInterfaceClass || iter->driver_info;
-        iter++
-    ){
-        /* Do we always get the same object instance? */
-        if (iter == id)
-            return true;
-    }
-
-    return false;
-
-    // if ((id->match_flags & USB_DEVICE_ID_MATCH_VENDOR) &&
-    //     id->idVendor != le16_to_cpu(container->descriptor.idVendor))
-    //         return false;
-    //
-    // if ((id->match_flags & USB_DEVICE_ID_MATCH_PRODUCT) &&
-    //     id->idProduct != le16_to_cpu(container->descriptor.idProduct))
-    //         return false;
-    //
-    // if ((id->match_flags & USB_DEVICE_ID_MATCH_DEV_LO) &&
-    //     (id->bcdDevice_lo > le16_to_cpu(container->descriptor.bcdDevice)))
-    //         return false;
-    //
-    // if ((id->match_flags & USB_DEVICE_ID_MATCH_DEV_HI) &&
-    //     (id->bcdDevice_hi < le16_to_cpu(container->descriptor.bcdDevice)))
-    //         return false;
-    //
-    // if ((id->match_flags & USB_DEVICE_ID_MATCH_DEV_CLASS) &&
-    //     (id->bDeviceClass != container->descriptor.bDeviceClass))
-    //         return false;
-    //
-    // if ((id->match_flags & USB_DEVICE_ID_MATCH_DEV_SUBCLASS) &&
-    //     (id->bDeviceSubClass != container->descriptor.bDeviceSubClass))
-    //         return false;
-    //
-    // if ((id->match_flags & USB_DEVICE_ID_MATCH_DEV_PROTOCOL) &&
-    //     (id->bDeviceProtocol != container->descriptor.bDeviceProtocol))
-    //         return false;
-    //
-    // return true;
-}
-
-/**
- * usb_store_find_controller_by_id() - Searches for a node matching the ID
- *
- * @id: Device ID
- *
- * @return: Null or a reference counted node instance
- */
-static struct usb_controller *usb_store_find_controller_by_id (
-    struct usb_device_id const *id
-){
-    struct usb_controller *ctrl;
-
-    spin_lock(&usb_controller_store_lock);
-
-    list_for_each_entry(ctrl, &usb_controller_store_list, siblings) {
-        if (usb_container_match(ctrl, id)) {
-            kref_get(&ctrl->refs);
-            goto found;
-        }
-    }
-
-    ctrl = NULL;
-
-found:
-    spin_unlock(&usb_controller_store_lock);
-
-    return ctrl;
-}
-
 /**
  * usb_store_find_container_by_desciptor() - Searches for a node with the given desciptor
  *
@@ -323,25 +392,15 @@ static struct usb_context *usb_controller_find_context (
     if (IS_NULL(ctrl))
         return ERR_PTR(-EINVAL);
 
-    spin_lock(&ctrl->lock);
-
-    context = list_first_entry_or_null(&ctrl->context_list, struct usb_context, siblings);
-
-    while (context && index--) {
-        if (list_is_last(&context->siblings, &ctrl->context_list))
-            context = NULL;
-        else
-            context = list_next_entry(context, siblings);
-    }
+    rcu_read_lock();
 
-    if (context)
-        kref_get(&context->refs);
-    else
-        context = ERR_PTR(-ENODEV);
+    context = rcu_dereference(ctrl->contexts[index]);
+    if (context && !kref_get_unless_zero(&context->refs))
+        context = NULL;
 
-    spin_unlock(&ctrl->lock);
+    rcu_read_unlock();
 
-    return context;
+    return context ? context : ERR_PTR(-ENODEV);
 }
 
 /**
@@ -355,18 +414,23 @@ static struct usb_context *usb_store_find_context (
     struct usb_client const *client
 ){
     struct usb_controller *ctrl;
+    struct usb_context *context;
 
     if (IS_NULL(client, client->name))
         return ERR_PTR(-EINVAL);
 
-    ctrl = client->controller;
+    /* Registered clients hold the controller */
+    if (likely(client->controller))
+        return usb_controller_find_context(client->controller, client->index);
+
+    ctrl = usb_store_find_controller_by_name(client->name);
     if (!ctrl)
-        ctrl = usb_store_find_controller_by_name(client->name);
+        return ERR_PTR(-ENODEV);
 
-    if (ctrl)
-        return usb_controller_find_context(ctrl, client->index);
+    context = usb_controller_find_context(ctrl, client->index);
+    kref_put(&ctrl->refs, usb_controller_destroy);
 
-    return ERR_PTR(-ENODEV);
+    return context;
 }
 
 /**
@@ -383,23 +447,22 @@ static void usb_store_add_context (
     struct usb_context *context
 ){
     struct usb_context *iter;
+    struct list_head *next = &ctrl->context_list;
 
     spin_lock(&ctrl->lock);
 
-    if (!list_empty(&ctrl->context_list)) {
-        list_for_each_entry(iter, &ctrl->context_list, siblings) {
-            // TODO - Do we need to check for duplicates?
-            if (strcmp(iter->name, context->name) > 0) {
-                list_splice_tail(&context->siblings, &iter->siblings);
-                goto exit;
-            }
+    list_for_each_entry(iter, &ctrl->context_list, siblings) {
+        // TODO - Do we need to check for duplicates?
+        if (strcmp(iter->name, context->name) > 0) {
+            next = &iter->siblings;
+            break;
         }
     }
 
     kref_get(&ctrl->refs);
-    list_add_tail(&context->siblings, &ctrl->context_list);
+    list_add_tail(&context->siblings, next);
+    rcu_assign_pointer(ctrl->contexts[context->index], context);
 
-exit:
     context->ctrl = ctrl;
     spin_unlock(&ctrl->lock);
 
@@ -432,6 +495,7 @@ static bool usb_store_remove_context (
     list_for_each_entry(iter, &ctrl->context_list, siblings) {
         if (iter == context) {
             list_del(&context->siblings);
+            RCU_INIT_POINTER(ctrl->contexts[context->index], NULL);
             removed = true;
             goto exit;
         }
@@ -443,6 +507,8 @@ exit:
     if (removed) {
         LIGHTS_DBG("Removed context from controller");
 
+        /* Lookups already holding the context keep it, its index is free */
+        ida_free(&ctrl->slots, context->index);
         kref_put(&ctrl->refs, usb_controller_destroy);
         context->ctrl = NULL;
     } else {
@@ -491,6 +557,7 @@ static int usb_controller_callback_create (
                 goto error;
 
             kref_init(&cb->refs);
+            cb->client = client;
             cb->type = type;
             cb->func = func;
 
@@ -560,8 +627,9 @@ static void usb_controller_callback_remove (
 /**
  * usb_controller_callback_invoke() - Calls each callback of a given type
  *
- * @ctrl: Owning container
- * @type: Type of callback to call
+ * @ctrl:  Owning container
+ * @type:  Type of callback to call
+ * @index: Index of the context raising the event
  *
  * Each callback is added to a temporary list so that a spin lock doesn't
  * need to be held. Since all driver callbacks are mutually exlusive, we
@@ -572,7 +640,8 @@ static void usb_controller_callback_remove (
  */
 static void usb_controller_callback_invoke (
     struct usb_controller *ctrl,
-    enum usb_callback_type type
+    enum usb_callback_type type,
+    uint8_t index
 ){
     LIST_HEAD(queue);
     struct usb_callback *iter, *safe;
@@ -598,7 +667,7 @@ static void usb_controller_callback_invoke (
     spin_unlock(&ctrl->lock);
 
     list_for_each_entry_safe(iter, safe, &queue, queue_node) {
-        iter->func(iter->client);
+        iter->func(iter->client, index);
         kref_put(&iter->refs, usb_controller_callback_destroy);
     }
 }
@@ -628,17 +697,171 @@ static inline enum ctrl_state read_state (
 }
 
 
-#define ctrl_wait_event(ctx, event) \
+#define ctrl_wait_event(ctx, event, timeout) \
 ({                                                      \
     error_t __err = 0;                                  \
     long __timeout = wait_event_interruptible_timeout(  \
-        (ctx)->completion, event, 5 * HZ                \
+        (ctx)->completion, event, timeout               \
     );                                                  \
     if (__timeout == 0)                                 \
         __err = -ETIMEDOUT;                             \
+    else if (__timeout < 0)                             \
+        __err = __timeout;                              \
     __err;                                              \
 })
 
+/**
+ * usb_latency_record() - Adds a sample to a histogram
+ *
+ * @latency: Histogram to update
+ * @start:   Time the transfer was submitted
+ *
+ * Safe to call from interrupt context.
+ */
+static void usb_latency_record (
+    struct usb_latency *latency,
+    ktime_t start
+){
+    uint32_t usecs = clamp_t(s64, ktime_us_delta(ktime_get(), start), 0, U32_MAX);
+    unsigned int bucket = usecs ? min_t(unsigned int, ilog2(usecs), USB_LATENCY_BUCKETS - 1) : 0;
+    unsigned long flags;
+    int32_t delta;
+
+    spin_lock_irqsave(&latency->lock, flags);
+
+    latency->buckets[bucket]++;
+    latency->count++;
+    latency->max = max(latency->max, usecs);
+
+    if (!latency->srtt) {
+        latency->srtt = usecs << 3;
+        latency->rttvar = usecs << 1;
+    } else {
+        delta = usecs - (latency->srtt >> 3);
+        latency->srtt += delta;
+        latency->rttvar += abs(delta) - (latency->rttvar >> 2);
+    }
+
+    spin_unlock_irqrestore(&latency->lock, flags);
+}
+
+/**
+ * usb_latency_timeout() - Calculates how long to wait for transfers
+ *
+ * @latency: Histogram of the endpoint
+ * @period:  Microseconds between transfers of the endpoint
+ * @packets: Number of transfers waited for
+ *
+ * @return: Timeout in jiffies
+ *
+ * Until the device has been observed, the full timeout_ms is given.
+ */
+static unsigned long usb_latency_timeout (
+    struct usb_latency *latency,
+    unsigned int period,
+    unsigned int packets
+){
+    uint64_t ceiling = max_t(uint64_t, READ_ONCE(timeout_ms), 1) * USEC_PER_MSEC;
+    uint64_t usecs = ceiling;
+    unsigned long flags;
+
+    spin_lock_irqsave(&latency->lock, flags);
+
+    if (latency->srtt) {
+        usecs = (latency->srtt >> 3) + latency->rttvar + (uint64_t)period * packets;
+        usecs = min(max_t(uint64_t, usecs, USB_TIMEOUT_MIN_US), ceiling);
+    }
+
+    spin_unlock_irqrestore(&latency->lock, flags);
+
+    return usecs_to_jiffies(usecs);
+}
+
+/**
+ * usb_latency_timed_out() - Records a wait which timed out
+ *
+ * @latency: Histogram of the endpoint
+ *
+ * The deviation is doubled, backing off each successive wait until
+ * it reaches the ceiling.
+ */
+static void usb_latency_timed_out (
+    struct usb_latency *latency
+){
+    unsigned long flags;
+
+    spin_lock_irqsave(&latency->lock, flags);
+
+    latency->timeouts++;
+    latency->rttvar = min_t(uint64_t, (uint64_t)latency->rttvar * 2 + USB_TIMEOUT_MIN_US, U32_MAX);
+
+    spin_unlock_irqrestore(&latency->lock, flags);
+}
+
+/**
+ * usb_latency_show() - Prints a histogram
+ *
+ * @m:       Output file
+ * @name:    Name of the endpoint
+ * @latency: Histogram to print
+ * @period:  Microseconds between transfers of the endpoint
+ */
+static void usb_latency_show (
+    struct seq_file *m,
+    const char *name,
+    struct usb_latency *latency,
+    unsigned int period
+){
+    struct usb_latency copy;
+    unsigned long flags;
+    unsigned int i;
+
+    spin_lock_irqsave(&latency->lock, flags);
+    copy = *latency;
+    spin_unlock_irqrestore(&latency->lock, flags);
+
+    seq_printf(m, "%s: samples %llu, max %uus, mean %uus, deviation %uus, timeouts %u, timeout %ums\n",
+        name,
+        copy.count,
+        copy.max,
+        copy.srtt >> 3,
+        copy.rttvar >> 2,
+        copy.timeouts,
+        jiffies_to_msecs(usb_latency_timeout(latency, period, 1))
+    );
+
+    for (i = 0; i < USB_LATENCY_BUCKETS; i++) {
+        if (!copy.buckets[i])
+            continue;
+
+        if (i == USB_LATENCY_BUCKETS - 1)
+            seq_printf(m, "  %8u+       us: %u\n", 1U << i, copy.buckets[i]);
+        else
+            seq_printf(m, "  %8u-%-8uus: %u\n", i ? 1U << i : 0, (2U << i) - 1, copy.buckets[i]);
+    }
+}
+
+/**
+ * usb_context_latency_show() - Prints /sys/kernel/debug/lights-usb/___/latency
+ *
+ * @m:      Output file
+ * @unused: Unused
+ *
+ * @return: Error code
+ */
+static int usb_context_latency_show (
+    struct seq_file *m,
+    void *unused
+){
+    struct usb_context *context = m->private;
+
+    usb_latency_show(m, "out", &context->out_latency, context->interrupt_out.period);
+    usb_latency_show(m, "in", &context->in_latency, context->interrupt_in.period);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(usb_context_latency);
+
 /**
  * urb_check_status() - Reads any URB error and adds it to the context
  *
@@ -675,68 +898,124 @@ static void usb_context_write_packet_callback (
     struct urb *urb
 ){
     struct usb_context *context = urb->context;
-    urb_check_status(urb);
+    int i;
+
+    if (!urb_check_status(urb)) {
+        for (i = 0; i < USB_OUT_URBS; i++) {
+            if (context->out_pool[i] == urb) {
+                usb_latency_record(&context->out_latency, context->out_stamp[i]);
+                break;
+            }
+        }
+    }
 
-    context->interrupt_out.done = true;
+    atomic_dec(&context->out_inflight);
     wake_up_interruptible(&context->completion);
 }
 
 /**
- * usb_context_write_packet() - Sends a write URB to the device
+ * usb_context_flush_packets() - Waits for every queued packet to be sent
+ *
+ * @context: Owning context
+ *
+ * @return: Error code of any packet since the last flush
+ */
+static error_t usb_context_flush_packets (
+    struct usb_context *context
+){
+    unsigned long timeout;
+    error_t err = 0;
+
+    timeout = usb_latency_timeout(
+        &context->out_latency,
+        context->interrupt_out.period,
+        atomic_read(&context->out_inflight)
+    );
+
+    if (!usb_wait_anchor_empty_timeout(&context->out_anchor, jiffies_to_msecs(timeout))) {
+        LIGHTS_ERR("Waiting for interrupt OUT timed out");
+        usb_latency_timed_out(&context->out_latency);
+        usb_kill_anchored_urbs(&context->out_anchor);
+        err = -ETIMEDOUT;
+    }
+
+    /* Remove arror from context */
+    if (context->error) {
+        if (!err)
+            err = (context->error == -EPIPE) ? -EPIPE : -EIO;
+        context->error = 0;
+    }
+
+    return err;
+}
+
+/**
+ * usb_context_write_packet() - Queues a write URB to the device
  *
  * @context: Owning context
  * @packet:  Data to send
  *
  * @return: Error code
+ *
+ * Up to USB_OUT_URBS packets are given to the host controller at once,
+ * only once they are all in flight does this wait for the oldest. Any
+ * transfer error is reported by usb_context_flush_packets().
  */
 static error_t usb_context_write_packet (
     struct usb_context *context,
     struct usb_packet const *packet
 ){
     size_t packet_size = context->packet_size;
+    struct urb *urb;
     error_t err;
 
     if (packet->length < packet_size)
         packet_size = packet->length;
 
-    /* Reset the completion flags */
-    context->interrupt_out.done = false;
+    /* Interrupt URBs complete in order, so the next is the oldest */
+    err = ctrl_wait_event(
+        context,
+        atomic_read(&context->out_inflight) < USB_OUT_URBS,
+        usb_latency_timeout(&context->out_latency, context->interrupt_out.period, 1)
+    );
+    if (err) {
+        LIGHTS_ERR("Waiting for interrupt OUT error: %d", err);
+        if (err == -ETIMEDOUT)
+            usb_latency_timed_out(&context->out_latency);
+        usb_kill_anchored_urbs(&context->out_anchor);
+        return err;
+    }
+
+    urb = context->out_pool[context->out_next];
+    context->out_stamp[context->out_next] = ktime_get();
+    context->out_next = (context->out_next + 1) % USB_OUT_URBS;
 
-    /* Write data into interput_out */
-    memcpy(context->interrupt_out.buffer, packet->data, packet_size);
+    /* Write data straight into the urbs DMA buffer */
+    memcpy(urb->transfer_buffer, packet->data, packet_size);
 
-    /* Fill the urb (callback should set a completion flag) */
+    /* Fill the urb (callback decrements the inflight count) */
     usb_fill_int_urb(
-        context->interrupt_out.urb,
+        urb,
         context->udev,
         context->interrupt_out.pipe,
-        context->interrupt_out.buffer,
+        urb->transfer_buffer,
         packet_size,
         usb_context_write_packet_callback,
         context,
         context->interrupt_out.interval
     );
 
-    // dump_packet("Sending Packet:", ctx->interrupt_out.buffer, packet_size);
+    // dump_packet("Sending Packet:", urb->transfer_buffer, packet_size);
 
     /* Send the urb */
-    err = usb_submit_urb(context->interrupt_out.urb, GFP_KERNEL);
-    if (err) {
-        LIGHTS_ERR("Failed to submit OUT urb: %d", err);
-        return err;
-    }
+    usb_anchor_urb(urb, &context->out_anchor);
+    atomic_inc(&context->out_inflight);
 
-    /* Wait for completion flag */
-    err = ctrl_wait_event(context, context->interrupt_out.done);
+    err = usb_submit_urb(urb, GFP_KERNEL);
     if (err) {
-        LIGHTS_ERR("Waiting for interrupt OUT error: %d", err);
-        return err;
-    }
-
-    /* Remove arror from context */
-    if (context->error) {
-        context->error = 0;
-        err = (err == -EPIPE) ? err : -EIO;
+        LIGHTS_ERR("Failed to submit OUT urb: %d", err);
+        usb_unanchor_urb(urb);
+        atomic_dec(&context->out_inflight);
     }
 
     return err;
@@ -748,114 +1027,349 @@ static error_t usb_context_write_packet (
  * @urb: URB being processed
  *
  * @context: interrupt
+ *
+ * Responses are only kept while a request is waiting for one, anything
+ * else the device sends is dropped. The URB is then posted again. Any
+ * URB not posted again is removed from the count of posted URBs.
  */
 static void usb_context_read_packet_callback (
     struct urb *urb
 ){
     struct usb_context *context = urb->context;
+    unsigned long flags;
+    uint8_t *slot;
+
+    switch (urb->status) {
+        case 0:
+            break;
+        case -ENOENT:
+        case -ECONNRESET:
+        case -ESHUTDOWN:
+            /* Killed, the ring is posted again on resume */
+            goto retired;
+        default:
+            /* Left idle until usb_context_post_reads() finds none posted */
+            LIGHTS_DBG("NonZero interrupt IN status: %d", urb->status);
+            goto retired;
+    }
+
+    spin_lock_irqsave(&context->in_lock, flags);
+
+    if (context->in_received != context->in_requested) {
+        usb_latency_record(&context->in_latency, context->in_stamp[context->in_received % USB_IN_SLOTS]);
+        slot = context->in_ring + (context->in_received % USB_IN_SLOTS) * context->packet_size;
+        memcpy(slot, urb->transfer_buffer, min_t(size_t, urb->actual_length, context->packet_size));
+        context->in_received++;
+    }
 
-    LIGHTS_DBG("Processing read callback");
-    urb_check_status(urb);
+    spin_unlock_irqrestore(&context->in_lock, flags);
 
-    context->interrupt_in.done = true;
     wake_up_interruptible(&context->completion);
+
+    if (STATE_IDLE != read_state(context))
+        goto retired;
+
+    usb_anchor_urb(urb, &context->in_anchor);
+    if (!usb_submit_urb(urb, GFP_ATOMIC))
+        return;
+
+    usb_unanchor_urb(urb);
+
+retired:
+    /* Readers waiting on a dead ring must not wait out their timeout */
+    if (atomic_dec_and_test(&context->in_posted))
+        wake_up_interruptible(&context->completion);
+}
+
+/**
+ * usb_context_post_reads() - Posts the IN ring to the device
+ *
+ * @context: Owning context
+ *
+ * @return: Error code
+ *
+ * Does nothing while any URB of the ring is still posted. The count of
+ * posted URBs is used rather than the anchor, which a completing URB
+ * leaves before its callback decides whether to post it again.
+ */
+static error_t usb_context_post_reads (
+    struct usb_context *context
+){
+    struct urb *urb;
+    error_t err = 0;
+    int i;
+
+    if (atomic_read(&context->in_posted))
+        return 0;
+
+    for (i = 0; i < USB_IN_URBS; i++) {
+        urb = context->in_pool[i];
+
+        usb_fill_int_urb(
+            urb,
+            context->udev,
+            context->interrupt_in.pipe,
+            urb->transfer_buffer,
+            context->packet_size,
+            usb_context_read_packet_callback,
+            context,
+            context->interrupt_in.interval
+        );
+
+        usb_anchor_urb(urb, &context->in_anchor);
+        atomic_inc(&context->in_posted);
+
+        err = usb_submit_urb(urb, GFP_KERNEL);
+        if (err) {
+            LIGHTS_ERR("Failed to submit IN urb: %d", err);
+            atomic_dec(&context->in_posted);
+            usb_unanchor_urb(urb);
+            break;
+        }
+    }
+
+    return err;
+}
+
+/**
+ * usb_context_request_read() - Reserves the response to the next packet
+ *
+ * @context: Owning context
+ *
+ * @return: Sequence number of the response
+ */
+static uint32_t usb_context_request_read (
+    struct usb_context *context
+){
+    unsigned long flags;
+    uint32_t seq;
+
+    spin_lock_irqsave(&context->in_lock, flags);
+    seq = context->in_requested++;
+    context->in_stamp[seq % USB_IN_SLOTS] = ktime_get();
+    spin_unlock_irqrestore(&context->in_lock, flags);
+
+    return seq;
 }
 
 /**
- * usb_context_read_packet() - Reads data from the device
+ * usb_context_cancel_reads() - Forgets every outstanding request
+ *
+ * @context: Owning context
+ */
+static void usb_context_cancel_reads (
+    struct usb_context *context
+){
+    unsigned long flags;
+
+    spin_lock_irqsave(&context->in_lock, flags);
+    context->in_requested = context->in_received;
+    spin_unlock_irqrestore(&context->in_lock, flags);
+}
+
+/**
+ * usb_context_read_packet() - Reads a response from the IN ring
  *
  * @context: Owning context
  * @packet:  Buffer to populate
+ * @seq:     Value returned by usb_context_request_read()
  *
  * @return: Error code
+ *
+ * The device answers requests in order, so the Nth response received
+ * belongs to the Nth request. Should a response never arrive, the
+ * outstanding requests are forgotten.
  */
 static error_t usb_context_read_packet (
     struct usb_context *context,
-    struct usb_packet *packet
+    struct usb_packet *packet,
+    uint32_t seq
 ){
-    error_t err;
     size_t packet_size = context->packet_size;
+    unsigned long flags, timeout;
+    int32_t ahead;
+    error_t err;
 
     if (packet->length < packet_size)
         packet_size = packet->length;
 
-    context->interrupt_in.done = false;
+    /* Responses arrive in order, allow for those ahead of this one */
+    ahead = seq - READ_ONCE(context->in_received);
+    timeout = usb_latency_timeout(
+        &context->in_latency,
+        context->interrupt_in.period,
+        ahead > 0 ? ahead + 1 : 1
+    );
 
-    usb_fill_int_urb(
-        context->interrupt_in.urb,
-        context->udev,
-        context->interrupt_in.pipe,
-        context->interrupt_in.buffer,
-        packet_size,
-        usb_context_read_packet_callback,
+    /* Wait for the response, or for the ring to die */
+    err = ctrl_wait_event(
         context,
-        context->interrupt_in.interval
+        (int32_t)(READ_ONCE(context->in_received) - seq) > 0 || !atomic_read(&context->in_posted),
+        timeout
     );
+    if (err == -ETIMEDOUT)
+        usb_latency_timed_out(&context->in_latency);
 
-    /* Send the urb */
-    err = usb_submit_urb(context->interrupt_in.urb, GFP_KERNEL);
-    if (err) {
-        LIGHTS_ERR("Failed to submit IN urb: %d", err);
-        return err;
-    }
+    spin_lock_irqsave(&context->in_lock, flags);
+
+    if (!err && (int32_t)(context->in_received - seq) <= 0)
+        err = -EIO;
 
-    /* Wait for completion flag */
-    err = ctrl_wait_event(context, context->interrupt_in.done);
     if (err) {
         LIGHTS_ERR("Waiting for interrupt IN error: %d", err);
-        return err;
+        context->in_requested = context->in_received;
+    } else if (context->in_received - seq > USB_IN_SLOTS) {
+        err = -EOVERFLOW;
+    } else {
+        memcpy(packet->data, context->in_ring + (seq % USB_IN_SLOTS) * context->packet_size, packet_size);
     }
 
-    /* Remove arror from context */
-    if (context->error) {
-        context->error = 0;
-        err = (err == -EPIPE) ? err : -EIO;
-    }
-
-    if (!err)
-        memcpy(packet->data, context->interrupt_in.buffer, packet_size);
+    spin_unlock_irqrestore(&context->in_lock, flags);
 
     return err;
 }
 
+enum usb_xfer_flags {
+    XFER_QUEUE = 0,     /* Return once the packet is queued */
+    XFER_WAIT  = 1,     /* Wait for every queued packet */
+    XFER_READ  = 3,     /* Wait, then read a response */
+};
+
 /**
  * usb_context_read_write() - Writes and Reads the device
  *
  * @context: Owning context
- * @packet:  Input/Output packet
- * @do_read: Flag to indicate if a read should be performed after the write
+ * @packet:  Input/Output packet, NULL to only wait
+ * @flags:   One of the XFER_ constants
  *
  * @return: Error code
  */
 static error_t usb_context_read_write (
     struct usb_context *context,
     struct usb_packet const *packet,
-    bool do_read
+    enum usb_xfer_flags flags
 ){
+    uint32_t seq = 0;
     error_t err = 0;
 
-    if (IS_NULL(context, packet))
+    if (IS_NULL(context) || IS_TRUE(!packet && flags != XFER_WAIT))
         return -EINVAL;
 
-    if (packet->length > context->packet_size)
+    if (packet && packet->length > context->packet_size)
         return -E2BIG;
 
     /* Allow only one thread at a time */
     err = mutex_lock_interruptible(&context->lock);
     if (err)
-        goto error_out;
+        return err;
 
     if (STATE_IDLE != read_state(context)) {
         err = -EIO;
         goto error_out;
     }
 
+    /* The response is received by the IN ring */
+    if (flags == XFER_READ) {
+        err = usb_context_post_reads(context);
+        if (err)
+            goto error_out;
+
+        seq = usb_context_request_read(context);
+    }
+
     /* Send the packet */
-    err = usb_context_write_packet(context, packet);
+    if (packet)
+        err = usb_context_write_packet(context, packet);
+
+    /* Even on error, nothing may remain in flight */
+    if (flags & XFER_WAIT) {
+        error_t flushed = usb_context_flush_packets(context);
+        if (!err)
+            err = flushed;
+    }
 
     /* Read a response */
-    if (!err && do_read)
-        err = usb_context_read_packet(context, (void*)packet);
+    if (!err && flags == XFER_READ)
+        err = usb_context_read_packet(context, (void*)packet, seq);
+    else if (flags == XFER_READ)
+        usb_context_cancel_reads(context);
+
+error_out:
+    mutex_unlock(&context->lock);
+
+    return err;
+}
+
+/**
+ * usb_context_write_packets() - Transfers a sequence of packets
+ *
+ * @context: Owning context
+ * @packets: Array of packets, those flagged read receive a response
+ * @count:   Number of @packets
+ *
+ * @return: Error code
+ *
+ * Every packet is queued under a single hold of the lock and awaited
+ * once. Responses are collected from the IN ring after the last write,
+ * so reads overlap the writes which follow them.
+ */
+static error_t usb_context_write_packets (
+    struct usb_context *context,
+    struct usb_packet *packets,
+    size_t count
+){
+    uint32_t seq = 0;
+    size_t i, reads = 0;
+    error_t err, flushed;
+
+    for (i = 0; i < count; i++) {
+        if (packets[i].length > context->packet_size)
+            return -E2BIG;
+        if (packets[i].read)
+            reads++;
+    }
+
+    /* Every response must fit within the ring */
+    if (reads > USB_IN_SLOTS)
+        return -E2BIG;
+
+    err = mutex_lock_interruptible(&context->lock);
+    if (err)
+        return err;
+
+    if (STATE_IDLE != read_state(context)) {
+        err = -EIO;
+        goto error_out;
+    }
+
+    if (reads) {
+        err = usb_context_post_reads(context);
+        if (err)
+            goto error_out;
+
+        seq = context->in_requested;
+    }
+
+    for (i = 0; i < count && !err; i++) {
+        if (packets[i].read)
+            usb_context_request_read(context);
+
+        err = usb_context_write_packet(context, &packets[i]);
+    }
+
+    /* Even on error, nothing may remain in flight */
+    flushed = usb_context_flush_packets(context);
+    if (!err)
+        err = flushed;
+
+    /* Responses arrive in the order they were requested */
+    for (i = 0; i < count && !err && reads; i++) {
+        if (packets[i].read)
+            err = usb_context_read_packet(context, &packets[i], seq++);
+    }
+
+    if (err && reads)
+        usb_context_cancel_reads(context);
 
 error_out:
     mutex_unlock(&context->lock);
@@ -879,7 +1393,7 @@ static int usb_driver_register (
     struct usb_device *udev = interface_to_usbdev(intf);
     struct usb_host_interface *iface_desc = intf->cur_altsetting;
     struct usb_context *context = NULL;
-    int err;
+    int err, i;
 
     LIGHTS_DBG("USB connecting: %s", dev_name(&udev->dev));
 
@@ -888,15 +1402,32 @@ static int usb_driver_register (
     if (!context)
         return -ENOMEM;
 
+    /* Clients address the device by this index until it disconnects */
+    err = ida_alloc_max(&ctrl->slots, USB_MAX_CONTEXTS - 1, GFP_KERNEL);
+    if (err < 0) {
+        LIGHTS_ERR("No index left for '%s'", dev_name(&udev->dev));
+        kfree(context);
+        return err;
+    }
+
+    context->index = err;
+
     kref_init(&context->refs);
     atomic_set(&context->state, STATE_IDLE);
-    context->udev = udev;
+    context->udev = usb_get_dev(udev);
     context->packet_size = ctrl->packet_size;
     context->name = kstrdup_const(dev_name(&udev->dev), GFP_KERNEL);
 
     /* Init the readers */
     mutex_init(&context->lock);
     init_waitqueue_head(&context->completion);
+    init_usb_anchor(&context->out_anchor);
+    init_usb_anchor(&context->in_anchor);
+    atomic_set(&context->in_posted, 0);
+    spin_lock_init(&context->in_lock);
+    spin_lock_init(&context->out_latency.lock);
+    spin_lock_init(&context->in_latency.lock);
+    atomic_set(&context->out_inflight, 0);
 
     /* Initialize the IN endpoint */
     err = usb_find_int_in_endpoint(iface_desc, &context->interrupt_in.endpoint);
@@ -907,9 +1438,17 @@ static int usb_driver_register (
 
     context->interrupt_in.pipe = usb_rcvintpipe(udev, context->interrupt_in.endpoint->bEndpointAddress);
     context->interrupt_in.interval = context->interrupt_in.endpoint->bInterval;
-    context->interrupt_in.urb = usb_alloc_urb(0, GFP_KERNEL);
-    context->interrupt_in.buffer = kzalloc(ctrl->packet_size, GFP_KERNEL);
-    if (!(context->interrupt_in.urb && context->interrupt_in.buffer)) {
+    context->interrupt_in.period = usb_decode_interval(context->interrupt_in.endpoint, udev->speed);
+    for (i = 0; i < USB_IN_URBS; i++) {
+        context->in_pool[i] = usb_context_alloc_urb(context);
+        if (!context->in_pool[i]) {
+            err = -ENOMEM;
+            goto error;
+        }
+    }
+
+    context->in_ring = kcalloc(USB_IN_SLOTS, ctrl->packet_size, GFP_KERNEL);
+    if (!context->in_ring) {
         err = -ENOMEM;
         goto error;
     }
@@ -923,11 +1462,14 @@ static int usb_driver_register (
 
     context->interrupt_out.pipe = usb_sndintpipe(udev, context->interrupt_out.endpoint->bEndpointAddress);
     context->interrupt_out.interval = context->interrupt_out.endpoint->bInterval;
-    context->interrupt_out.urb = usb_alloc_urb(0, GFP_KERNEL);
-    context->interrupt_out.buffer = kzalloc(ctrl->packet_size, GFP_KERNEL);
-    if (!(context->interrupt_out.urb && context->interrupt_out.buffer)) {
-        err = -ENOMEM;
-        goto error;
+    context->interrupt_out.period = usb_decode_interval(context->interrupt_out.endpoint, udev->speed);
+
+    for (i = 0; i < USB_OUT_URBS; i++) {
+        context->out_pool[i] = usb_context_alloc_urb(context);
+        if (!context->out_pool[i]) {
+            err = -ENOMEM;
+            goto error;
+        }
     }
 
     /* we can register the device now, as it is ready */
@@ -940,6 +1482,18 @@ static int usb_driver_register (
     /* Context already has a ref count of 1 */
     usb_set_intfdata(intf, context);
 
+    /* Responses are collected from now on */
+    mutex_lock(&context->lock);
+    if (usb_context_post_reads(context))
+        LIGHTS_WARN("IN ring of '%s' will be posted on first read", context->name);
+    mutex_unlock(&context->lock);
+
+    /* Latency histograms, removed on disconnect */
+    if (!IS_ERR_OR_NULL(usb_debugfs)) {
+        context->debugfs = debugfs_create_dir(dev_name(&intf->dev), usb_debugfs);
+        debugfs_create_file("latency", 0444, context->debugfs, context, &usb_context_latency_fops);
+    }
+
     /* Increase the ref count of the ctrl */
     usb_store_add_context(ctrl, context);
 
@@ -949,11 +1503,12 @@ static int usb_driver_register (
     wake_up_interruptible_all(&ctrl->probe_wait);
 
     /* Call all registered callbacks */
-    usb_controller_callback_invoke(ctrl, CALLBACK_CONNECT);
+    usb_controller_callback_invoke(ctrl, CALLBACK_CONNECT, context->index);
 
     return err;
 
 error:
+    ida_free(&ctrl->slots, context->index);
     kref_put(&context->refs, usb_context_destroy);
 
     return err;
@@ -974,11 +1529,13 @@ static int usb_driver_connect (
     struct usb_controller *ctrl;
     int ret;
 
-    /* Container is reference counted */
-    ctrl = usb_store_find_controller_by_id(id);
-    if (!ctrl)
+    /* The probing driver is embedded in its controller */
+    if (IS_NULL(intf->dev.driver))
         return -ENODEV;
 
+    ctrl = container_of(to_usb_driver(intf->dev.driver), struct usb_controller, usb_driver);
+    kref_get(&ctrl->refs);
+
     ret = usb_driver_register(intf, ctrl);
 
     kref_put(&ctrl->refs, usb_controller_destroy);
@@ -1012,15 +1569,19 @@ static void usb_driver_disconnect (
     /* Prevent any new readers writers */
     atomic_set(&context->state, STATE_EXITING);
 
+    /* Waits for any reader of the histograms */
+    debugfs_remove_recursive(context->debugfs);
+    context->debugfs = NULL;
+
     /* Cancel all existing transfers */
-    usb_kill_urb(context->interrupt_in.urb);
-    usb_kill_urb(context->interrupt_out.urb);
+    usb_kill_anchored_urbs(&context->in_anchor);
+    usb_kill_anchored_urbs(&context->out_anchor);
 
     /* There should be nothing waiting, but just in-case */
     wake_up_interruptible_all(&context->completion);
 
     /* Call all registered callbacks */
-    usb_controller_callback_invoke(ctrl, CALLBACK_DISCONNECT);
+    usb_controller_callback_invoke(ctrl, CALLBACK_DISCONNECT, context->index);
 
     /* Give back the minor */
     usb_deregister_dev(intf, &ctrl->class_driver);
@@ -1060,11 +1621,11 @@ static int usb_driver_suspend (
 
     atomic_set(&context->state, STATE_PAUSED);
 
-    usb_kill_urb(context->interrupt_in.urb);
-    usb_kill_urb(context->interrupt_out.urb);
+    usb_kill_anchored_urbs(&context->in_anchor);
+    usb_kill_anchored_urbs(&context->out_anchor);
 
     /* Call all registered callbacks */
-    usb_controller_callback_invoke(context->ctrl, CALLBACK_SUSPEND);
+    usb_controller_callback_invoke(context->ctrl, CALLBACK_SUSPEND, context->index);
 
     return 0;
 }
@@ -1097,8 +1658,13 @@ static int usb_driver_resume (
 
     LIGHTS_INFO("USB resuming '%s'", context->name);
 
+    mutex_lock(&context->lock);
+    usb_context_cancel_reads(context);
+    usb_context_post_reads(context);
+    mutex_unlock(&context->lock);
+
     /* Call all registered callbacks */
-    usb_controller_callback_invoke(context->ctrl, CALLBACK_RESUME);
+    usb_controller_callback_invoke(context->ctrl, CALLBACK_RESUME, context->index);
 
     return 0;
 
@@ -1167,7 +1733,7 @@ error_t usb_read_packet (
     if (IS_ERR(context))
         return PTR_ERR(context);
 
-    err = usb_context_read_write(context, packet, true);
+    err = usb_context_read_write(context, packet, XFER_READ);
     kref_put(&context->refs, usb_context_destroy);
 
     return err;
@@ -1195,7 +1761,91 @@ error_t usb_write_packet (
     if (IS_ERR(context))
         return PTR_ERR(context);
 
-    err = usb_context_read_write(context, packet, false);
+    err = usb_context_read_write(context, packet, XFER_WAIT);
+    kref_put(&context->refs, usb_context_destroy);
+
+    return err;
+}
+
+/**
+ * usb_queue_packet() - Queues a packet to a device
+ *
+ * @client: Previously registered client
+ * @packet: Data to send
+ *
+ * @return: Error code
+ */
+error_t usb_queue_packet (
+    struct usb_client const *client,
+    struct usb_packet const *packet
+){
+    struct usb_context *context;
+    error_t err;
+
+    if (IS_NULL(client, packet))
+        return -EINVAL;
+
+    context = usb_store_find_context(client);
+    if (IS_ERR(context))
+        return PTR_ERR(context);
+
+    err = usb_context_read_write(context, packet, XFER_QUEUE);
+    kref_put(&context->refs, usb_context_destroy);
+
+    return err;
+}
+
+/**
+ * usb_write_packets() - Transfers a sequence of packets to a device
+ *
+ * @client:  Previously registered client
+ * @packets: Array of packets
+ * @count:   Number of @packets
+ *
+ * @return: Error code
+ */
+error_t usb_write_packets (
+    struct usb_client const *client,
+    struct usb_packet *packets,
+    size_t count
+){
+    struct usb_context *context;
+    error_t err;
+
+    if (IS_NULL(client, packets) || IS_TRUE(0 == count))
+        return -EINVAL;
+
+    context = usb_store_find_context(client);
+    if (IS_ERR(context))
+        return PTR_ERR(context);
+
+    err = usb_context_write_packets(context, packets, count);
+    kref_put(&context->refs, usb_context_destroy);
+
+    return err;
+}
+
+/**
+ * usb_flush_packets() - Waits for queued packets to be sent
+ *
+ * @client: Previously registered client
+ *
+ * @return: Error code
+ */
+error_t usb_flush_packets (
+    struct usb_client const *client
+){
+    struct usb_context *context;
+    error_t err;
+
+    if (IS_NULL(client))
+        return -EINVAL;
+
+    context = usb_store_find_context(client);
+    if (IS_ERR(context))
+        return PTR_ERR(context);
+
+    err = usb_context_read_write(context, NULL, XFER_WAIT);
     kref_put(&context->refs, usb_context_destroy);
 
     return err;
@@ -1229,6 +1879,7 @@ static struct usb_controller *usb_store_create_controller (
     INIT_LIST_HEAD(&ctrl->context_list);
     INIT_LIST_HEAD(&ctrl->callback_list);
     spin_lock_init(&ctrl->lock);
+    ida_init(&ctrl->slots);
     atomic_set(&ctrl->controllers, 1);
     init_waitqueue_head(&ctrl->probe_wait);
 
@@ -1383,3 +2034,22 @@ void usb_controller_unregister (
     kref_put(&ctrl->refs, usb_controller_destroy);
     client->controller = NULL;
 }
+
+/**
+ * usb_driver_init() - Creates the debugfs directory
+ */
+void usb_driver_init (
+    void
+){
+    usb_debugfs = debugfs_create_dir("lights-usb", NULL);
+}
+
+/**
+ * usb_driver_exit() - Removes the debugfs directory
+ */
+void usb_driver_exit (
+    void
+){
+    debugfs_remove_recursive(usb_debugfs);
+    usb_debugfs = NULL;
+}
@@ -20,16 +20,21 @@ struct usb_client;
  *
  * @length: Length of @data
  * @data:   Raw byte array
+ * @read:   Replace @data with the response, see usb_write_packets()
  */
 struct usb_packet {
     size_t  length;
     char    *data;
+    bool    read;
 };
 
 /**
  * typedef usb_callback_t - Callback prototype
+ *
+ * The second argument is the index of the device raising the event,
+ * a client created with that index transfers to the same device.
  */
-typedef void (*usb_callback_t)(struct usb_client *);
+typedef void (*usb_callback_t)(struct usb_client *, uint8_t);
 
 /**
  * struct usb_client - Client data
@@ -93,6 +98,59 @@ error_t usb_write_packet (
     struct usb_packet const *packet
 );
 
+/**
+ * usb_queue_packet() - Queues a packet to the device
+ *
+ * @client: Previously registered client
+ * @packet: Data buffer to transfer
+ *
+ * @return: Error code
+ *
+ * The packet is copied and given to the host controller alongside any
+ * previously queued, this only blocks while too many are in flight. A
+ * call to usb_flush_packets() must follow the last packet, it returns
+ * the result of every packet queued since the last flush.
+ */
+error_t usb_queue_packet (
+    struct usb_client const *client,
+    struct usb_packet const *packet
+);
+
+/**
+ * usb_write_packets() - Transfers a sequence of packets to the device
+ *
+ * @client:  Previously registered client
+ * @packets: Array of packets to transfer
+ * @count:   Number of @packets
+ *
+ * @return: Error code
+ *
+ * This function is blocking.
+ *
+ * The device is checked and locked once, each packet is given to the
+ * host controller in turn and all are awaited together. Packets with
+ * the read flag have their data replaced by the response of the
+ * device, no more than 8 may be given at once.
+ */
+error_t usb_write_packets (
+    struct usb_client const *client,
+    struct usb_packet *packets,
+    size_t count
+);
+
+/**
+ * usb_flush_packets() - Waits for queued packets to be sent
+ *
+ * @client: Previously registered client
+ *
+ * @return: Error code of the first failed packet
+ *
+ * This function is blocking.
+ */
+error_t usb_flush_packets (
+    struct usb_client const *client
+);
+
 /**
  * usb_controller_register() - Registers a client
  *
@@ -125,4 +183,21 @@ void usb_controller_unregister (
     struct usb_client *client
 );
 
+/**
+ * usb_driver_init() - Prepares the USB drivers
+ *
+ * Creates /sys/kernel/debug/lights-usb/, within which each device
+ * has a latency file. Must be called before any client is registered.
+ */
+void usb_driver_init (
+    void
+);
+
+/**
+ * usb_driver_exit() - Releases what usb_driver_init() created
+ */
+void usb_driver_exit (
+    void
+);
+
 #endif
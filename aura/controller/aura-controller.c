@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0
 #include <linux/slab.h>
 #include <linux/kref.h>
+#include <linux/seqlock.h>
 
 #include <adapter/lights-adapter.h>
 #include "aura-controller.h"
@@ -75,6 +76,7 @@ struct aura_colors {
  * @effect:   A pointer into the ctrl->effect_colors->zone array
  * @direct:   A pointer into the ctrl->direct_colors->zone array
  * @context:  Owning context
+ * @lights:   Userland access registered for the zone, if any
  */
 struct aura_zone_context {
     struct aura_zone                zone;
@@ -83,6 +85,7 @@ struct aura_zone_context {
     struct lights_color             *effect;
     struct lights_color             *direct;
     struct aura_controller_context  *context;
+    struct lights_dev               *lights;
 
     struct lights_thunk             thunk;
 };
@@ -99,7 +102,7 @@ struct aura_zone_context {
  *
  * @ctrl:           Public object
  * @callback_pool:  Reserve of aura_callback_context
- * @lock:           Context spin lock
+ * @lock:           Sequence lock of the effect and colors
  * @effect:         Active effect
  * @zone_all:       One zone to rule them all
  * @zone_contexts:  Array of individual zones
@@ -109,13 +112,15 @@ struct aura_zone_context {
  * @zone_count:     Number of zones
  * @version:        Version of the control (determines some registers)
  * @lights_client:  Userland access
+ * @lights_lock:    Protects the @lights pointers of the context and zones
+ * @lights:         Userland access registered for the controller, if any
  * @name:           Interface name
  * @firmware:       Chipset name
  */
 struct aura_controller_context {
     struct aura_controller          ctrl;
 
-    struct mutex                    lock;
+    seqlock_t                       lock;
     struct lights_effect const      *effect;
     struct aura_zone_context        *zone_all;
     struct aura_zone_context        *zone_contexts;
@@ -130,6 +135,8 @@ struct aura_controller_context {
     uint8_t                         version;
 
     struct lights_adapter_client    lights_client;
+    spinlock_t                      lights_lock;
+    struct lights_dev               *lights;
     struct lights_thunk             thunk;
     char                            *name;
     char                            firmware[32];
@@ -610,7 +617,8 @@ struct aura_controller const *aura_controller_create (
     lights_thunk_init(&context->thunk, AURA_CTRL_HASH);
     memcpy(context->firmware, firmware, 16);
     memcpy(&context->lights_client, client, sizeof(*client));
-    mutex_init(&context->lock);
+    seqlock_init(&context->lock);
+    spin_lock_init(&context->lights_lock);
 
     err = lights_adapter_register(&context->lights_client, 32);
     if (err) {
@@ -923,6 +931,7 @@ error_t aura_controller_register_ctrl (
 ){
     struct aura_controller_context *ctx = ctrl_from_public(ctrl);
     struct lights_attribute attrs[4];
+    unsigned long flags;
     error_t err;
 
     if (IS_NULL(ctrl, lights))
@@ -956,12 +965,16 @@ error_t aura_controller_register_ctrl (
     );
 
     err = lights_device_create_files(lights, attrs, ARRAY_SIZE(attrs));
-    if (!err)
-        return 0;
+    if (err) {
+        lights_device_unregister(lights);
+        return err;
+    }
 
-    lights_device_unregister(lights);
+    spin_lock_irqsave(&ctx->lights_lock, flags);
+    ctx->lights = lights;
+    spin_unlock_irqrestore(&ctx->lights_lock, flags);
 
-    return err;
+    return 0;
 }
 
 /**
@@ -982,6 +995,7 @@ error_t aura_controller_register_zone (
 ){
     struct aura_zone_context *zone = zone_from_public(_zone);
     struct lights_attribute attrs[3];
+    unsigned long flags;
     error_t err;
 
     if (IS_NULL(_zone, lights, zone))
@@ -1010,12 +1024,70 @@ error_t aura_controller_register_zone (
     );
 
     err = lights_device_create_files(lights, attrs, ARRAY_SIZE(attrs));
-    if (!err)
-        return 0;
+    if (err) {
+        lights_device_unregister(lights);
+        return err;
+    }
+
+    spin_lock_irqsave(&zone->context->lights_lock, flags);
+    zone->lights = lights;
+    spin_unlock_irqrestore(&zone->context->lights_lock, flags);
+
+    return 0;
+}
+
+/**
+ * aura_controller_unregister_ctrl() - Removes the lights_fs of a controller
+ *
+ * @ctrl:   Controller previously registered
+ * @lights: Instance given to aura_controller_register_ctrl()
+ *
+ * Updates still in flight are no longer reported to @lights once this
+ * returns, so it may be freed before the controller is destroyed.
+ */
+void aura_controller_unregister_ctrl (
+    struct aura_controller const *ctrl,
+    struct lights_dev *lights
+){
+    struct aura_controller_context *ctx = ctrl_from_public(ctrl);
+    unsigned long flags;
+
+    if (IS_NULL(ctrl, lights))
+        return;
+
+    spin_lock_irqsave(&ctx->lights_lock, flags);
+    if (ctx->lights == lights)
+        ctx->lights = NULL;
+    spin_unlock_irqrestore(&ctx->lights_lock, flags);
 
     lights_device_unregister(lights);
+}
 
-    return err;
+/**
+ * aura_controller_unregister_zone() - Removes the lights_fs of a zone
+ *
+ * @zone:   Zone previously registered
+ * @lights: Instance given to aura_controller_register_zone()
+ *
+ * Updates still in flight are no longer reported to @lights once this
+ * returns, so it may be freed before the controller is destroyed.
+ */
+void aura_controller_unregister_zone (
+    struct aura_zone const *_zone,
+    struct lights_dev *lights
+){
+    struct aura_zone_context *zone = zone_from_public(_zone);
+    unsigned long flags;
+
+    if (IS_NULL(_zone, lights))
+        return;
+
+    spin_lock_irqsave(&zone->context->lights_lock, flags);
+    if (zone->lights == lights)
+        zone->lights = NULL;
+    spin_unlock_irqrestore(&zone->context->lights_lock, flags);
+
+    lights_device_unregister(lights);
 }
 
 
@@ -1046,6 +1118,79 @@ struct aura_zone const *aura_controller_get_zone (
 }
 
 
+/**
+ * aura_controller_submit() - Records an update with the devices it touches
+ *
+ * @ctx:  Controller about to queue a transfer
+ * @zone: Single zone written by the transfer, NULL for every zone
+ *
+ * A transfer to one zone is only tracked by the device of that zone, so
+ * pollers of the other zones are not woken by it. Transfers to the
+ * effect or to every color are tracked by every registered device.
+ */
+static void aura_controller_submit (
+    struct aura_controller_context *ctx,
+    struct aura_zone_context *zone
+){
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&ctx->lights_lock, flags);
+
+    if (zone && zone != ctx->zone_all) {
+        if (zone->lights)
+            lights_device_submit(zone->lights);
+        goto unlock;
+    }
+
+    if (ctx->lights)
+        lights_device_submit(ctx->lights);
+
+    /* zone_contexts holds zone_all as its final entry */
+    for (i = 0; i <= ctx->zone_count; i++) {
+        if (ctx->zone_contexts[i].lights)
+            lights_device_submit(ctx->zone_contexts[i].lights);
+    }
+
+unlock:
+    spin_unlock_irqrestore(&ctx->lights_lock, flags);
+}
+
+/**
+ * aura_controller_complete() - Records a completion with the devices it touches
+ *
+ * @ctx:   Controller whose transfer finished
+ * @zone:  Zone given to aura_controller_submit()
+ * @error: Result of the transfer
+ */
+static void aura_controller_complete (
+    struct aura_controller_context *ctx,
+    struct aura_zone_context *zone,
+    error_t error
+){
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&ctx->lights_lock, flags);
+
+    if (zone && zone != ctx->zone_all) {
+        if (zone->lights)
+            lights_device_complete(zone->lights, error);
+        goto unlock;
+    }
+
+    if (ctx->lights)
+        lights_device_complete(ctx->lights, error);
+
+    for (i = 0; i <= ctx->zone_count; i++) {
+        if (ctx->zone_contexts[i].lights)
+            lights_device_complete(ctx->zone_contexts[i].lights, error);
+    }
+
+unlock:
+    spin_unlock_irqrestore(&ctx->lights_lock, flags);
+}
+
 /**
  * aura_controller_set_zone_color_callback() - Async handler for color setting
  *
@@ -1069,7 +1214,7 @@ static void aura_controller_set_zone_color_callback (
 
     if (error) {
         AURA_DBG("Failed to set color");
-        return;
+        goto complete;
     }
 
     delta = zone->offset * 3;
@@ -1079,26 +1224,26 @@ static void aura_controller_set_zone_color_callback (
         target = &zone->context->effect_colors->zone[zone->offset];
     } else {
         AURA_ERR("Failed to detect color target");
-        return;
+        goto complete;
     }
 
     color_msg = adapter_seek_msg(result, 1);
     if (!color_msg) {
         AURA_ERR("Failed to seek message");
-        return;
+        goto complete;
     }
 
     if (zone->zone.id == ZONE_ID_ALL) {
         if (color_msg->length != zone->context->zone_count * 3) {
             AURA_ERR("Message has an invalid length '%d'", color_msg->length);
-            return;
+            goto complete;
         }
     } else if (color_msg->length != 3) {
         AURA_ERR("Message has an invalid length '%d'", color_msg->length);
-        return;
+        goto complete;
     }
 
-    mutex_lock(&zone->context->lock);
+    write_seqlock(&zone->context->lock);
 
     if (zone->zone.id == ZONE_ID_ALL) {
         for (i = 0; i < zone->context->zone_count; i++)
@@ -1107,7 +1252,10 @@ static void aura_controller_set_zone_color_callback (
         lights_color_read_rbg(target, color_msg->data.block);
     }
 
-    mutex_unlock(&zone->context->lock);
+    write_sequnlock(&zone->context->lock);
+
+complete:
+    aura_controller_complete(zone->context, zone, error);
 }
 
 /**
@@ -1162,6 +1310,8 @@ error_t aura_controller_set_zone_color (
         count = 2;
     }
 
+    aura_controller_submit(context, zone);
+
     err = lights_adapter_xfer_async(
         &context->lights_client,
         msgs,
@@ -1169,6 +1319,8 @@ error_t aura_controller_set_zone_color (
         &zone->thunk,
         aura_controller_set_zone_color_callback
     );
+    if (err)
+        aura_controller_complete(context, zone, err);
 
     return err;
 }
@@ -1190,6 +1342,7 @@ error_t aura_controller_get_zone_color (
 ){
     struct aura_zone_context *zone_ctx = zone_from_public(zone);
     struct aura_controller_context *context;
+    unsigned int seq;
 
     if (IS_NULL(zone, color))
         return -EINVAL;
@@ -1201,15 +1354,15 @@ error_t aura_controller_get_zone_color (
         return -EIO;
     }
 
-    mutex_lock(&context->lock);
+    do {
+        seq = read_seqbegin(&context->lock);
 
-    if (context->is_direct) {
-        *color = *zone_ctx->direct;
-    } else {
-        *color = *zone_ctx->effect;
-    }
-
-    mutex_unlock(&context->lock);
+        if (context->is_direct) {
+            *color = *zone_ctx->direct;
+        } else {
+            *color = *zone_ctx->effect;
+        }
+    } while (read_seqretry(&context->lock, seq));
 
     return 0;
 }
@@ -1237,7 +1390,7 @@ static void aura_controller_set_color_callback (
 
     if (error) {
         AURA_DBG("Failed to set color");
-        return;
+        goto complete;
     }
 
     if (result->data.word == ctrl->direct_colors->reg) {
@@ -1246,27 +1399,30 @@ static void aura_controller_set_color_callback (
         target = ctrl->effect_colors->zone;
     } else {
         AURA_ERR("Failed to detect color target");
-        return;
+        goto complete;
     }
 
     color_msg = adapter_seek_msg(result, 1);
     if (!color_msg) {
         AURA_ERR("Failed to seek message");
-        return;
+        goto complete;
     }
 
     if (color_msg->length != ctrl->zone_count * 3) {
         AURA_ERR("Message has an invalid length '%d'", color_msg->length);
-        return;
+        goto complete;
     }
 
-    mutex_lock(&ctrl->lock);
+    write_seqlock(&ctrl->lock);
 
     for (i = 0; i <= ctrl->zone_count; i++) {
         lights_color_read_rbg(&target[i], &color_msg->data.block[i * 3]);
     }
 
-    mutex_unlock(&ctrl->lock);
+    write_sequnlock(&ctrl->lock);
+
+complete:
+    aura_controller_complete(ctrl, NULL, error);
 }
 
 /**
@@ -1322,6 +1478,8 @@ error_t aura_controller_set_colors (
 
     AURA_DBG("Applying color 0x%06x to '%s' all zones", color->value, ctrl->name);
 
+    aura_controller_submit(ctrl, NULL);
+
     err = lights_adapter_xfer_async(
         &ctrl->lights_client,
         msgs,
@@ -1329,6 +1487,8 @@ error_t aura_controller_set_colors (
         &ctrl->thunk,
         aura_controller_set_color_callback
     );
+    if (err)
+        aura_controller_complete(ctrl, NULL, err);
 
     return err;
 }
@@ -1356,22 +1516,22 @@ static void aura_controller_set_effect_callback (
 
     if (error) {
         AURA_DBG("Failed to set mode");
-        return;
+        goto complete;
     }
 
     mode_msg = adapter_seek_msg(result, 1);
     if (!mode_msg) {
         AURA_ERR("Failed to seek message");
-        return;
+        goto complete;
     }
 
     aura_mode = mode_msg->data.byte;
     if (aura_mode_to_lights_effect(aura_mode, &lights_effect)) {
         AURA_ERR("Message contains an invalid mode '0x%02x'", aura_mode);
-        return;
+        goto complete;
     }
 
-    mutex_lock(&ctrl->lock);
+    write_seqlock(&ctrl->lock);
 
     if (aura_mode == AURA_MODE_DIRECT) {
         ctrl->is_direct = true;
@@ -1379,7 +1539,10 @@ static void aura_controller_set_effect_callback (
         ctrl->effect = lights_effect;
     }
 
-    mutex_unlock(&ctrl->lock);
+    write_sequnlock(&ctrl->lock);
+
+complete:
+    aura_controller_complete(ctrl, NULL, error);
 }
 
 /**
@@ -1437,6 +1600,8 @@ error_t aura_controller_set_effect (
         count += 2;
 
         // AURA_DBG("Queing %d messages to update mode", count);
+        aura_controller_submit(context, NULL);
+
         err = lights_adapter_xfer_async(
             &context->lights_client,
             msgs,
@@ -1444,6 +1609,8 @@ error_t aura_controller_set_effect (
             &context->thunk,
             aura_controller_set_effect_callback
         );
+        if (err)
+            aura_controller_complete(context, NULL, err);
     }
 
     return err;
@@ -1462,15 +1629,15 @@ error_t aura_controller_get_effect (
     struct lights_effect *effect
 ){
     struct aura_controller_context *ctx = ctrl_from_public(ctrl);
+    unsigned int seq;
 
     if (IS_NULL(ctrl, effect))
         return -EINVAL;
 
-    mutex_lock(&ctx->lock);
-
-    *effect = *ctx->effect;
-
-    mutex_unlock(&ctx->lock);
+    do {
+        seq = read_seqbegin(&ctx->lock);
+        *effect = *ctx->effect;
+    } while (read_seqretry(&ctx->lock, seq));
 
     return 0;
 }
@@ -1501,7 +1668,7 @@ static void aura_controller_update_callback (
 
     if (error) {
         AURA_DBG("Failed to update");
-        return;
+        goto complete;
     }
 
     msg = result;
@@ -1524,7 +1691,7 @@ static void aura_controller_update_callback (
 
                 if (aura_mode_to_lights_effect(aura_mode, &lights_effect)) {
                     AURA_ERR("Message contains an invalid effect '0x%02x'", aura_mode);
-                    return;
+                    goto complete;
                 }
             }
         }
@@ -1534,7 +1701,7 @@ static void aura_controller_update_callback (
 
     msg = adapter_seek_msg(msg, 1);
     if (msg && msg->length == context->zone_count * 3) {
-        mutex_lock(&context->lock);
+        write_seqlock(&context->lock);
 
         context->is_direct = is_direct;
 
@@ -1544,10 +1711,13 @@ static void aura_controller_update_callback (
         if (lights_effect)
             context->effect = lights_effect;
 
-        mutex_unlock(&context->lock);
+        write_sequnlock(&context->lock);
     } else {
         AURA_ERR("Failed to find color array in messages");
     }
+
+complete:
+    aura_controller_complete(context, NULL, error);
 }
 
 /**
@@ -1613,6 +1783,8 @@ error_t aura_controller_update (
         count += 2;
     }
 
+    aura_controller_submit(context, NULL);
+
     err = lights_adapter_xfer_async(
         &context->lights_client,
         msgs,
@@ -1620,6 +1792,8 @@ error_t aura_controller_update (
         &context->thunk,
         aura_controller_update_callback
     );
+    if (err)
+        aura_controller_complete(context, NULL, err);
 
     return err;
 }
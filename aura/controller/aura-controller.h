@@ -115,6 +115,28 @@ error_t aura_controller_register_zone (
     const char *name
 );
 
+/**
+ * aura_controller_unregister_ctrl() - Removes the lights_fs of a controller
+ *
+ * @ctrl:   Controller previously registered
+ * @lights: Instance given to aura_controller_register_ctrl()
+ */
+void aura_controller_unregister_ctrl (
+    struct aura_controller const *ctrl,
+    struct lights_dev *lights
+);
+
+/**
+ * aura_controller_unregister_zone() - Removes the lights_fs of a zone
+ *
+ * @zone:   Zone previously registered
+ * @lights: Instance given to aura_controller_register_zone()
+ */
+void aura_controller_unregister_zone (
+    struct aura_zone const *zone,
+    struct lights_dev *lights
+);
+
 /**
  * aura_controller_get_zone() - Fetches a zone by its index
  *
@@ -456,12 +456,12 @@ static void aura_gpu_zone_update_callback (
 
     if (error) {
         AURA_DBG("Failed to update: %s", ERR_NAME(error));
-        return;
+        goto complete;
     }
 
     if (!lights_adapter_msg_value(iter, MSG_BYTE_DATA, &gpu_mode)) {
         AURA_ERR("Failed to read mode from messages");
-        return;
+        goto complete;
     }
 
     if (AURA_GPU_DISABLE == lights_adapter_msg_read_flags(iter))
@@ -472,7 +472,7 @@ static void aura_gpu_zone_update_callback (
 
         if (!lights_adapter_msg_value(iter, MSG_BYTE_DATA, &color_bytes[i])) {
             AURA_ERR("Failed to read mode from messages");
-            return;
+            goto complete;
         }
     }
 
@@ -482,7 +482,7 @@ static void aura_gpu_zone_update_callback (
 
     if (aura_mode_to_lights_effect(gpu_mode, &effect)) {
         AURA_DBG("Not a valid aura mode 0x%02x", gpu_mode);
-        return;
+        goto complete;
     }
 
     state_dump("pre update:", &zone->state);
@@ -497,6 +497,9 @@ static void aura_gpu_zone_update_callback (
     spin_unlock(&zone->lock);
 
     state_dump("post update:", &zone->state);
+
+complete:
+    lights_device_complete(&zone->ctrl->lights, error);
 }
 
 /**
@@ -545,13 +548,19 @@ static error_t aura_gpu_zone_update (
     msgs[3] = ADAPTER_WRITE_BYTE_DATA(zone->reg.blue,  off ? 0 : state->color.b);
     msgs[4] = ADAPTER_WRITE_BYTE_DATA(zone->reg.apply, 0x01);
 
-    return lights_adapter_xfer_async(
+    lights_device_submit(&zone->ctrl->lights);
+
+    err = lights_adapter_xfer_async(
         &zone->ctrl->lights_client,
         msgs,
         count,
         &zone->thunk,
         aura_gpu_zone_update_callback
     );
+    if (err)
+        lights_device_complete(&zone->ctrl->lights, err);
+
+    return err;
 }
 
 /**
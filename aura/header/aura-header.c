@@ -9,6 +9,7 @@
  */
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/seqlock.h>
 
 #include <adapter/lights-adapter.h>
 #include <adapter/lights-interface.h>
@@ -19,8 +20,47 @@ static uint16_t header_led_count[5] = {60, 60, 60, 60, 60};
 module_param_array(header_led_count, short, NULL, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 MODULE_PARM_DESC(header_led_count, "An array of numbers representing the count of leds on each header.");
 
+static uint delta_threshold = 75;
+
+/**
+ * delta_threshold_set() - Parses a new delta_threshold
+ *
+ * @val: String written to the parameter
+ * @kp:  Parameter descriptor
+ *
+ * @return: Error code
+ *
+ * The value is a percentage, anything above 100 is rejected.
+ */
+static int delta_threshold_set (
+    const char *val,
+    const struct kernel_param *kp
+){
+    unsigned int value;
+    int err;
+
+    err = kstrtouint(val, 0, &value);
+    if (err)
+        return err;
+
+    if (value > 100)
+        return -ERANGE;
+
+    *(unsigned int *)kp->arg = value;
+
+    return 0;
+}
+
+static const struct kernel_param_ops delta_threshold_ops = {
+    .set = delta_threshold_set,
+    .get = param_get_uint,
+};
+
+module_param_cb(delta_threshold, &delta_threshold_ops, &delta_threshold, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(delta_threshold, "Percentage of a full frame's packets above which the whole strip is resent.");
+
 static inline struct aura_header_controller *aura_header_controller_get (
-    void
+    uint8_t index
 );
 static inline int aura_header_controller_put (
     struct aura_header_controller *ctrl
@@ -168,6 +208,9 @@ enum HEADER_CONSTS {
 
     MAX_SPEED_VALUE     = 5,
     MAX_HEADER_COUNT    = 5,
+
+    /* Unchanged leds between two dirty spans which are resent, rather than splitting the span */
+    DELTA_MAX_GAP       = PACKET_LED_COUNT / 2,
 };
 
 enum HEADER_CONTROL {
@@ -270,9 +313,13 @@ struct packet_data {
  * @pending:     Effect in the process of being written
  * @msg_buffer:  Buffer for multi packet transfer
  * @thunk:       Magic member for callbacks
- * @lock:        Lock for reading/writing effects and buffer
+ * @lock:        Lock for writing effects and buffer
+ * @active_lock: Sequence lock of @active, readers never block
+ * @committed:   Led colors last sent to the device
+ * @committed_valid: Flag to indicate @committed matches the device
+ * @inflight:    Number of transfers not yet completed
  * @led_count:   Number of LEDs configured for this zone
- * @name:        Name of the zone (argb-strip-X)
+ * @name:        Name of the zone (argb-strip-X, or argb-strip-N-X past the first device)
  * @id:          Zero based index of the zone
  */
 struct aura_header_zone {
@@ -283,9 +330,13 @@ struct aura_header_zone {
     struct lights_adapter_msg       *msg_buffer;
     struct lights_thunk             thunk;
     spinlock_t                      lock;
+    seqlock_t                       active_lock;
+    struct lights_color             *committed;
+    bool                            committed_valid;
+    atomic_t                        inflight;
 
     uint16_t                        led_count;
-    char                            name[16]; // "argb-strip-00"
+    char                            name[20]; // "argb-strip-255-00"
     uint8_t                         id;
 };
 #define ZONE_HASH 'ZONE'
@@ -293,10 +344,21 @@ struct aura_header_zone {
     lights_thunk_container(ptr, struct aura_header_zone, thunk, ZONE_HASH) \
 )
 
+/* Size of @msg_buffer, 20 leds per packet plus the enable and effect packets */
+#define ZONE_MSG_COUNT(zone) ( \
+    DIV_ROUND_UP((zone)->led_count, PACKET_LED_COUNT) + 2 \
+)
+
 /**
  * struct aura_header_controller - Storage for multiple zones
  *
+ * @siblings:     Next and prev pointers
+ * @client:       Access point to the device, by its index
+ * @connect:      Applies the state once the device has settled
+ * @disconnect:   Destroys the controller, unless the device returned
+ * @index:        Index of the device among those bound to the driver
  * @refs:         Reference counter
+ * @applied:      Flag to indicate the zones hold a state worth replaying
  * @oled_capable: Flag to indicate if USB is an oled screen
  * @oled_type:    Type of oled screen
  * @zone_count:   Number of zones
@@ -304,8 +366,13 @@ struct aura_header_zone {
  * @name:         Name of the controller, determined by device.
  */
 struct aura_header_controller {
-    // struct lights_adapter_client    *lights_client;
+    struct list_head                siblings;
+    struct lights_adapter_client    client;
+    struct delayed_work             connect;
+    struct delayed_work             disconnect;
+    uint8_t                         index;
     struct kref                     refs;
+    bool                            applied;
 
     bool                            oled_capable;
     uint8_t                         oled_type;
@@ -318,19 +385,17 @@ struct aura_header_controller {
 /**
  * struct aura_header_container - Global values
  *
- * @worker:    Job to execute when disconnect is detected
- * @client:    Access point to the device
- * @ctrl:      Controller of the device
- * @lock:      Access lock
- * @connected: Flag to indicate if connected/disconnected
+ * @client: Owner of the usb driver, receives the events of every device
+ * @ctrls:  Controller of each device
+ * @lock:   Lock for @ctrls
+ *
+ * Each device is transferred to through the client of its own
+ * controller, so every device has its own async queue.
  */
 struct aura_header_container {
-    struct delayed_work             connect;
-    struct delayed_work             disconnect;
     struct lights_adapter_client    client;
-    struct aura_header_controller   *ctrl;
+    struct list_head                ctrls;
     spinlock_t                      lock;
-    // bool                            connected;
 };
 
 /**
@@ -364,6 +429,7 @@ static struct lights_state const effect_default = {
 /**
  * usb_get_zone_count() - Fetches the number of available zones from device
  *
+ * @client:     Client of the device
  * @zone_count: Buffer to write to
  *
  * @return: Error code
@@ -372,6 +438,7 @@ static struct lights_state const effect_default = {
  * Each zone represents a single argb header on the board.
  */
 static int usb_get_zone_count (
+    struct lights_adapter_client *client,
     uint8_t *zone_count
 ){
     const uint8_t map[0x1E] = {
@@ -388,7 +455,7 @@ static int usb_get_zone_count (
 
     // packet_dump("Packet: ", packet);
 
-    err = lights_adapter_xfer(&global.client, &msg, 1);
+    err = lights_adapter_xfer(client, &msg, 1);
     if (err) {
         AURA_DBG("read failed with %d", err);
         return err;
@@ -423,12 +490,14 @@ static int usb_get_zone_count (
 /**
  * usb_get_name() - Reads the chpset name from the device
  *
- * @name: Output buffer
- * @len:  Length of @name
+ * @client: Client of the device
+ * @name:   Output buffer
+ * @len:    Length of @name
  *
  * @return: Error code
  */
 static error_t usb_get_name (
+    struct lights_adapter_client *client,
     char *name,
     size_t len
 ){
@@ -438,7 +507,7 @@ static error_t usb_get_name (
 
     packet = packet_init(&msg, PACKET_CMD_READ | PACKET_CMD_NAME);
 
-    err = lights_adapter_xfer(&global.client, &msg, 1);
+    err = lights_adapter_xfer(client, &msg, 1);
     if (err) {
         AURA_DBG("read failed with %d", err);
         return err;
@@ -461,6 +530,7 @@ static error_t usb_get_name (
 /**
  * usb_detect_oled() - Checks if device is an oled screen
  *
+ * @client:       Client of the device
  * @oled_capable: Output flag
  * @oled_type:    Output type
  *
@@ -469,6 +539,7 @@ static error_t usb_get_name (
  * NOTE - This needs testing. (ROG MAXIMUS XI EXTREME/FORMULA)
  */
 static error_t usb_detect_oled (
+    struct lights_adapter_client *client,
     bool *oled_capable,
     uint8_t *oled_type
 ){
@@ -478,7 +549,7 @@ static error_t usb_detect_oled (
 
     packet = packet_init(&msg, PACKET_CMD_READ | PACKET_CMD_OLED_CAPS);
 
-    err = lights_adapter_xfer(&global.client, &msg, 1);
+    err = lights_adapter_xfer(client, &msg, 1);
     if (err) {
         AURA_DBG("read failed with %d", err);
         return err;
@@ -526,7 +597,7 @@ static error_t usb_device_reset (
     packet = packet_init(&msg, PACKET_CMD_RESET);
     packet->data.raw[0] = 0xAA;
 
-    err = lights_adapter_xfer(&global.client, &msg, 1);
+    err = lights_adapter_xfer(&ctrl->client, &msg, 1);
     if (err) {
         AURA_DBG("lights_adapter_xfer() failed with %s", ERR_NAME(err));
         return err;
@@ -534,10 +605,12 @@ static error_t usb_device_reset (
 
     for (i = 0; i < ctrl->zone_count; i++) {
         spin_lock(&ctrl->zones[i].lock);
+        write_seqlock(&ctrl->zones[i].active_lock);
 
         ctrl->zones[i].active  = effect_default;
         ctrl->zones[i].pending = effect_default;
 
+        write_sequnlock(&ctrl->zones[i].active_lock);
         spin_unlock(&ctrl->zones[i].lock);
     }
 
@@ -641,55 +714,130 @@ static int _transfer_add_direct (
 
     return max_loops;
 }
+
+/**
+ * transfer_add_direct() - Creates packets to update a span of LEDs
+ *
+ * @msg:         Target Message array
+ * @zone:        Zone being updated
+ * @command:     Packet command byte
+ * @colors:      Array of zone->led_count colors, or NULL for black
+ * @first:       Index of the first LED in the span
+ * @color_count: Number of LEDs in the span
+ * @apply:       Flags the last packet to display the colors
+ *
+ * @return: Number of packets created
+ *
+ * Offsets above 255 carry their high bits in the packet flags, as
+ * _transfer_add_direct() does.
+ */
 static int transfer_add_direct (
-   struct lights_adapter_msg *msg,
-   struct aura_header_zone *zone,
-   uint8_t command,
-   struct lights_color const *colors,
-   uint8_t color_count
+    struct lights_adapter_msg *msg,
+    struct aura_header_zone *zone,
+    uint8_t command,
+    struct lights_color const *colors,
+    uint16_t first,
+    uint16_t color_count,
+    bool apply
+){
+    struct packet_data *packet;
+    struct data_direct *direct;
+    int packet_count = DIV_ROUND_UP(color_count, PACKET_LED_COUNT);
+    int curr_loop, i;
+
+    for (curr_loop = 0; curr_loop < packet_count; curr_loop++) {
+        msg[curr_loop] = ADAPTER_WRITE_BLOCK_DATA(MSG_FLAG_ENABLE, PACKET_SIZE);
+        packet = packet_init(&msg[curr_loop], command);
+
+        direct = &packet->data.direct;
+        direct->flags = zone->id;
+
+        if (first >= 0x100)
+            direct->flags = (first >> 8) & 0xf;
+
+        /* The device only displays the colors once flagged */
+        if (apply && curr_loop + 1 == packet_count)
+            direct->flags |= 0x80;
+
+        direct->offset = (uint8_t)first;
+        direct->count  = min_t(uint16_t, color_count, PACKET_LED_COUNT);
+
+        for (i = 0; i < direct->count; i++) {
+            if (colors)
+                lights_color_write_rgb(&colors[first + i], &direct->value[i * 3]);
+            else
+                memset(&direct->value[i * 3], 0, 3);
+        }
+
+        first       += direct->count;
+        color_count -= direct->count;
+    }
+
+    return packet_count;
+}
+
+/**
+ * transfer_add_delta() - Creates packets for only the changed LEDs
+ *
+ * @msg:    Target Message array
+ * @zone:   Zone being updated
+ * @colors: Array of zone->led_count colors
+ * @space:  Number of messages available in @msg
+ *
+ * @return: Number of packets created, or a negative error code when
+ *          sending the full strip is cheaper
+ *
+ * Each new frame is compared against the last committed to the device.
+ * Spans of changed LEDs, separated by less than DELTA_MAX_GAP unchanged
+ * ones, are merged and sent as direct packets. If more than
+ * delta_threshold percent of a full frame's packets would be needed,
+ * -E2BIG is returned and nothing is created. The same happens when
+ * the spans would not fit within @space.
+ */
+static int transfer_add_delta (
+    struct lights_adapter_msg *msg,
+    struct aura_header_zone *zone,
+    struct lights_color const *colors,
+    int space
 ){
-   struct packet_data *packet;
-   struct data_direct *direct;
-   size_t bytes_to_transfer = 3 * color_count;
-   size_t max_loops = (bytes_to_transfer / PACKET_DIRECT_SIZE) + 1;
-   size_t max_items_per_packet;
-   uint16_t src_offset = 0;
-   int curr_loop, i;
-
-   if (!color_count)
-       return -EINVAL;
-
-   max_items_per_packet = PACKET_DIRECT_SIZE / 3;
-
-   for (curr_loop = 0; curr_loop < max_loops; curr_loop++) {
-       msg[curr_loop] = ADAPTER_WRITE_BLOCK_DATA(MSG_FLAG_ENABLE, PACKET_SIZE);
-       packet = packet_init(&msg[curr_loop], command);
-
-       direct = &packet->data.direct;
-       direct->flags = zone->id;
-
-       /* NOTE - LightsService has this as only greater than */
-       if (src_offset >= 0x100)
-           direct->flags = (src_offset >> 8) & 0xf;
-
-       if (curr_loop + 1 == max_loops)
-           direct->flags |= 0x80;
-
-       direct->offset = (uint8_t)src_offset;
-       direct->count  = min_t(uint8_t, color_count, max_items_per_packet);
-
-       for (i = 0; i < direct->count; i++) {
-           if (colors) {
-               lights_color_write_rgb(colors, &direct->value[i * 3]);
-           } else {
-               memset(&direct->value[i * 3], 0, 3);
-           }
-           // direct->value[i] = data ? ((uint8_t*)data)[src_offset] : 0;
-           src_offset += 3;
-       }
-   }
-
-   return max_loops;
+    struct lights_color const *committed = zone->committed;
+    struct packet_data *packet;
+    uint16_t i = 0, start, end;
+    int count = 0, limit;
+
+    limit = DIV_ROUND_UP(zone->led_count, PACKET_LED_COUNT) * READ_ONCE(delta_threshold) / 100;
+    limit = min(limit, space);
+
+    while (i < zone->led_count) {
+        if (lights_color_equal(&colors[i], &committed[i])) {
+            i++;
+            continue;
+        }
+
+        start = i;
+        end = i + 1;
+
+        for (i = end; i < zone->led_count; i++) {
+            if (!lights_color_equal(&colors[i], &committed[i]))
+                end = i + 1;
+            else if (i + 1 - end >= DELTA_MAX_GAP)
+                break;
+        }
+
+        i = end;
+
+        if (count + DIV_ROUND_UP(end - start, PACKET_LED_COUNT) > limit)
+            return -E2BIG;
+
+        count += transfer_add_direct(&msg[count], zone, PACKET_CMD_DIRECT, colors, start, end - start, false);
+    }
+
+    if (count) {
+        packet = packet_cast(&msg[count - 1]);
+        packet->data.direct.flags |= 0x80;
+    }
+
+    return count;
 }
 
 /**
@@ -776,9 +924,15 @@ static void aura_header_zone_update_callback (
 
     if (error) {
         AURA_DBG("Failed to apply update: %s", ERR_NAME(error));
-        return;
+        /* The next frame is sent in full */
+        WRITE_ONCE(zone->committed_valid, false);
+        smp_mb__before_atomic();
+        atomic_dec(&zone->inflight);
+        goto complete;
     }
 
+    atomic_dec(&zone->inflight);
+
     packet = packet_cast(iter);
     if (MSG_FLAG_DISABLE == lights_adapter_msg_read_flags(iter))
         disable = true;
@@ -787,7 +941,7 @@ static void aura_header_zone_update_callback (
         iter = iter->next;
         if (!iter) {
             AURA_ERR("Expected second message following 'PACKET_CMD_ENABLE'");
-            return;
+            goto complete;
         }
         packet = packet_cast(iter);
     }
@@ -796,15 +950,15 @@ static void aura_header_zone_update_callback (
         mode = disable ? AURA_MODE_OFF : packet->data.effect.mode;
         if (aura_mode_to_lights_effect(mode, &effect)) {
             AURA_ERR("Message contains an invalid mode: 0x%02x", mode);
-            return;
+            goto complete;
         }
 
         if (disable || AURA_MODE_DIRECT == effect->value) {
             AURA_DBG("Applying mode only: %s", effect->name);
 
-            spin_lock(&zone->lock);
+            write_seqlock(&zone->active_lock);
             zone->active.effect = *effect;
-            spin_unlock(&zone->lock);
+            write_sequnlock(&zone->active_lock);
         } else {
             for (i = 0; i < ARRAY_SIZE(aura_speeds); i++) {
                 if (packet->data.effect.speed + 0x1A > aura_speeds[i]) {
@@ -821,14 +975,17 @@ static void aura_header_zone_update_callback (
 
             state_dump("Applying state: ", &state);
 
-            spin_lock(&zone->lock);
+            write_seqlock(&zone->active_lock);
             zone->active = state;
-            spin_unlock(&zone->lock);
+            write_sequnlock(&zone->active_lock);
         }
-    } else {
+    } else if (PACKET_CMD_DIRECT != packet->command) {
         AURA_ERR("Unexpected packet type: %x", packet->command);
         packet_dump("packet 2 post:", packet);
     }
+
+complete:
+    lights_device_complete(&zone->lights, error);
 }
 
 /**
@@ -849,6 +1006,7 @@ static error_t aura_header_zone_update (
 ){
     bool update_colors = false;
     size_t count = 0;
+    int written;
     error_t err;
     int i;
 
@@ -896,14 +1054,42 @@ static error_t aura_header_zone_update (
         }
     }
 
+    /*
+     * Any change of effect leaves the device showing other colors. Nor
+     * is @committed known to be on the device while a transfer is in
+     * flight, it may yet fail.
+     */
+    if (state || atomic_read(&zone->inflight))
+        zone->committed_valid = false;
+
+    /* Pairs with the failed callback, which invalidates before its decrement */
+    smp_rmb();
+
     if (colors || update_colors) {
-        count += transfer_add_direct(
-            &zone->msg_buffer[count],
-            zone,
-            PACKET_CMD_DIRECT,
-            colors,
-            zone->led_count
-        );
+        written = -E2BIG;
+        if (colors && READ_ONCE(zone->committed_valid))
+            written = transfer_add_delta(&zone->msg_buffer[count], zone, colors, ZONE_MSG_COUNT(zone) - count);
+
+        if (written < 0) {
+            written = transfer_add_direct(
+                &zone->msg_buffer[count],
+                zone,
+                PACKET_CMD_DIRECT,
+                colors,
+                0,
+                zone->led_count,
+                true
+            );
+        }
+
+        count += written;
+
+        if (colors && colors != zone->committed)
+            memcpy(zone->committed, colors, zone->led_count * sizeof(*colors));
+        else if (!colors)
+            memset(zone->committed, 0, zone->led_count * sizeof(*colors));
+
+        zone->committed_valid = true;
     }
 
     if (count) {
@@ -911,17 +1097,30 @@ static error_t aura_header_zone_update (
         for (i = 0; i < count; i++)
             packet_dump("packet:", &zone->msg_buffer[i]);
 
+        lights_device_submit(&zone->lights);
+        atomic_inc(&zone->inflight);
+
         err = lights_adapter_xfer_async(
-            &global.client,
+            &zone->ctrl->client,
             zone->msg_buffer,
             count,
             &zone->thunk,
             aura_header_zone_update_callback
         );
+        if (err) {
+            atomic_dec(&zone->inflight);
+            lights_device_complete(&zone->lights, err);
+        }
+    } else if (colors) {
+        /* Every led is already showing the requested color */
+        err = 0;
     } else {
         err = -EINVAL;
     }
 
+    if (err)
+        zone->committed_valid = false;
+
     /* Update the pending state */
     if (!err && state)
         zone->pending = *state;
@@ -1049,25 +1248,29 @@ static error_t aura_header_zone_read (
     struct lights_state *state
 ){
     struct aura_header_zone *zone = zone_from_thunk(thunk);
+    struct lights_state active;
+    unsigned int seq;
 
     if (IS_NULL(thunk, state, zone))
         return -EINVAL;
 
-    spin_lock(&zone->lock);
+    /* Never blocks the completion handler */
+    do {
+        seq = read_seqbegin(&zone->active_lock);
+        active = zone->active;
+    } while (read_seqretry(&zone->active_lock, seq));
 
     if (state->type & LIGHTS_TYPE_EFFECT)
-        state->effect = zone->active.effect;
+        state->effect = active.effect;
 
     if (state->type & LIGHTS_TYPE_COLOR)
-        state->color = zone->active.color;
+        state->color = active.color;
 
     if (state->type & LIGHTS_TYPE_SPEED)
-        state->speed = zone->active.speed;
+        state->speed = active.speed;
 
     if (state->type & LIGHTS_TYPE_DIRECTION)
-        state->direction = zone->active.direction;
-
-    spin_unlock(&zone->lock);
+        state->direction = active.direction;
 
     return 0;
 }
@@ -1097,7 +1300,7 @@ static error_t aura_header_zone_sync (
     transfer_add_sync(&msg, zone, state->sync);
 
     /* Should we send this as a blocking call */
-    return lights_adapter_xfer(&global.client, &msg, 1);
+    return lights_adapter_xfer(&zone->ctrl->client, &msg, 1);
 }
 
 /**
@@ -1160,14 +1363,16 @@ static error_t aura_header_controller_update (
             &pending
         );
 
-        err = lights_adapter_xfer(&global.client, &msg, 1);
+        err = lights_adapter_xfer(&ctrl->client, &msg, 1);
         if (err) {
             AURA_DBG("read failed with %d", err);
             return err;
         }
 
         if (!err) {
+            write_seqlock(&ctrl->zones[i].active_lock);
             ctrl->zones[i].active = pending;
+            write_sequnlock(&ctrl->zones[i].active_lock);
             ctrl->zones[i].pending = pending;
         }
     }
@@ -1175,19 +1380,79 @@ static error_t aura_header_controller_update (
     return 0;
 }
 
+/**
+ * aura_header_zone_replay() - Resends the last state of a zone
+ *
+ * @zone: Zone which the device has forgotten
+ *
+ * @return: Error code
+ *
+ * The pending effect is sent again and, in direct mode, the full
+ * committed frame with it.
+ */
+static error_t aura_header_zone_replay (
+    struct aura_header_zone *zone
+){
+    struct lights_state pending;
+    error_t err;
+
+    spin_lock(&zone->lock);
+
+    /* Whatever the device was showing has been lost */
+    zone->committed_valid = false;
+    pending = zone->pending;
+
+    err = aura_header_zone_update(
+        zone,
+        &pending,
+        AURA_MODE_DIRECT == pending.effect.value ? zone->committed : NULL
+    );
+
+    spin_unlock(&zone->lock);
+
+    return err;
+}
+
+/**
+ * aura_header_controller_replay() - Restores every zone after a reset
+ *
+ * @ctrl: Controller of the device
+ *
+ * The zones are queued behind a single plug, so the whole state is
+ * pipelined to the device as one burst.
+ */
+static void aura_header_controller_replay (
+    struct aura_header_controller *ctrl
+){
+    struct lights_adapter_plug plug;
+    error_t err;
+    int i;
+
+    lights_adapter_plug(&plug);
+
+    for (i = 0; i < ctrl->zone_count; i++) {
+        err = aura_header_zone_replay(&ctrl->zones[i]);
+        if (err)
+            AURA_ERR("Failed to replay '%s': %s", ctrl->zones[i].name, ERR_NAME(err));
+    }
+
+    lights_adapter_unplug(&plug);
+}
+
 
 /**
  * aura_header_zone_release() - Releases memory contained within a zone
  *
- * @zone: Zone being freed
+ * @zone: Zone being freed, already unregistered
  */
 static void aura_header_zone_release (
     struct aura_header_zone *zone
 ){
-    lights_device_unregister(&zone->lights);
-
     kfree(zone->msg_buffer);
     zone->msg_buffer = NULL;
+
+    kfree(zone->committed);
+    zone->committed = NULL;
 }
 
 /**
@@ -1244,21 +1509,29 @@ static error_t aura_header_zone_init (
 
     lights_thunk_init(&zone->thunk, ZONE_HASH);
     spin_lock_init(&zone->lock);
+    atomic_set(&zone->inflight, 0);
+    seqlock_init(&zone->active_lock);
 
     zone->id = index;
     zone->ctrl = ctrl;
     zone->led_count = header_led_count[index];
 
-    /* 20 leds per packet, plus one additional */
     zone->msg_buffer = kmalloc_array(
-        (zone->led_count / PACKET_LED_COUNT) + 2,
+        ZONE_MSG_COUNT(zone),
         sizeof(*zone->msg_buffer),
         GFP_KERNEL
     );
     if (!zone->msg_buffer)
         return -ENOMEM;
 
-    snprintf(zone->name, sizeof(zone->name), "argb-strip-%d", index);
+    zone->committed = kcalloc(zone->led_count, sizeof(*zone->committed), GFP_KERNEL);
+    if (!zone->committed)
+        return -ENOMEM;
+
+    if (ctrl->index)
+        snprintf(zone->name, sizeof(zone->name), "argb-strip-%u-%d", ctrl->index, index);
+    else
+        snprintf(zone->name, sizeof(zone->name), "argb-strip-%d", index);
     AURA_DBG("Creating sysfs for '%s'", zone->name);
 
     zone->lights.led_count = zone->led_count;
@@ -1276,31 +1549,51 @@ static error_t aura_header_zone_init (
 /**
  * aura_header_controller_destroy() - Destroys a controller and all zones
  *
- * @ctrl: Controller to destroy
+ * @ctrl: Controller to destroy, no longer listed
  */
 static void aura_header_controller_destroy (
     struct aura_header_controller *ctrl
 ){
     int i;
 
-    if (ctrl->zones && ctrl->zone_count) {
+    cancel_delayed_work_sync(&ctrl->connect);
+
+    if (ctrl->zones) {
+        for (i = 0; i < ctrl->zone_count; i++)
+            lights_device_unregister(&ctrl->zones[i].lights);
+    }
+
+    /* The queue goes before the buffers its jobs point into */
+    if (lights_adapter_is_registered(&ctrl->client))
+        lights_adapter_unregister(&ctrl->client);
+
+    if (ctrl->zones) {
         for (i = 0; i < ctrl->zone_count; i++)
             aura_header_zone_release(&ctrl->zones[i]);
         kfree(ctrl->zones);
     }
 
-    AURA_DBG("Destroyed AURA header controller");
+    AURA_DBG("Destroyed AURA header controller %u", ctrl->index);
 
     kfree(ctrl);
 }
 
+static void aura_header_driver_connect_worker (
+    struct work_struct *work
+);
+static void aura_header_driver_disconnect_worker (
+    struct work_struct *work
+);
+
 /**
  * aura_header_controller_create() - Creates a controller and all zones
  *
+ * @index: Index of the device among those bound to the driver
+ *
  * @return: Error code or created controller
  */
 static struct aura_header_controller *aura_header_controller_create (
-    void
+    uint8_t index
 ){
     struct aura_header_controller *ctrl;
     // struct lights_state state;
@@ -1312,19 +1605,29 @@ static struct aura_header_controller *aura_header_controller_create (
         return ERR_PTR(-ENOMEM);
 
     kref_init(&ctrl->refs);
+    INIT_LIST_HEAD(&ctrl->siblings);
+    INIT_DELAYED_WORK(&ctrl->connect, aura_header_driver_connect_worker);
+    INIT_DELAYED_WORK(&ctrl->disconnect, aura_header_driver_disconnect_worker);
+    ctrl->index = index;
 
-    err = usb_get_zone_count(&ctrl->zone_count);
-    if (err < 0)
+    /* The driver is already registered, this only adds a queue for the device */
+    ctrl->client = LIGHTS_USB_CLIENT_INDEX(driver_name, index, PACKET_SIZE, device_ids);
+
+    err = lights_adapter_register(&ctrl->client, 32);
+    if (err)
         goto error_free;
 
-    err = usb_get_name(ctrl->name, sizeof(ctrl->name));
+    err = usb_get_zone_count(&ctrl->client, &ctrl->zone_count);
     if (err < 0)
         goto error_free;
 
-    err = usb_detect_oled(&ctrl->oled_capable, &ctrl->oled_type);
+    err = usb_get_name(&ctrl->client, ctrl->name, sizeof(ctrl->name));
     if (err < 0)
         goto error_free;
 
+    err = usb_detect_oled(&ctrl->client, &ctrl->oled_capable, &ctrl->oled_type);
+    if (err < 0)
+        goto error_free;
     ctrl->zones = kcalloc(ctrl->zone_count, sizeof(struct aura_header_zone), GFP_KERNEL);
     if (!ctrl->zones)
         goto error_free;
@@ -1349,7 +1652,7 @@ static struct aura_header_controller *aura_header_controller_create (
     // lights_get_state(&state);
     // aura_header_controller_update(ctrl, &state);
 
-    AURA_DBG("Created AURA header controller");
+    AURA_DBG("Created AURA header controller %u", index);
 
     return ctrl;
 
@@ -1362,33 +1665,48 @@ error_free:
 /**
  * aura_header_controller_get() - Fetches a reference counted handle
  *
- * @return: Controller
+ * @index: Index of the device
+ *
+ * @return: NULL or the controller
  */
 static inline struct aura_header_controller *aura_header_controller_get (
-    void
+    uint8_t index
 ){
-    struct aura_header_controller *ctrl = NULL;
+    struct aura_header_controller *iter;
 
     spin_lock(&global.lock);
-    if (global.ctrl) {
-        ctrl = global.ctrl;
-        kref_get(&ctrl->refs);
+
+    list_for_each_entry(iter, &global.ctrls, siblings) {
+        if (iter->index == index) {
+            kref_get(&iter->refs);
+            goto found;
+        }
     }
+
+    iter = NULL;
+
+found:
     spin_unlock(&global.lock);
 
-    return ctrl;
+    return iter;
 }
 
 /**
  * aura_header_controller_put_kref() - kref_put callback
  *
  * @ref: Reference counter
+ *
+ * Called with the global lock held, it is released here so that
+ * the controller can be destroyed outside of it.
  */
 static void aura_header_controller_put_kref (
     struct kref *ref
 ){
     struct aura_header_controller *ctrl = container_of(ref, struct aura_header_controller, refs);
 
+    list_del_init(&ctrl->siblings);
+    spin_unlock(&global.lock);
+
     aura_header_controller_destroy(ctrl);
 }
 
@@ -1402,81 +1720,76 @@ static void aura_header_controller_put_kref (
 static inline int aura_header_controller_put (
     struct aura_header_controller *ctrl
 ){
-    return kref_put(&ctrl->refs, aura_header_controller_put_kref);
+    return kref_put_lock(&ctrl->refs, aura_header_controller_put_kref, &global.lock);
 }
 
 /**
  * aura_header_driver_connect_worker() - Updates a connected controller
  *
- * @work: Delayed work job
+ * @work: Delayed work job of the controller
+ *
+ * A new controller is given the global state. Once applied, a device
+ * coming back from a reset or suspend has its zones replayed instead.
+ * The work is cancelled before the controller is destroyed.
  */
 static void aura_header_driver_connect_worker (
     struct work_struct *work
 ){
-    struct aura_header_controller *ctrl;
+    struct aura_header_controller *ctrl = container_of(to_delayed_work(work), struct aura_header_controller, connect);
     error_t err;
 
-    ctrl = aura_header_controller_get();
-    if (ctrl) {
+    if (READ_ONCE(ctrl->applied)) {
+        aura_header_controller_replay(ctrl);
+    } else {
         err = aura_header_controller_update(ctrl);
         if (err) {
             AURA_ERR("Failed to apply state to controller: %s", ERR_NAME(err));
+        } else {
+            WRITE_ONCE(ctrl->applied, true);
         }
-
-        aura_header_controller_put(ctrl);
     }
 }
 
 /**
  * aura_header_driver_disconnect_worker() - Destroys a disconnected controller
  *
- * @work: Delayed work job
+ * @work: Delayed work job of the controller
  */
 static void aura_header_driver_disconnect_worker (
     struct work_struct *work
 ){
-    spin_lock(&global.lock);
-
-    if (global.ctrl && aura_header_controller_put(global.ctrl)) {
-        AURA_INFO("Destroyed global controller");
-        global.ctrl = NULL;
-    } else if (global.ctrl) {
-        AURA_INFO("Released handle (refs %d)", kref_read(&global.ctrl->refs));
-    }
+    struct aura_header_controller *ctrl = container_of(to_delayed_work(work), struct aura_header_controller, disconnect);
+    uint8_t index = ctrl->index;
 
-    spin_unlock(&global.lock);
+    if (aura_header_controller_put(ctrl))
+        AURA_INFO("Destroyed controller %u", index);
+    else
+        AURA_INFO("Released handle of controller %u", index);
 }
 
 /**
  * aura_header_driver_on_connect() - Device connection callback
  *
  * @client: Registered USB client
+ * @index:  Index of the connected device
  */
 static void aura_header_driver_on_connect (
-    struct usb_client *client
+    struct usb_client *client,
+    uint8_t index
 ){
     struct aura_header_controller *ctrl;
-    bool create = false;
 
-    spin_lock(&global.lock);
-    if (global.ctrl) {
-        /*
-         * A previous device disconnected but the 5 second
-         * destructor has not yet been invoked. Increase
-         * the ref count to cancel the destruction.
-         */
-         kref_get(&global.ctrl->refs);
-         AURA_INFO("Using existing USB controller (refs: %d)", kref_read(&global.ctrl->refs));
-    } else {
-        /*
-         * A previous controller was either destroyed or
-         * not yet created. Since both connect/disconnect
-         * are mutually exclusive, we don't need to worry
-         * about contention
-         */
-         create = true;
+    /*
+     * A previous device disconnected but the 5 second
+     * destructor has not yet been invoked. The reference
+     * taken here cancels the destruction.
+     */
+    ctrl = aura_header_controller_get(index);
+    if (ctrl) {
+        AURA_INFO("Using existing USB controller %u (refs: %d)", index, kref_read(&ctrl->refs));
+        mod_delayed_work(system_wq, &ctrl->connect, 0);
+        return;
     }
-    spin_unlock(&global.lock);
 
     /*
      * When a controller is created it needs the global state applying to it.
@@ -1491,45 +1804,70 @@ static void aura_header_driver_on_connect (
      * sleep the current thread. We need to delay the state update until
      * either enough time has passed or a reconnect event is detected.
      */
-    if (create) {
-        ctrl = aura_header_controller_create();
-        if (IS_ERR(ctrl)) {
-            CLEAR_ERR(ctrl);
-            return;
-        }
+    ctrl = aura_header_controller_create(index);
+    if (IS_ERR(ctrl)) {
+        CLEAR_ERR(ctrl);
+        return;
+    }
+
+    /* Connect and disconnect are mutually exclusive, no other can be listed */
+    spin_lock(&global.lock);
+    list_add_tail(&ctrl->siblings, &global.ctrls);
+    spin_unlock(&global.lock);
 
-        global.ctrl = ctrl;
-        AURA_INFO("Created global USB controller (refs: %d)", kref_read(&global.ctrl->refs));
+    AURA_INFO("Created USB controller %u (refs: %d)", index, kref_read(&ctrl->refs));
 
-        queue_delayed_work(system_wq, &global.connect, 1 * HZ);
-    } else {
-        mod_delayed_work(system_wq, &global.connect, 0);
-    }
+    queue_delayed_work(system_wq, &ctrl->connect, 1 * HZ);
 }
 
 /**
  * aura_header_driver_on_disconnect() - Device disconnect callback
  *
  * @client: Registered USB client
+ * @index:  Index of the disconnected device
  *
  * The controller is destroyed after a 5 second delay within a worker thread.
  * If a device is reconnected within this time frame, the controller is reused.
  */
 static void aura_header_driver_on_disconnect (
-    struct usb_client *client
+    struct usb_client *client,
+    uint8_t index
 ){
-    bool schedule = false;
-
-    spin_lock(&global.lock);
-    schedule = global.ctrl;
-    spin_unlock(&global.lock);
+    struct aura_header_controller *ctrl;
 
-    if (schedule) {
-        AURA_INFO("Scheduling destruction");
-        schedule_delayed_work(&global.disconnect, 5 * HZ);
-    } else {
+    ctrl = aura_header_controller_get(index);
+    if (!ctrl) {
         AURA_INFO("No controller to destruct");
+        return;
     }
+
+    AURA_INFO("Scheduling destruction of controller %u", index);
+    schedule_delayed_work(&ctrl->disconnect, 5 * HZ);
+
+    /* The list still holds the controller */
+    aura_header_controller_put(ctrl);
+}
+
+/**
+ * aura_header_driver_on_resume() - Device resume callback
+ *
+ * @client: Registered USB client
+ * @index:  Index of the resumed device
+ *
+ * The device may have lost its state while suspended.
+ */
+static void aura_header_driver_on_resume (
+    struct usb_client *client,
+    uint8_t index
+){
+    struct aura_header_controller *ctrl;
+
+    ctrl = aura_header_controller_get(index);
+    if (!ctrl)
+        return;
+
+    mod_delayed_work(system_wq, &ctrl->connect, 0);
+    aura_header_controller_put(ctrl);
 }
 
 /**
@@ -1538,6 +1876,9 @@ static void aura_header_driver_on_disconnect (
  * @state: Initial state of all zones
  *
  * @return: Error code
+ *
+ * The global client only registers the driver. Each device bound to
+ * it is given a controller with a client of its own.
  */
 error_t aura_header_probe (
     struct lights_state const *state
@@ -1548,13 +1889,12 @@ error_t aura_header_probe (
         .ids = device_ids,
         .on_connect = aura_header_driver_on_connect,
         .on_disconnect = aura_header_driver_on_disconnect,
+        .on_resume = aura_header_driver_on_resume,
     };
 
     LIGHTS_USB_CLIENT_INIT(&global.client, &usb);
-    INIT_DELAYED_WORK(&global.connect, aura_header_driver_connect_worker);
-    INIT_DELAYED_WORK(&global.disconnect, aura_header_driver_disconnect_worker);
+    INIT_LIST_HEAD(&global.ctrls);
     spin_lock_init(&global.lock);
-    global.ctrl = NULL;
 
     return lights_adapter_register(&global.client, 32);
 }
@@ -1565,23 +1905,29 @@ error_t aura_header_probe (
 void aura_header_release (
     void
 ){
-    struct aura_header_controller *ctrl = NULL;
+    struct aura_header_controller *ctrl;
+
+    /* Removes the callbacks, no controller is created or taken after this */
+    if (lights_adapter_is_registered(&global.client))
+        lights_adapter_unregister(&global.client);
 
-    /* Remove here to prevent 5 second delay */
     spin_lock(&global.lock);
-    ctrl = global.ctrl;
-    global.ctrl = NULL;
-    spin_unlock(&global.lock);
 
-    if (ctrl && aura_header_controller_put(ctrl))
-        AURA_INFO("Destroyed global controller");
+    while (!list_empty(&global.ctrls)) {
+        ctrl = list_first_entry(&global.ctrls, struct aura_header_controller, siblings);
+        list_del_init(&ctrl->siblings);
 
-    if (lights_adapter_is_registered(&global.client))
-        /* This should cause an on_disconnect event */
-        lights_adapter_unregister(&global.client);
+        /* Keeps a running destructor from freeing it */
+        kref_get(&ctrl->refs);
+        spin_unlock(&global.lock);
 
-    if (global.connect.work.func) {
-        cancel_delayed_work_sync(&global.connect);
-        cancel_delayed_work_sync(&global.disconnect);
+        /* Remove here to prevent 5 second delay */
+        cancel_delayed_work_sync(&ctrl->disconnect);
+        aura_header_controller_destroy(ctrl);
+        AURA_INFO("Destroyed controller");
+
+        spin_lock(&global.lock);
     }
+
+    spin_unlock(&global.lock);
 }
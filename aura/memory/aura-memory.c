@@ -584,10 +584,11 @@ exit:
 static void aura_memory_ctrl_destroy (
     struct aura_memory_controller *ctrl
 ){
-    if (ctrl->aura)
+    if (ctrl->aura) {
+        aura_controller_unregister_ctrl(ctrl->aura, &ctrl->lights);
         aura_controller_destroy(ctrl->aura);
+    }
 
-    lights_device_unregister(&ctrl->lights);
     kfree(ctrl);
 }
 
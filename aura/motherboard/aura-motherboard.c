@@ -59,7 +59,7 @@ struct aura_motherboard_zone {
 static void aura_motherboard_zone_destroy (
     struct aura_motherboard_zone *zone
 ){
-    lights_device_unregister(&zone->lights);
+    aura_controller_unregister_zone(zone->aura, &zone->lights);
     kfree(zone);
 }
 
@@ -0,0 +1,837 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * An emulated aura argb header controller, for use with dummy_hcd.
+ *
+ * Loading this module alongside dummy_hcd connects a device, with the
+ * vendor and product ids of the aura headers, to the dummy host. The
+ * lights-aura module binds to it exactly as it would the real thing,
+ * allowing the USB path to be measured on any machine.
+ *
+ *   modprobe dummy_hcd
+ *   insmod build/lights-aura-gadget.ko latency_us=250
+ *   cat /sys/kernel/debug/lights-aura-gadget/stats
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/usb/composite.h>
+
+#define LIGHTS_MODULE "lights-aura-gadget"
+#include <include/debug.h>
+
+static uint zones = 3;
+module_param(zones, uint, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(zones, "Number of argb headers reported, 1 to 4");
+
+static uint interval = 1;
+module_param(interval, uint, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(interval, "Polling interval of the endpoints, in milliseconds");
+
+static uint latency_us;
+module_param(latency_us, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(latency_us, "Microseconds taken to process each packet");
+
+static char *firmware = "AULA3-AR32-0207";
+module_param(firmware, charp, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(firmware, "Firmware name reported to the host");
+
+static bool oled;
+module_param(oled, bool, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(oled, "Report the device as having an oled screen");
+
+enum GADGET_CONSTS {
+    PACKET_SIZE         = 65,
+    PACKET_MAX_SIZE     = 64,
+    PACKET_BUFFER_SIZE  = PACKET_MAX_SIZE * 2,
+    PACKET_IN_REQS      = 4,
+    MAX_ZONES           = 4,
+};
+
+/* These mirror the commands of aura/header/aura-header.c */
+enum GADGET_CONTROL {
+    PACKET_CONTROL          = 0xEC,
+    PACKET_CMD_READ         = 0x80,
+
+    PACKET_CMD_NAME         = 0x02,
+    PACKET_CMD_CAPS         = 0x30,
+    PACKET_CMD_ENABLE       = 0x35,
+    PACKET_CMD_EFFECT       = 0x3B,
+    PACKET_CMD_SYNC         = 0x3C,
+    PACKET_CMD_RESET        = 0x3F,
+    PACKET_CMD_DIRECT       = 0x40,
+    PACKET_CMD_OLED_CAPS    = 0x50,
+};
+
+/* Value of the caps response from which the host derives the zone count */
+static uint8_t const zone_config[MAX_ZONES] = { 0x01, 0x03, 0x07, 0x0F };
+
+/**
+ * struct aura_gadget_stats - Counters of /sys/kernel/debug/___/stats
+ *
+ * @packets:   Number of packets received
+ * @direct:    Number of direct packets received
+ * @leds:      Number of led values received
+ * @effects:   Number of effect packets received
+ * @responses: Number of responses sent
+ * @dropped:   Number of responses dropped, the host did not read them
+ * @invalid:   Number of packets not understood
+ * @errors:    Number of failed transfers
+ */
+struct aura_gadget_stats {
+    uint64_t                        packets;
+    uint64_t                        direct;
+    uint64_t                        leds;
+    uint64_t                        effects;
+    uint64_t                        responses;
+    uint64_t                        dropped;
+    uint64_t                        invalid;
+    uint64_t                        errors;
+};
+
+/**
+ * struct aura_gadget - The emulated device
+ *
+ * @function: Composite function of the single interface
+ * @in_ep:    Interrupt IN endpoint
+ * @out_ep:   Interrupt OUT endpoint
+ * @out_req:  The single OUT request, packets are processed one at a time
+ * @in_reqs:  Requests carrying responses
+ * @in_free:  Bitmap of the unused @in_reqs
+ * @timer:    Delays each packet by latency_us
+ * @lock:     Lock for every member below
+ * @enabled:  Flag to indicate the host has configured the device
+ * @reply:    Response to the last read command
+ * @replying: Flag to indicate @reply is waiting to be sent
+ * @stats:    Counters
+ * @debugfs:  Directory of the stats file
+ */
+struct aura_gadget {
+    struct usb_function             function;
+    struct usb_ep                   *in_ep;
+    struct usb_ep                   *out_ep;
+    struct usb_request              *out_req;
+    struct usb_request              *in_reqs[PACKET_IN_REQS];
+    unsigned long                   in_free;
+    struct hrtimer                  timer;
+
+    spinlock_t                      lock;
+    bool                            enabled;
+    uint8_t                         reply[PACKET_SIZE];
+    bool                            replying;
+    struct aura_gadget_stats        stats;
+
+    struct dentry                   *debugfs;
+};
+
+static struct aura_gadget global;
+
+static struct usb_device_descriptor aura_gadget_device_desc = {
+    .bLength            = USB_DT_DEVICE_SIZE,
+    .bDescriptorType    = USB_DT_DEVICE,
+    .bcdUSB             = cpu_to_le16(0x0200),
+    .bDeviceClass       = USB_CLASS_PER_INTERFACE,
+    .idVendor           = cpu_to_le16(0x0b05),
+    .idProduct          = cpu_to_le16(0x1872),
+    .bcdDevice          = cpu_to_le16(0x0100),
+    .bNumConfigurations = 1,
+};
+
+static struct usb_string aura_gadget_strings[] = {
+    [USB_GADGET_MANUFACTURER_IDX].s = "AsusTek Computer Inc.",
+    [USB_GADGET_PRODUCT_IDX].s      = "AURA LED Controller",
+    [USB_GADGET_SERIAL_IDX].s       = "9876543210",
+    {  } /* Terminating entry */
+};
+
+static struct usb_gadget_strings aura_gadget_string_table = {
+    .language = 0x0409,
+    .strings  = aura_gadget_strings,
+};
+
+static struct usb_gadget_strings *aura_gadget_device_strings[] = {
+    &aura_gadget_string_table,
+    NULL,
+};
+
+/*
+ * The real device is HID, a vendor class keeps usbhid from claiming
+ * the emulated one. The aura driver matches on the ids alone.
+ */
+static struct usb_interface_descriptor aura_gadget_intf = {
+    .bLength            = USB_DT_INTERFACE_SIZE,
+    .bDescriptorType    = USB_DT_INTERFACE,
+    .bNumEndpoints      = 2,
+    .bInterfaceClass    = USB_CLASS_VENDOR_SPEC,
+};
+
+static struct usb_endpoint_descriptor aura_gadget_fs_in = {
+    .bLength            = USB_DT_ENDPOINT_SIZE,
+    .bDescriptorType    = USB_DT_ENDPOINT,
+    .bEndpointAddress   = USB_DIR_IN,
+    .bmAttributes       = USB_ENDPOINT_XFER_INT,
+    .wMaxPacketSize     = cpu_to_le16(PACKET_MAX_SIZE),
+    .bInterval          = 1,
+};
+
+static struct usb_endpoint_descriptor aura_gadget_fs_out = {
+    .bLength            = USB_DT_ENDPOINT_SIZE,
+    .bDescriptorType    = USB_DT_ENDPOINT,
+    .bEndpointAddress   = USB_DIR_OUT,
+    .bmAttributes       = USB_ENDPOINT_XFER_INT,
+    .wMaxPacketSize     = cpu_to_le16(PACKET_MAX_SIZE),
+    .bInterval          = 1,
+};
+
+static struct usb_endpoint_descriptor aura_gadget_hs_in = {
+    .bLength            = USB_DT_ENDPOINT_SIZE,
+    .bDescriptorType    = USB_DT_ENDPOINT,
+    .bmAttributes       = USB_ENDPOINT_XFER_INT,
+    .wMaxPacketSize     = cpu_to_le16(PACKET_MAX_SIZE),
+    .bInterval          = 4,
+};
+
+static struct usb_endpoint_descriptor aura_gadget_hs_out = {
+    .bLength            = USB_DT_ENDPOINT_SIZE,
+    .bDescriptorType    = USB_DT_ENDPOINT,
+    .bmAttributes       = USB_ENDPOINT_XFER_INT,
+    .wMaxPacketSize     = cpu_to_le16(PACKET_MAX_SIZE),
+    .bInterval          = 4,
+};
+
+static struct usb_descriptor_header *aura_gadget_fs_function[] = {
+    (struct usb_descriptor_header *) &aura_gadget_intf,
+    (struct usb_descriptor_header *) &aura_gadget_fs_in,
+    (struct usb_descriptor_header *) &aura_gadget_fs_out,
+    NULL,
+};
+
+static struct usb_descriptor_header *aura_gadget_hs_function[] = {
+    (struct usb_descriptor_header *) &aura_gadget_intf,
+    (struct usb_descriptor_header *) &aura_gadget_hs_in,
+    (struct usb_descriptor_header *) &aura_gadget_hs_out,
+    NULL,
+};
+
+static struct usb_configuration aura_gadget_config = {
+    .label               = "aura",
+    .bConfigurationValue = 1,
+    .bmAttributes        = USB_CONFIG_ATT_ONE | USB_CONFIG_ATT_SELFPOWER,
+    .MaxPower            = 100,
+};
+
+/**
+ * aura_gadget_reply() - Prepares the response to a read command
+ *
+ * @g:       The device
+ * @command: Command of the request, without PACKET_CMD_READ
+ *
+ * Must be called with the lock held.
+ */
+static void aura_gadget_reply (
+    struct aura_gadget *g,
+    uint8_t command
+){
+    uint8_t *raw = &g->reply[2];
+
+    memset(g->reply, 0, sizeof(g->reply));
+    g->reply[0] = PACKET_CONTROL;
+    g->reply[1] = command;
+
+    switch (command) {
+        case PACKET_CMD_CAPS:
+            raw[5] = zone_config[clamp_t(uint, zones, 1, MAX_ZONES) - 1];
+            break;
+        case PACKET_CMD_NAME:
+            strscpy((char *)raw, firmware, PACKET_SIZE - 2);
+            break;
+        case PACKET_CMD_OLED_CAPS:
+            raw[0] = oled;
+            break;
+    }
+
+    g->replying = true;
+}
+
+/**
+ * aura_gadget_handle() - Processes a packet sent by the host
+ *
+ * @g:      The device
+ * @packet: Received data
+ * @length: Length of @packet
+ *
+ * Must be called with the lock held.
+ */
+static void aura_gadget_handle (
+    struct aura_gadget *g,
+    uint8_t const *packet,
+    size_t length
+){
+    uint8_t command;
+
+    g->stats.packets++;
+
+    if (length < 5 || packet[0] != PACKET_CONTROL) {
+        g->stats.invalid++;
+        return;
+    }
+
+    command = packet[1];
+
+    switch (command) {
+        case PACKET_CMD_READ | PACKET_CMD_CAPS:
+        case PACKET_CMD_READ | PACKET_CMD_NAME:
+        case PACKET_CMD_READ | PACKET_CMD_OLED_CAPS:
+            aura_gadget_reply(g, command & ~PACKET_CMD_READ);
+            break;
+        case PACKET_CMD_DIRECT:
+            /* flags, offset, count, then count RGB values */
+            g->stats.direct++;
+            g->stats.leds += min_t(size_t, packet[4], (length - 5) / 3);
+            break;
+        case PACKET_CMD_EFFECT:
+            g->stats.effects++;
+            break;
+        case PACKET_CMD_ENABLE:
+        case PACKET_CMD_SYNC:
+        case PACKET_CMD_RESET:
+            break;
+        default:
+            g->stats.invalid++;
+            break;
+    }
+}
+
+/**
+ * aura_gadget_in_complete() - Response completion handler
+ *
+ * @ep:  IN endpoint
+ * @req: Request carrying the response
+ */
+static void aura_gadget_in_complete (
+    struct usb_ep *ep,
+    struct usb_request *req
+){
+    struct aura_gadget *g = ep->driver_data;
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&g->lock, flags);
+
+    for (i = 0; i < PACKET_IN_REQS; i++) {
+        if (g->in_reqs[i] == req)
+            __set_bit(i, &g->in_free);
+    }
+
+    if (req->status == 0)
+        g->stats.responses++;
+    else if (req->status != -ESHUTDOWN && req->status != -ECONNRESET)
+        g->stats.errors++;
+
+    spin_unlock_irqrestore(&g->lock, flags);
+}
+
+/**
+ * aura_gadget_continue() - Sends any response and accepts the next packet
+ *
+ * @g: The device
+ */
+static void aura_gadget_continue (
+    struct aura_gadget *g
+){
+    struct usb_request *req;
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&g->lock, flags);
+
+    if (!g->enabled)
+        goto exit;
+
+    if (g->replying) {
+        g->replying = false;
+
+        i = find_first_bit(&g->in_free, PACKET_IN_REQS);
+        if (i < PACKET_IN_REQS) {
+            req = g->in_reqs[i];
+            memcpy(req->buf, g->reply, PACKET_SIZE);
+            req->length = PACKET_SIZE;
+
+            __clear_bit(i, &g->in_free);
+            if (usb_ep_queue(g->in_ep, req, GFP_ATOMIC)) {
+                __set_bit(i, &g->in_free);
+                g->stats.errors++;
+            }
+        } else {
+            g->stats.dropped++;
+        }
+    }
+
+    if (usb_ep_queue(g->out_ep, g->out_req, GFP_ATOMIC))
+        g->stats.errors++;
+
+exit:
+    spin_unlock_irqrestore(&g->lock, flags);
+}
+
+/**
+ * aura_gadget_timer() - Ends the emulated processing time
+ *
+ * @timer: The devices timer
+ *
+ * @return: Never restarts
+ */
+static enum hrtimer_restart aura_gadget_timer (
+    struct hrtimer *timer
+){
+    aura_gadget_continue(container_of(timer, struct aura_gadget, timer));
+
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * aura_gadget_out_complete() - Packet reception handler
+ *
+ * @ep:  OUT endpoint
+ * @req: The OUT request
+ *
+ * The next packet is not accepted until latency_us has passed, so
+ * the host sees a device taking that long over each packet.
+ */
+static void aura_gadget_out_complete (
+    struct usb_ep *ep,
+    struct usb_request *req
+){
+    struct aura_gadget *g = ep->driver_data;
+    unsigned long flags;
+    uint latency;
+
+    switch (req->status) {
+        case 0:
+            spin_lock_irqsave(&g->lock, flags);
+            aura_gadget_handle(g, req->buf, req->actual);
+            spin_unlock_irqrestore(&g->lock, flags);
+            break;
+        case -ESHUTDOWN:
+        case -ECONNRESET:
+            /* Endpoint disabled */
+            return;
+        default:
+            spin_lock_irqsave(&g->lock, flags);
+            g->stats.errors++;
+            spin_unlock_irqrestore(&g->lock, flags);
+            break;
+    }
+
+    latency = READ_ONCE(latency_us);
+    if (latency)
+        hrtimer_start(&g->timer, us_to_ktime(latency), HRTIMER_MODE_REL_SOFT);
+    else
+        aura_gadget_continue(g);
+}
+
+/**
+ * aura_gadget_disable() - Disables both endpoints
+ *
+ * @f: The function
+ */
+static void aura_gadget_disable (
+    struct usb_function *f
+){
+    struct aura_gadget *g = container_of(f, struct aura_gadget, function);
+    unsigned long flags;
+
+    spin_lock_irqsave(&g->lock, flags);
+    g->enabled = false;
+    g->replying = false;
+    spin_unlock_irqrestore(&g->lock, flags);
+
+    /* A running timer sees the flag and does nothing */
+    hrtimer_try_to_cancel(&g->timer);
+
+    usb_ep_disable(g->in_ep);
+    usb_ep_disable(g->out_ep);
+}
+
+/**
+ * aura_gadget_set_alt() - Enables both endpoints
+ *
+ * @f:    The function
+ * @intf: Interface number
+ * @alt:  Alternate setting, always zero
+ *
+ * @return: Error code
+ */
+static int aura_gadget_set_alt (
+    struct usb_function *f,
+    unsigned intf,
+    unsigned alt
+){
+    struct aura_gadget *g = container_of(f, struct aura_gadget, function);
+    struct usb_gadget *gadget = f->config->cdev->gadget;
+    unsigned long flags;
+    int err;
+
+    if (g->enabled)
+        aura_gadget_disable(f);
+
+    /* A timer still running would queue out_req a second time */
+    hrtimer_cancel(&g->timer);
+
+    err = config_ep_by_speed(gadget, f, g->in_ep);
+    if (!err)
+        err = config_ep_by_speed(gadget, f, g->out_ep);
+    if (err)
+        return err;
+
+    err = usb_ep_enable(g->in_ep);
+    if (err)
+        return err;
+
+    err = usb_ep_enable(g->out_ep);
+    if (err) {
+        usb_ep_disable(g->in_ep);
+        return err;
+    }
+
+    spin_lock_irqsave(&g->lock, flags);
+    g->enabled = true;
+    g->in_free = GENMASK(PACKET_IN_REQS - 1, 0);
+    spin_unlock_irqrestore(&g->lock, flags);
+
+    err = usb_ep_queue(g->out_ep, g->out_req, GFP_ATOMIC);
+    if (err)
+        aura_gadget_disable(f);
+
+    return err;
+}
+
+/**
+ * aura_gadget_free_requests() - Releases every request
+ *
+ * @g: The device
+ */
+static void aura_gadget_free_requests (
+    struct aura_gadget *g
+){
+    int i;
+
+    if (g->out_req) {
+        kfree(g->out_req->buf);
+        usb_ep_free_request(g->out_ep, g->out_req);
+        g->out_req = NULL;
+    }
+
+    for (i = 0; i < PACKET_IN_REQS; i++) {
+        if (g->in_reqs[i]) {
+            kfree(g->in_reqs[i]->buf);
+            usb_ep_free_request(g->in_ep, g->in_reqs[i]);
+            g->in_reqs[i] = NULL;
+        }
+    }
+}
+
+/**
+ * aura_gadget_alloc_request() - Creates a request with a buffer
+ *
+ * @ep:       Owning endpoint
+ * @length:   Size of the buffer
+ * @complete: Completion handler
+ *
+ * @return: NULL or the request
+ */
+static struct usb_request *aura_gadget_alloc_request (
+    struct usb_ep *ep,
+    size_t length,
+    void (*complete)(struct usb_ep *, struct usb_request *)
+){
+    struct usb_request *req;
+
+    req = usb_ep_alloc_request(ep, GFP_KERNEL);
+    if (!req)
+        return NULL;
+
+    req->buf = kzalloc(length, GFP_KERNEL);
+    if (!req->buf) {
+        usb_ep_free_request(ep, req);
+        return NULL;
+    }
+
+    req->length = length;
+    req->complete = complete;
+
+    return req;
+}
+
+/**
+ * aura_gadget_function_bind() - Claims the interface and endpoints
+ *
+ * @c: Owning configuration
+ * @f: The function
+ *
+ * @return: Error code
+ */
+static int aura_gadget_function_bind (
+    struct usb_configuration *c,
+    struct usb_function *f
+){
+    struct aura_gadget *g = container_of(f, struct aura_gadget, function);
+    struct usb_gadget *gadget = c->cdev->gadget;
+    uint period = clamp_t(uint, interval, 1, 255);
+    int id, i, err;
+
+    id = usb_interface_id(c, f);
+    if (id < 0)
+        return id;
+
+    aura_gadget_intf.bInterfaceNumber = id;
+
+    g->in_ep = usb_ep_autoconfig(gadget, &aura_gadget_fs_in);
+    g->out_ep = usb_ep_autoconfig(gadget, &aura_gadget_fs_out);
+    if (!g->in_ep || !g->out_ep)
+        return -ENODEV;
+
+    g->in_ep->driver_data = g;
+    g->out_ep->driver_data = g;
+
+    /* Full speed counts frames, high speed 2^(N-1) micro frames */
+    aura_gadget_fs_in.bInterval = period;
+    aura_gadget_fs_out.bInterval = period;
+    aura_gadget_hs_in.bInterval = min_t(uint, ilog2(period * 8) + 1, 16);
+    aura_gadget_hs_out.bInterval = aura_gadget_hs_in.bInterval;
+    aura_gadget_hs_in.bEndpointAddress = aura_gadget_fs_in.bEndpointAddress;
+    aura_gadget_hs_out.bEndpointAddress = aura_gadget_fs_out.bEndpointAddress;
+
+    err = usb_assign_descriptors(f, aura_gadget_fs_function, aura_gadget_hs_function, NULL, NULL);
+    if (err)
+        return err;
+
+    /* A packet is larger than the endpoint, so is always a short transfer */
+    g->out_req = aura_gadget_alloc_request(g->out_ep, PACKET_BUFFER_SIZE, aura_gadget_out_complete);
+    if (!g->out_req)
+        goto error_free;
+
+    for (i = 0; i < PACKET_IN_REQS; i++) {
+        g->in_reqs[i] = aura_gadget_alloc_request(g->in_ep, PACKET_SIZE, aura_gadget_in_complete);
+        if (!g->in_reqs[i])
+            goto error_free;
+    }
+
+    LIGHTS_INFO("Emulating %u aura headers at %ums", clamp_t(uint, zones, 1, MAX_ZONES), period);
+
+    return 0;
+
+error_free:
+    aura_gadget_free_requests(g);
+    usb_free_all_descriptors(f);
+
+    return -ENOMEM;
+}
+
+/**
+ * aura_gadget_function_unbind() - Releases the endpoints
+ *
+ * @c: Owning configuration
+ * @f: The function
+ */
+static void aura_gadget_function_unbind (
+    struct usb_configuration *c,
+    struct usb_function *f
+){
+    struct aura_gadget *g = container_of(f, struct aura_gadget, function);
+
+    hrtimer_cancel(&g->timer);
+    aura_gadget_free_requests(g);
+    usb_free_all_descriptors(f);
+}
+
+/**
+ * aura_gadget_config_bind() - Adds the function to the configuration
+ *
+ * @c: The configuration
+ *
+ * @return: Error code
+ */
+static int aura_gadget_config_bind (
+    struct usb_configuration *c
+){
+    global.function = (struct usb_function) {
+        .name    = "aura",
+        .bind    = aura_gadget_function_bind,
+        .unbind  = aura_gadget_function_unbind,
+        .set_alt = aura_gadget_set_alt,
+        .disable = aura_gadget_disable,
+    };
+
+    return usb_add_function(c, &global.function);
+}
+
+/**
+ * aura_gadget_bind() - Composite driver bind handler
+ *
+ * @cdev: Composite device
+ *
+ * @return: Error code
+ */
+static int aura_gadget_bind (
+    struct usb_composite_dev *cdev
+){
+    int err;
+
+    err = usb_string_ids_tab(cdev, aura_gadget_strings);
+    if (err)
+        return err;
+
+    aura_gadget_device_desc.iManufacturer = aura_gadget_strings[USB_GADGET_MANUFACTURER_IDX].id;
+    aura_gadget_device_desc.iProduct = aura_gadget_strings[USB_GADGET_PRODUCT_IDX].id;
+    aura_gadget_device_desc.iSerialNumber = aura_gadget_strings[USB_GADGET_SERIAL_IDX].id;
+
+    return usb_add_config(cdev, &aura_gadget_config, aura_gadget_config_bind);
+}
+
+/**
+ * aura_gadget_unbind() - Composite driver unbind handler
+ *
+ * @cdev: Composite device
+ *
+ * @return: Error code
+ */
+static int aura_gadget_unbind (
+    struct usb_composite_dev *cdev
+){
+    return 0;
+}
+
+static struct usb_composite_driver aura_gadget_driver = {
+    .name      = "lights-aura-gadget",
+    .dev       = &aura_gadget_device_desc,
+    .strings   = aura_gadget_device_strings,
+    .max_speed = USB_SPEED_HIGH,
+    .bind      = aura_gadget_bind,
+    .unbind    = aura_gadget_unbind,
+};
+
+/**
+ * aura_gadget_stats_show() - Prints /sys/kernel/debug/lights-aura-gadget/stats
+ *
+ * @m:      Output file
+ * @unused: Unused
+ *
+ * @return: Error code
+ */
+static int aura_gadget_stats_show (
+    struct seq_file *m,
+    void *unused
+){
+    struct aura_gadget_stats stats;
+    unsigned long flags;
+
+    spin_lock_irqsave(&global.lock, flags);
+    stats = global.stats;
+    spin_unlock_irqrestore(&global.lock, flags);
+
+    seq_printf(m, "packets:   %llu\n", stats.packets);
+    seq_printf(m, "direct:    %llu\n", stats.direct);
+    seq_printf(m, "leds:      %llu\n", stats.leds);
+    seq_printf(m, "effects:   %llu\n", stats.effects);
+    seq_printf(m, "responses: %llu\n", stats.responses);
+    seq_printf(m, "dropped:   %llu\n", stats.dropped);
+    seq_printf(m, "invalid:   %llu\n", stats.invalid);
+    seq_printf(m, "errors:    %llu\n", stats.errors);
+
+    return 0;
+}
+
+/**
+ * aura_gadget_stats_open() - Opens /sys/kernel/debug/lights-aura-gadget/stats
+ *
+ * @inode: Inode of the file
+ * @filp:  File being opened
+ *
+ * @return: Error code
+ */
+static int aura_gadget_stats_open (
+    struct inode *inode,
+    struct file *filp
+){
+    return single_open(filp, aura_gadget_stats_show, inode->i_private);
+}
+
+/**
+ * aura_gadget_stats_reset() - Clears the counters on any write
+ *
+ * @filp:   Open file
+ * @buffer: Unused
+ * @len:    Length of @buffer
+ * @offset: Unused
+ *
+ * @return: @len
+ */
+static ssize_t aura_gadget_stats_reset (
+    struct file *filp,
+    const char __user *buffer,
+    size_t len,
+    loff_t *offset
+){
+    unsigned long flags;
+
+    spin_lock_irqsave(&global.lock, flags);
+    memset(&global.stats, 0, sizeof(global.stats));
+    spin_unlock_irqrestore(&global.lock, flags);
+
+    return len;
+}
+
+static struct file_operations const aura_gadget_stats_fops = {
+    .owner   = THIS_MODULE,
+    .open    = aura_gadget_stats_open,
+    .read    = seq_read,
+    .write   = aura_gadget_stats_reset,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/**
+ * aura_gadget_module_init() - Module entry
+ *
+ * @return: Error code
+ */
+static int __init aura_gadget_module_init (
+    void
+){
+    int err;
+
+    spin_lock_init(&global.lock);
+    hrtimer_init(&global.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+    global.timer.function = aura_gadget_timer;
+
+    global.debugfs = debugfs_create_dir(LIGHTS_MODULE, NULL);
+    debugfs_create_file("stats", 0644, global.debugfs, NULL, &aura_gadget_stats_fops);
+
+    err = usb_composite_probe(&aura_gadget_driver);
+    if (err) {
+        LIGHTS_ERR("Failed to register gadget, is dummy_hcd loaded? %d", err);
+        debugfs_remove_recursive(global.debugfs);
+    }
+
+    return err;
+}
+
+/**
+ * aura_gadget_module_exit() - Module exit
+ */
+static void __exit aura_gadget_module_exit (
+    void
+){
+    usb_composite_unregister(&aura_gadget_driver);
+    debugfs_remove_recursive(global.debugfs);
+}
+
+module_init(aura_gadget_module_init);
+module_exit(aura_gadget_module_exit);
+
+MODULE_AUTHOR("Owen Parry <twifty@zoho.com>");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Emulated ASUS AURA ARGB header controller");
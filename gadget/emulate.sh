@@ -0,0 +1,106 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Drives the USB path of lights-aura through the emulated headers.
+#
+# Loads dummy_hcd, the lights modules and lights-aura-gadget from build/,
+# waits for the emulated zones to be bound, then writes led frames and a
+# color to each of them. The time taken and the packet counters of the
+# gadget are printed. Exits non-zero when a write fails, a zone reports
+# an error or the gadget rejected a packet, so it doubles as a
+# regression check.
+#
+# Usage: sudo gadget/emulate.sh [frames]
+#
+# The gadget parameters are taken from the environment:
+#   ZONES=2 INTERVAL=1 LATENCY_US=0 sudo gadget/emulate.sh 2000
+
+set -euo pipefail
+
+FRAMES=${1:-1000}
+ZONES=${ZONES:-2}
+INTERVAL=${INTERVAL:-1}
+LATENCY_US=${LATENCY_US:-0}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$ROOT/build
+STATS=/sys/kernel/debug/lights-aura-gadget/stats
+TMP=$(mktemp -d)
+
+fail () {
+    echo "emulate: $*" >&2
+    exit 1
+}
+
+cleanup () {
+    rmmod lights-aura-gadget 2>/dev/null || true
+    rm -rf "$TMP"
+}
+
+[[ $EUID -eq 0 ]] || fail "must be run as root"
+
+for module in lights lights-aura lights-aura-gadget; do
+    [[ -f $BUILD/$module.ko ]] || fail "$BUILD/$module.ko missing, run 'make build gadget'"
+done
+
+trap cleanup EXIT
+
+modprobe dummy_hcd
+modprobe libcomposite
+
+lsmod | grep -q '^lights ' || insmod "$BUILD/lights.ko"
+lsmod | grep -q '^lights_aura ' || insmod "$BUILD/lights-aura.ko"
+
+insmod "$BUILD/lights-aura-gadget.ko" zones="$ZONES" interval="$INTERVAL" latency_us="$LATENCY_US"
+
+# Binding, and reading the config table which follows, takes a moment
+zones=()
+for _ in $(seq 50); do
+    mapfile -t zones < <(ls -d /dev/lights/argb-strip-* 2>/dev/null || true)
+    [[ ${#zones[@]} -ge $ZONES ]] && break
+    sleep 0.1
+done
+[[ ${#zones[@]} -ge $ZONES ]] || fail "found ${#zones[@]} of $ZONES emulated zones"
+
+echo > "$STATS"
+
+start=$(date +%s%N)
+
+for zone in "${zones[@]}"; do
+    name=$(basename "$zone")
+    size=$(( $(cat "/sys/class/lights/$name/led_count") * 3 ))
+
+    # Alternate between all leds off and all leds white
+    head -c "$size" /dev/zero > "$TMP/off"
+    head -c "$size" /dev/zero | tr '\0' '\377' > "$TMP/on"
+
+    echo direct > "$zone/effect"
+
+    for i in $(seq "$FRAMES"); do
+        frame=$TMP/off
+        (( i % 2 )) && frame=$TMP/on
+
+        dd if="$frame" of="$zone/leds" bs="$size" count=1 conv=notrunc status=none ||
+            fail "failed to write frame $i to $name"
+    done
+
+    echo static > "$zone/effect"
+    echo "#ff0000" > "$zone/color" || fail "failed to write the color of $name"
+done
+
+elapsed=$(( ($(date +%s%N) - start) / 1000 ))
+
+echo "zones:     ${#zones[@]}"
+echo "frames:    $FRAMES per zone"
+echo "elapsed:   $elapsed us"
+echo "per frame: $(( elapsed / (FRAMES * ${#zones[@]}) )) us"
+cat "$STATS"
+
+for zone in "${zones[@]}"; do
+    name=$(basename "$zone")
+    err=$(cat "/sys/class/lights/$name/error")
+    [[ $err == 0 ]] || fail "$name reports $err"
+done
+
+grep -q '^invalid: *0$' "$STATS" || fail "the gadget rejected packets"
+grep -q '^errors: *0$' "$STATS" || fail "the gadget saw transfer errors"